@@ -0,0 +1,328 @@
+/*
+ * Copyright © 2015 Red Hat, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "evdev-mt-protocol-a.h"
+
+static inline void
+mt_emit(struct mt_protocol_a *mt,
+	const struct timeval *time,
+	uint16_t type,
+	uint16_t code,
+	int32_t value)
+{
+	struct input_event ev;
+
+	ev.time = *time;
+	ev.type = type;
+	ev.code = code;
+	ev.value = value;
+
+	mt->emit(&ev, mt->emit_data);
+}
+
+static inline void
+mt_emit_slot(struct mt_protocol_a *mt,
+	     const struct timeval *time,
+	     int slot)
+{
+	if (mt->slot == slot)
+		return;
+
+	mt->slot = slot;
+	mt_emit(mt, time, EV_ABS, ABS_MT_SLOT, slot);
+}
+
+static inline void
+mt_clear_current(struct mt_protocol_a *mt)
+{
+	mt->current.x = 0;
+	mt->current.y = 0;
+	mt->current.has_x = false;
+	mt->current.has_y = false;
+	mt->current.tracking_id = -1;
+	mt->current_dirty = false;
+}
+
+static void
+mt_commit_contact(struct mt_protocol_a *mt)
+{
+	if (mt->current_dirty &&
+	    mt->ncontacts < MT_PROTOCOL_A_MAX_SLOTS)
+		mt->contacts[mt->ncontacts++] = mt->current;
+
+	mt_clear_current(mt);
+}
+
+static inline bool
+mt_contact_has_position(const struct mt_protocol_a_contact *contact)
+{
+	return contact->has_x && contact->has_y;
+}
+
+static inline uint64_t
+mt_distance_squared(const struct mt_protocol_a_slot *slot,
+		    const struct mt_protocol_a_contact *contact)
+{
+	int64_t dx = (int64_t)slot->x - contact->x;
+	int64_t dy = (int64_t)slot->y - contact->y;
+
+	return dx * dx + dy * dy;
+}
+
+/* Fills slot_contact with the index of the contact for each slot, or -1
+ * if the slot is unused in this frame */
+static void
+mt_match_contacts(struct mt_protocol_a *mt, int *slot_contact)
+{
+	bool assigned[MT_PROTOCOL_A_MAX_SLOTS] = { false };
+	struct mt_protocol_a_contact *contact;
+	struct mt_protocol_a_slot *slot;
+	unsigned int c, s;
+
+	for (s = 0; s < MT_PROTOCOL_A_MAX_SLOTS; s++)
+		slot_contact[s] = -1;
+
+	/* Devices that send tracking IDs tell us who's who */
+	for (c = 0; c < mt->ncontacts; c++) {
+		contact = &mt->contacts[c];
+		if (contact->tracking_id == -1)
+			continue;
+
+		for (s = 0; s < MT_PROTOCOL_A_MAX_SLOTS; s++) {
+			slot = &mt->slots[s];
+			if (slot->active &&
+			    slot_contact[s] == -1 &&
+			    slot->hw_tracking_id == contact->tracking_id) {
+				slot_contact[s] = c;
+				assigned[c] = true;
+				break;
+			}
+		}
+	}
+
+	/* For everything else, repeatedly pick the closest contact/slot
+	 * pair until we run out of either. With the handful of contacts
+	 * we see in practice this beats a full minimum-cost assignment. */
+	while (true) {
+		uint64_t distance, best = UINT64_MAX;
+		int best_contact = -1,
+		    best_slot = -1;
+
+		for (c = 0; c < mt->ncontacts; c++) {
+			if (assigned[c])
+				continue;
+
+			contact = &mt->contacts[c];
+			if (!mt_contact_has_position(contact))
+				continue;
+
+			for (s = 0; s < MT_PROTOCOL_A_MAX_SLOTS; s++) {
+				slot = &mt->slots[s];
+				if (!slot->active || slot_contact[s] != -1)
+					continue;
+
+				/* both have IDs, but different ones */
+				if (slot->hw_tracking_id != -1 &&
+				    contact->tracking_id != -1)
+					continue;
+
+				distance = mt_distance_squared(slot, contact);
+				if (distance < best) {
+					best = distance;
+					best_contact = c;
+					best_slot = s;
+				}
+			}
+		}
+
+		if (best_contact == -1)
+			break;
+
+		slot_contact[best_slot] = best_contact;
+		assigned[best_contact] = true;
+	}
+
+	/* New contacts only go into slots that were free in the last
+	 * frame, a slot can't end and start a touch in the same frame.
+	 * A contact needs a position to start a touch, a tracking ID on
+	 * its own only keeps an existing one going. */
+	s = 0;
+	for (c = 0; c < mt->ncontacts; c++) {
+		if (assigned[c] || !mt_contact_has_position(&mt->contacts[c]))
+			continue;
+
+		while (s < MT_PROTOCOL_A_MAX_SLOTS &&
+		       (mt->slots[s].active || slot_contact[s] != -1))
+			s++;
+
+		if (s == MT_PROTOCOL_A_MAX_SLOTS)
+			break;
+
+		slot_contact[s] = c;
+		assigned[c] = true;
+	}
+}
+
+static void
+mt_flush_frame(struct mt_protocol_a *mt, const struct timeval *time)
+{
+	int slot_contact[MT_PROTOCOL_A_MAX_SLOTS];
+	struct mt_protocol_a_contact *contact;
+	struct mt_protocol_a_slot *slot;
+	int s;
+
+	if (mt->ncontacts == 0 && mt->nactive == 0)
+		return;
+
+	mt_match_contacts(mt, slot_contact);
+
+	for (s = 0; s < MT_PROTOCOL_A_MAX_SLOTS; s++) {
+		slot = &mt->slots[s];
+
+		if (slot_contact[s] == -1) {
+			if (slot->active) {
+				mt_emit_slot(mt, time, s);
+				mt_emit(mt, time, EV_ABS, ABS_MT_TRACKING_ID, -1);
+				slot->active = false;
+				mt->nactive--;
+			}
+			continue;
+		}
+
+		contact = &mt->contacts[slot_contact[s]];
+
+		if (!slot->active) {
+			slot->active = true;
+			slot->tracking_id = mt->next_tracking_id;
+			slot->hw_tracking_id = contact->tracking_id;
+			mt->next_tracking_id = (mt->next_tracking_id + 1) &
+					       MT_PROTOCOL_A_TRACKING_ID_MAX;
+			mt->nactive++;
+
+			mt_emit_slot(mt, time, s);
+			mt_emit(mt, time, EV_ABS, ABS_MT_TRACKING_ID,
+				slot->tracking_id);
+			mt_emit(mt, time, EV_ABS, ABS_MT_POSITION_X, contact->x);
+			mt_emit(mt, time, EV_ABS, ABS_MT_POSITION_Y, contact->y);
+		} else {
+			/* an axis the device didn't send stays where it was */
+			if (!contact->has_x)
+				contact->x = slot->x;
+			if (!contact->has_y)
+				contact->y = slot->y;
+
+			if (slot->x != contact->x) {
+				mt_emit_slot(mt, time, s);
+				mt_emit(mt, time, EV_ABS, ABS_MT_POSITION_X,
+					contact->x);
+			}
+			if (slot->y != contact->y) {
+				mt_emit_slot(mt, time, s);
+				mt_emit(mt, time, EV_ABS, ABS_MT_POSITION_Y,
+					contact->y);
+			}
+		}
+
+		slot->x = contact->x;
+		slot->y = contact->y;
+	}
+}
+
+void
+mt_protocol_a_init(struct mt_protocol_a *mt,
+		   mt_protocol_a_emit_func emit,
+		   void *data)
+{
+	memset(mt, 0, sizeof(*mt));
+
+	mt->emit = emit;
+	mt->emit_data = data;
+
+	mt_protocol_a_reset(mt);
+}
+
+void
+mt_protocol_a_reset(struct mt_protocol_a *mt)
+{
+	int s;
+
+	for (s = 0; s < MT_PROTOCOL_A_MAX_SLOTS; s++) {
+		mt->slots[s].active = false;
+		mt->slots[s].tracking_id = -1;
+		mt->slots[s].hw_tracking_id = -1;
+	}
+
+	mt->nactive = 0;
+	mt->ncontacts = 0;
+	mt_clear_current(mt);
+}
+
+void
+mt_protocol_a_process(struct mt_protocol_a *mt, struct input_event *ev)
+{
+	switch (ev->type) {
+	case EV_ABS:
+		switch (ev->code) {
+		case ABS_MT_POSITION_X:
+			mt->current.x = ev->value;
+			mt->current.has_x = true;
+			mt->current_dirty = true;
+			return;
+		case ABS_MT_POSITION_Y:
+			mt->current.y = ev->value;
+			mt->current.has_y = true;
+			mt->current_dirty = true;
+			return;
+		case ABS_MT_TRACKING_ID:
+			mt->current.tracking_id = ev->value;
+			mt->current_dirty = true;
+			return;
+		default:
+			/* We don't use any of the other MT axes */
+			if (ev->code >= ABS_MT_SLOT && ev->code <= ABS_MAX)
+				return;
+			break;
+		}
+		break;
+	case EV_SYN:
+		switch (ev->code) {
+		case SYN_MT_REPORT:
+			mt_commit_contact(mt);
+			return;
+		case SYN_REPORT:
+			/* some devices skip the SYN_MT_REPORT for the last
+			 * contact */
+			mt_commit_contact(mt);
+			mt_flush_frame(mt, &ev->time);
+			mt->ncontacts = 0;
+			break;
+		}
+		break;
+	}
+
+	mt->emit(ev, mt->emit_data);
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright © 2015 Red Hat, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef EVDEV_MT_PROTOCOL_A_H
+#define EVDEV_MT_PROTOCOL_A_H
+
+#include "config.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "linux/input.h"
+
+/* Contacts beyond this number in a single frame are dropped. Same limit
+ * as mtdev, which we used to do the conversion. */
+#define MT_PROTOCOL_A_MAX_SLOTS 32
+
+/* Kernel tracking IDs wrap at this value too, see input_mt_new_trkid() */
+#define MT_PROTOCOL_A_TRACKING_ID_MAX 0xffff
+
+typedef void (*mt_protocol_a_emit_func)(struct input_event *ev, void *data);
+
+struct mt_protocol_a_contact {
+	int32_t x, y;
+	bool has_x, has_y; /* whether the device sent the position */
+	int32_t tracking_id; /* as sent by the device, -1 if none */
+};
+
+struct mt_protocol_a_slot {
+	bool active;
+	int32_t tracking_id; /* the one we emit */
+	int32_t hw_tracking_id; /* the one the device sent, -1 if none */
+	int32_t x, y;
+};
+
+/**
+ * Converts a Protocol A event stream (contacts separated by
+ * SYN_MT_REPORT) into the slotted Protocol B. Contacts are buffered
+ * until SYN_REPORT, then matched to the previous frame's slots and only
+ * the changed slot state is passed on to the emit function. All other
+ * events are passed on immediately.
+ */
+struct mt_protocol_a {
+	struct mt_protocol_a_contact contacts[MT_PROTOCOL_A_MAX_SLOTS];
+	unsigned int ncontacts;
+	struct mt_protocol_a_contact current;
+	bool current_dirty;
+
+	struct mt_protocol_a_slot slots[MT_PROTOCOL_A_MAX_SLOTS];
+	unsigned int nactive;
+	int slot; /* last ABS_MT_SLOT value passed on */
+	int32_t next_tracking_id;
+
+	mt_protocol_a_emit_func emit;
+	void *emit_data;
+};
+
+void
+mt_protocol_a_init(struct mt_protocol_a *mt,
+		   mt_protocol_a_emit_func emit,
+		   void *data);
+
+/**
+ * Drop all contacts without passing on any events, e.g. after the
+ * device was suspended.
+ */
+void
+mt_protocol_a_reset(struct mt_protocol_a *mt);
+
+void
+mt_protocol_a_process(struct mt_protocol_a *mt, struct input_event *ev);
+
+#endif
@@ -407,6 +407,9 @@ tp_button_handle_event(struct tp_dispatch *tp,
 		break;
 	}
 
+	PROBE6(tp_button_state, tp->device, t - tp->touches,
+	       current, event, t->button.state, time);
+
 	if (current != t->button.state)
 		log_debug(libinput,
 			  "button state: from %s, event %s to %s\n",
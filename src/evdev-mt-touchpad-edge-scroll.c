@@ -205,8 +205,11 @@ tp_edge_scroll_handle_area(struct tp_dispatch *tp,
 static void
 tp_edge_scroll_handle_event(struct tp_dispatch *tp,
 			    struct tp_touch *t,
-			    enum scroll_event event)
+			    enum scroll_event event,
+			    uint64_t time)
 {
+	enum tp_edge_scroll_touch_state current = t->scroll.edge_state;
+
 	switch (t->scroll.edge_state) {
 	case EDGE_SCROLL_TOUCH_STATE_NONE:
 		tp_edge_scroll_handle_none(tp, t, event);
@@ -221,6 +224,9 @@ tp_edge_scroll_handle_event(struct tp_dispatch *tp,
 		tp_edge_scroll_handle_area(tp, t, event);
 		break;
 	}
+
+	PROBE6(tp_edge_scroll_state, tp->device, t - tp->touches,
+	       current, event, t->scroll.edge_state, time);
 }
 
 static void
@@ -228,7 +234,7 @@ tp_edge_scroll_handle_timeout(uint64_t now, void *data)
 {
 	struct tp_touch *t = data;
 
-	tp_edge_scroll_handle_event(t->tp, t, SCROLL_EVENT_TIMEOUT);
+	tp_edge_scroll_handle_event(t->tp, t, SCROLL_EVENT_TIMEOUT, now);
 }
 
 int
@@ -296,13 +302,16 @@ tp_edge_scroll_handle_state(struct tp_dispatch *tp, uint64_t time)
 		case TOUCH_NONE:
 			break;
 		case TOUCH_BEGIN:
-			tp_edge_scroll_handle_event(tp, t, SCROLL_EVENT_TOUCH);
+			tp_edge_scroll_handle_event(tp, t, SCROLL_EVENT_TOUCH,
+						    time);
 			break;
 		case TOUCH_UPDATE:
-			tp_edge_scroll_handle_event(tp, t, SCROLL_EVENT_MOTION);
+			tp_edge_scroll_handle_event(tp, t, SCROLL_EVENT_MOTION,
+						    time);
 			break;
 		case TOUCH_END:
-			tp_edge_scroll_handle_event(tp, t, SCROLL_EVENT_RELEASE);
+			tp_edge_scroll_handle_event(tp, t, SCROLL_EVENT_RELEASE,
+						    time);
 			break;
 		}
 	}
@@ -354,7 +363,7 @@ tp_edge_scroll_post_events(struct tp_dispatch *tp, uint64_t time)
 				    *delta);
 		t->scroll.direction = axis;
 
-		tp_edge_scroll_handle_event(tp, t, SCROLL_EVENT_POSTED);
+		tp_edge_scroll_handle_event(tp, t, SCROLL_EVENT_POSTED, time);
 	}
 
 	return 0; /* Edge touches are suppressed by edge_scroll_touch_active */
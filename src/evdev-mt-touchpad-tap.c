@@ -519,6 +519,8 @@ tp_tap_handle_event(struct tp_dispatch *tp,
 	if (tp->tap.state == TAP_STATE_IDLE || tp->tap.state == TAP_STATE_DEAD)
 		tp_tap_clear_timer(tp);
 
+	PROBE5(tp_tap_state, tp->device, current, event, tp->tap.state, time);
+
 	log_debug(libinput,
 		  "tap state: %s → %s → %s\n",
 		  tap_state_to_str(current),
@@ -73,7 +73,7 @@ tp_filter_motion(struct tp_dispatch *tp,
 		*dy_unaccel = motion.dy;
 
 	if (motion.dx != 0.0 || motion.dy != 0.0)
-		filter_dispatch(tp->device->pointer.filter, &motion, tp, time);
+		evdev_filter_dispatch(tp->device, &motion, tp, time);
 
 	*dx = motion.dx;
 	*dy = motion.dy;
@@ -430,6 +430,12 @@ tp_post_twofinger_scroll(struct tp_dispatch *tp, uint64_t time)
 	if (nchanged == 0)
 		return;
 
+	if (!libinput_device_wants_event(&tp->device->base,
+					 LIBINPUT_EVENT_POINTER_AXIS)) {
+		tp->device->pointer.filter_stale = true;
+		return;
+	}
+
 	dx /= nchanged;
 	dy /= nchanged;
 
@@ -666,6 +672,12 @@ tp_post_pointer_motion(struct tp_dispatch *tp, uint64_t time)
 	double dx = 0.0, dy = 0.0;
 	double dx_unaccel, dy_unaccel;
 
+	if (!libinput_device_wants_event(&tp->device->base,
+					 LIBINPUT_EVENT_POINTER_MOTION)) {
+		tp->device->pointer.filter_stale = true;
+		return;
+	}
+
 	/* When a clickpad is clicked, combine motion of all active touches */
 	if (tp->buttons.is_clickpad && tp->buttons.state)
 		tp_get_active_touches_delta(tp, &dx, &dy);
@@ -746,6 +758,7 @@ tp_remove_sendevents(struct tp_dispatch *tp)
 
 	if (tp->buttons.trackpoint)
 		libinput_device_remove_event_listener(
+					&tp->buttons.trackpoint->base,
 					&tp->sendevents.trackpoint_listener);
 }
 
@@ -768,8 +781,8 @@ tp_destroy(struct evdev_dispatch *dispatch)
 		(struct tp_dispatch*)dispatch;
 
 
-	free(tp->touches);
-	free(tp);
+	free_tag(LIBINPUT_MEMORY_TAG_TOUCHPAD, tp->touches);
+	free_tag(LIBINPUT_MEMORY_TAG_TOUCHPAD, tp);
 }
 
 static void
@@ -840,16 +853,18 @@ tp_trackpoint_timeout(uint64_t now, void *data)
 	tp->sendevents.trackpoint_active = false;
 }
 
+/* Buttons do not count as trackpad activity, as people may use
+   the trackpoint buttons in combination with the touchpad. */
+#define TP_TRACKPOINT_ACTIVITY_EVENTS \
+	(event_type_mask(LIBINPUT_EVENT_POINTER_MOTION) | \
+	 event_type_mask(LIBINPUT_EVENT_POINTER_MOTION_ABSOLUTE) | \
+	 event_type_mask(LIBINPUT_EVENT_POINTER_AXIS))
+
 static void
 tp_trackpoint_event(uint64_t time, struct libinput_event *event, void *data)
 {
 	struct tp_dispatch *tp = data;
 
-	/* Buttons do not count as trackpad activity, as people may use
-	   the trackpoint buttons in combination with the touchpad. */
-	if (event->type == LIBINPUT_EVENT_POINTER_BUTTON)
-		return;
-
 	if (!tp->sendevents.trackpoint_active) {
 		evdev_stop_scroll(tp->device,
 				  time,
@@ -875,6 +890,7 @@ tp_device_added(struct evdev_device *device,
 		tp->buttons.trackpoint = added_device;
 		libinput_device_add_event_listener(&added_device->base,
 					&tp->sendevents.trackpoint_listener,
+					TP_TRACKPOINT_ACTIVITY_EVENTS,
 					tp_trackpoint_event, tp);
 	}
 
@@ -900,6 +916,7 @@ tp_device_removed(struct evdev_device *device,
 			tp->buttons.active_is_topbutton = false;
 		}
 		libinput_device_remove_event_listener(
+					&removed_device->base,
 					&tp->sendevents.trackpoint_listener);
 		tp->buttons.trackpoint = NULL;
 	}
@@ -996,7 +1013,8 @@ tp_init_slots(struct tp_dispatch *tp,
 	}
 
 	tp->ntouches = max(tp->real_touches, n_btn_tool_touches);
-	tp->touches = calloc(tp->ntouches, sizeof(struct tp_touch));
+	tp->touches = zalloc_tag(LIBINPUT_MEMORY_TAG_TOUCHPAD,
+				 tp->ntouches * sizeof(struct tp_touch));
 	if (!tp->touches)
 		return -1;
 
@@ -1361,7 +1379,7 @@ evdev_mt_touchpad_create(struct evdev_device *device)
 {
 	struct tp_dispatch *tp;
 
-	tp = zalloc(sizeof *tp);
+	tp = zalloc_tag(LIBINPUT_MEMORY_TAG_TOUCHPAD, sizeof *tp);
 	if (!tp)
 		return NULL;
 
@@ -1372,6 +1390,10 @@ evdev_mt_touchpad_create(struct evdev_device *device)
 		return NULL;
 	}
 
+	/* see tp_device_added */
+	device->interest.tags = EVDEV_TAG_TRACKPOINT |
+				EVDEV_TAG_EXTERNAL_MOUSE;
+
 	device->base.config.sendevents = &tp->sendevents.config;
 
 	tp->sendevents.current_mode = LIBINPUT_CONFIG_SEND_EVENTS_ENABLED;
@@ -30,10 +30,10 @@
 #include "linux/input.h"
 #include <unistd.h>
 #include <fcntl.h>
-#include <mtdev-plumbing.h>
 #include <assert.h>
 #include <time.h>
 #include <math.h>
+#include <pthread.h>
 
 #include "libinput.h"
 #include "evdev.h"
@@ -43,6 +43,10 @@
 #define DEFAULT_AXIS_STEP_DISTANCE 10
 #define DEFAULT_MIDDLE_BUTTON_SCROLL_TIMEOUT 200
 
+/* How much the event loop reads for us at once, see
+ * libinput_add_fd_reader() */
+#define EVDEV_READ_BUFFER_SIZE (64 * sizeof(struct input_event))
+
 enum evdev_key_type {
 	EVDEV_KEY_TYPE_NONE,
 	EVDEV_KEY_TYPE_KEY,
@@ -129,6 +133,16 @@ evdev_pointer_notify_button(struct evdev_device *device,
 
 }
 
+static inline const char *
+evdev_device_get_devnode(struct evdev_device *device)
+{
+	/* virtual devices don't have a device node */
+	if (!device->udev_device)
+		return device->sysname;
+
+	return udev_device_get_devnode(device->udev_device);
+}
+
 void
 evdev_device_led_update(struct evdev_device *device, enum libinput_led leds)
 {
@@ -168,27 +182,60 @@ transform_absolute(struct evdev_device *device, int32_t *x, int32_t *y)
 	matrix_mult_vec(&device->abs.calibration, x, y);
 }
 
-static inline double
-scale_axis(const struct input_absinfo *absinfo, double val, double to_range)
-{
-	return (val - absinfo->minimum) * to_range /
+void
+evdev_axis_transform_update(struct evdev_axis_transform *transform,
+			    const struct input_absinfo *absinfo,
+			    uint32_t to_range)
+{
+	transform->to_range = to_range;
+	transform->minimum = absinfo->minimum;
+	transform->maximum = absinfo->maximum;
+	transform->scale = (double)to_range /
 		(absinfo->maximum - absinfo->minimum + 1);
+	transform->offset = -absinfo->minimum * transform->scale;
 }
 
-double
-evdev_device_transform_x(struct evdev_device *device,
-			 double x,
-			 uint32_t width)
-{
-	return scale_axis(device->abs.absinfo_x, x, width);
+/* The transforms evdev_device_transform_x/y() would use for this output
+ * size, for converting many coordinates in one go */
+void
+evdev_device_get_transform(struct evdev_device *device,
+			   uint32_t width,
+			   uint32_t height,
+			   struct evdev_axis_transform *transform_x,
+			   struct evdev_axis_transform *transform_y)
+{
+	if (device->base.seat->libinput->thread_safe_events) {
+		evdev_axis_transform_update(transform_x,
+					    device->abs.absinfo_x,
+					    width);
+		evdev_axis_transform_update(transform_y,
+					    device->abs.absinfo_y,
+					    height);
+		return;
+	}
+
+	/* refreshes the cache if the size or the axis ranges changed */
+	evdev_device_transform_x(device, 0, width);
+	evdev_device_transform_y(device, 0, height);
+
+	*transform_x = device->abs.transform_x;
+	*transform_y = device->abs.transform_y;
 }
 
-double
-evdev_device_transform_y(struct evdev_device *device,
-			 double y,
-			 uint32_t height)
-{
-	return scale_axis(device->abs.absinfo_y, y, height);
+void
+evdev_filter_dispatch(struct evdev_device *device,
+		      struct motion_params *motion,
+		      void *data,
+		      uint64_t time)
+{
+	/* The trackers missed everything while motion was masked, their
+	 * velocity would be off for the first events after that */
+	if (device->pointer.filter_stale) {
+		filter_restart(device->pointer.filter, data, time);
+		device->pointer.filter_stale = false;
+	}
+
+	filter_dispatch(device->pointer.filter, motion, data, time);
 }
 
 static void
@@ -227,10 +274,16 @@ evdev_flush_pending_event(struct evdev_device *device, uint64_t time)
 			break;
 		}
 
+		if (!libinput_device_wants_event(base,
+						 LIBINPUT_EVENT_POINTER_MOTION)) {
+			device->pointer.filter_stale = true;
+			break;
+		}
+
 		/* Apply pointer acceleration. */
 		motion.dx = dx_unaccel;
 		motion.dy = dy_unaccel;
-		filter_dispatch(device->pointer.filter, &motion, device, time);
+		evdev_filter_dispatch(device, &motion, device, time);
 
 		if (motion.dx == 0.0 && motion.dy == 0.0 &&
 		    dx_unaccel == 0.0 && dy_unaccel == 0.0) {
@@ -249,7 +302,7 @@ evdev_flush_pending_event(struct evdev_device *device, uint64_t time)
 			log_bug_kernel(libinput,
 				       "%s: Driver sent multiple touch down for the "
 				       "same slot",
-				       udev_device_get_devnode(device->udev_device));
+				       evdev_device_get_devnode(device));
 			break;
 		}
 
@@ -259,7 +312,7 @@ evdev_flush_pending_event(struct evdev_device *device, uint64_t time)
 		if (seat_slot == -1)
 			break;
 
-		seat->slot_map |= 1 << seat_slot;
+		seat->slot_map |= 1u << seat_slot;
 		x = device->mt.slots[slot].x;
 		y = device->mt.slots[slot].y;
 		transform_absolute(device, &x, &y);
@@ -290,7 +343,7 @@ evdev_flush_pending_event(struct evdev_device *device, uint64_t time)
 		if (seat_slot == -1)
 			break;
 
-		seat->slot_map &= ~(1 << seat_slot);
+		seat->slot_map &= ~(1u << seat_slot);
 
 		touch_notify_touch_up(base, time, slot, seat_slot);
 		break;
@@ -302,7 +355,7 @@ evdev_flush_pending_event(struct evdev_device *device, uint64_t time)
 			log_bug_kernel(libinput,
 				       "%s: Driver sent multiple touch down for the "
 				       "same slot",
-				       udev_device_get_devnode(device->udev_device));
+				       evdev_device_get_devnode(device));
 			break;
 		}
 
@@ -312,7 +365,7 @@ evdev_flush_pending_event(struct evdev_device *device, uint64_t time)
 		if (seat_slot == -1)
 			break;
 
-		seat->slot_map |= 1 << seat_slot;
+		seat->slot_map |= 1u << seat_slot;
 
 		cx = device->abs.x;
 		cy = device->abs.y;
@@ -348,7 +401,7 @@ evdev_flush_pending_event(struct evdev_device *device, uint64_t time)
 		if (seat_slot == -1)
 			break;
 
-		seat->slot_map &= ~(1 << seat_slot);
+		seat->slot_map &= ~(1u << seat_slot);
 
 		touch_notify_touch_up(base, time, -1, seat_slot);
 		break;
@@ -689,7 +742,7 @@ fallback_process(struct evdev_dispatch *dispatch,
 static void
 fallback_destroy(struct evdev_dispatch *dispatch)
 {
-	free(dispatch);
+	free_tag(LIBINPUT_MEMORY_TAG_DEVICE, dispatch);
 }
 
 static void
@@ -752,6 +805,62 @@ struct evdev_dispatch_interface fallback_interface = {
 	fallback_tag_device,
 };
 
+/* Keyboard-only devices have no pointer or touch state to maintain, so
+ * they skip the pending event and scroll bookkeeping of the fallback
+ * dispatch. EV_SYN and EV_MSC carry nothing we need for keys. */
+static void
+keyboard_process(struct evdev_dispatch *dispatch,
+		 struct evdev_device *device,
+		 struct input_event *e,
+		 uint64_t time)
+{
+	enum evdev_key_type type;
+
+	/* ignore kernel key repeat */
+	if (e->type != EV_KEY || e->value == 2)
+		return;
+
+	/* Ignore key release events from the kernel for keys that libinput
+	 * never got a pressed event for. */
+	if (e->value == 0 && !hw_is_key_down(device, e->code))
+		return;
+
+	type = get_key_type(e->code);
+	hw_set_key_down(device, e->code, e->value);
+
+	switch (type) {
+	case EVDEV_KEY_TYPE_NONE:
+		break;
+	case EVDEV_KEY_TYPE_KEY:
+		evdev_keyboard_notify_key(
+			device,
+			time,
+			e->code,
+			e->value ? LIBINPUT_KEY_STATE_PRESSED :
+				   LIBINPUT_KEY_STATE_RELEASED);
+		break;
+	case EVDEV_KEY_TYPE_BUTTON:
+		evdev_pointer_notify_button(
+			device,
+			time,
+			e->code,
+			e->value ? LIBINPUT_BUTTON_STATE_PRESSED :
+				   LIBINPUT_BUTTON_STATE_RELEASED);
+		break;
+	}
+}
+
+struct evdev_dispatch_interface keyboard_interface = {
+	keyboard_process,
+	NULL, /* remove */
+	fallback_destroy,
+	NULL, /* device_added */
+	NULL, /* device_removed */
+	NULL, /* device_suspended */
+	NULL, /* device_resumed */
+	fallback_tag_device,
+};
+
 static uint32_t
 evdev_sendevents_get_modes(struct libinput_device *device)
 {
@@ -1044,7 +1153,8 @@ evdev_init_natural_scroll(struct evdev_device *device)
 static struct evdev_dispatch *
 fallback_dispatch_create(struct libinput_device *device)
 {
-	struct evdev_dispatch *dispatch = zalloc(sizeof *dispatch);
+	struct evdev_dispatch *dispatch = zalloc_tag(LIBINPUT_MEMORY_TAG_DEVICE,
+						     sizeof *dispatch);
 	struct evdev_device *evdev_device = (struct evdev_device *)device;
 
 	if (dispatch == NULL)
@@ -1055,14 +1165,14 @@ fallback_dispatch_create(struct libinput_device *device)
 	if (evdev_device->buttons.want_left_handed &&
 	    evdev_init_left_handed(evdev_device,
 				   evdev_change_to_left_handed) == -1) {
-		free(dispatch);
+		free_tag(LIBINPUT_MEMORY_TAG_DEVICE, dispatch);
 		return NULL;
 	}
 
 	if (evdev_device->scroll.want_button &&
 	    evdev_init_button_scroll(evdev_device,
 				     evdev_change_scroll_method) == -1) {
-		free(dispatch);
+		free_tag(LIBINPUT_MEMORY_TAG_DEVICE, dispatch);
 		return NULL;
 	}
 
@@ -1075,31 +1185,73 @@ fallback_dispatch_create(struct libinput_device *device)
 	return dispatch;
 }
 
+static inline bool
+evdev_is_keyboard_only(struct evdev_device *device)
+{
+	/* Keyboards with a wheel still need the fallback to post axis
+	 * events */
+	return device->seat_caps == EVDEV_DEVICE_KEYBOARD &&
+	       !libevdev_has_event_type(device->evdev, EV_REL) &&
+	       !libevdev_has_event_type(device->evdev, EV_ABS);
+}
+
+static struct evdev_dispatch *
+keyboard_dispatch_create(struct libinput_device *device)
+{
+	struct evdev_dispatch *dispatch = zalloc_tag(LIBINPUT_MEMORY_TAG_DEVICE,
+						     sizeof *dispatch);
+	struct evdev_device *evdev_device = (struct evdev_device *)device;
+
+	if (dispatch == NULL)
+		return NULL;
+
+	dispatch->interface = &keyboard_interface;
+
+	evdev_init_sendevents(evdev_device, dispatch);
+
+	return dispatch;
+}
+
 static inline void
 evdev_process_event(struct evdev_device *device, struct input_event *e)
 {
 	struct evdev_dispatch *dispatch = device->dispatch;
 	uint64_t time = e->time.tv_sec * 1000ULL + e->time.tv_usec / 1000;
 
+	/* all events we generate until the SYN_REPORT share one frame
+	 * sequence number */
+	if (!device->base.in_frame) {
+		device->base.in_frame = 1;
+		device->base.frame_seq = ++device->base.last_seq;
+		PROBE3(frame_begin, device, device->base.frame_seq, time);
+	}
+
+	device->base.in_process = 1;
 	dispatch->interface->process(dispatch, device, e, time);
+	device->base.in_process = 0;
+
+	if (e->type == EV_SYN && e->code == SYN_REPORT) {
+		device->base.in_frame = 0;
+		PROBE3(frame_end, device, device->base.frame_seq, time);
+	}
+}
+
+static void
+evdev_protocol_a_emit(struct input_event *ev, void *data)
+{
+	struct evdev_device *device = data;
+
+	evdev_process_event(device, ev);
 }
 
 static inline void
 evdev_device_dispatch_one(struct evdev_device *device,
 			  struct input_event *ev)
 {
-	if (!device->mtdev) {
+	if (!device->protocol_a)
 		evdev_process_event(device, ev);
-	} else {
-		mtdev_put_event(device->mtdev, ev);
-		if (libevdev_event_is_code(ev, EV_SYN, SYN_REPORT)) {
-			while (!mtdev_empty(device->mtdev)) {
-				struct input_event e;
-				mtdev_get_event(device->mtdev, &e);
-				evdev_process_event(device, &e);
-			}
-		}
-	}
+	else
+		mt_protocol_a_process(device->protocol_a, ev);
 }
 
 static int
@@ -1119,51 +1271,111 @@ evdev_sync_device(struct evdev_device *device)
 	return rc == -EAGAIN ? 0 : rc;
 }
 
+/* ev is the SYN_DROPPED event, libevdev must be in sync mode */
+static int
+evdev_device_handle_syn_dropped(struct evdev_device *device,
+				struct input_event *ev)
+{
+	struct libinput *libinput = device->base.seat->libinput;
+
+	PROBE2(syn_dropped, device,
+	       ev->time.tv_sec * 1000ULL + ev->time.tv_usec / 1000);
+
+	switch (ratelimit_test(&device->syn_drop_limit)) {
+	case RATELIMIT_PASS:
+		log_info(libinput, "SYN_DROPPED event from "
+			 "\"%s\" - some input events have "
+			 "been lost.\n", device->devname);
+		break;
+	case RATELIMIT_THRESHOLD:
+		log_info(libinput, "SYN_DROPPED flood "
+			 "from \"%s\"\n",
+			 device->devname);
+		break;
+	case RATELIMIT_EXCEEDED:
+		break;
+	}
+
+	/* send one more sync event so we handle all
+	   currently pending events before we sync up
+	   to the current state */
+	ev->code = SYN_REPORT;
+	evdev_device_dispatch_one(device, ev);
+
+	return evdev_sync_device(device);
+}
+
+/* We read the events ourselves and libevdev only tracks the device
+ * state, this keeps that up to date. Returns false for events libevdev
+ * would have discarded, e.g. for codes we disabled. */
+static inline bool
+evdev_update_libevdev_state(struct evdev_device *device,
+			    const struct input_event *ev)
+{
+	switch (ev->type) {
+	case EV_SYN:
+		return true;
+	case EV_KEY:
+	case EV_ABS:
+	case EV_LED:
+	case EV_SW:
+		return libevdev_set_event_value(device->evdev,
+						ev->type,
+						ev->code,
+						ev->value) == 0;
+	default:
+		return libevdev_has_event_code(device->evdev,
+					       ev->type,
+					       ev->code);
+	}
+}
+
+/* Called with each batch of events the event loop read for us, see
+ * libinput_add_fd_reader(). The events are processed in place, libevdev
+ * is only needed again after a SYN_DROPPED. */
 static void
-evdev_device_dispatch(void *data)
+evdev_device_dispatch(void *data, void *buffer, ssize_t len)
 {
 	struct evdev_device *device = data;
 	struct libinput *libinput = device->base.seat->libinput;
-	struct input_event ev;
-	int rc;
+	struct input_event *events = buffer;
+	struct input_event *ev;
+	struct input_event sync_ev;
+	size_t i, nevents;
+	int rc = 0;
+
+	if (len < 0) {
+		if (len != -EAGAIN && len != -EINTR) {
+			libinput_remove_source(libinput, device->source);
+			device->source = NULL;
+		}
+		return;
+	}
 
-	/* If the compositor is repainting, this function is called only once
-	 * per frame and we have to process all the events available on the
-	 * fd, otherwise there will be input lag. */
-	do {
-		rc = libevdev_next_event(device->evdev,
-					 LIBEVDEV_READ_FLAG_NORMAL, &ev);
-		if (rc == LIBEVDEV_READ_STATUS_SYNC) {
-			switch (ratelimit_test(&device->syn_drop_limit)) {
-			case RATELIMIT_PASS:
-				log_info(libinput, "SYN_DROPPED event from "
-					 "\"%s\" - some input events have "
-					 "been lost.\n", device->devname);
-				break;
-			case RATELIMIT_THRESHOLD:
-				log_info(libinput, "SYN_DROPPED flood "
-					 "from \"%s\"\n",
-					 device->devname);
-				break;
-			case RATELIMIT_EXCEEDED:
-				break;
-			}
+	nevents = len / sizeof(*events);
+	PROBE2(dispatch_entry, device, nevents);
 
-			/* send one more sync event so we handle all
-			   currently pending events before we sync up
-			   to the current state */
-			ev.code = SYN_REPORT;
-			evdev_device_dispatch_one(device, &ev);
-
-			rc = evdev_sync_device(device);
-			if (rc == 0)
-				rc = LIBEVDEV_READ_STATUS_SUCCESS;
-		} else if (rc == LIBEVDEV_READ_STATUS_SUCCESS) {
-			evdev_device_dispatch_one(device, &ev);
+	for (i = 0; i < nevents; i++) {
+		ev = &events[i];
+
+		if (ev->type == EV_SYN && ev->code == SYN_DROPPED) {
+			/* Everything up to the next SYN_REPORT is garbage
+			 * and the rest predates the state we sync to, so
+			 * drop the rest of the buffer */
+			libevdev_next_event(device->evdev,
+					    LIBEVDEV_READ_FLAG_FORCE_SYNC,
+					    &sync_ev);
+			rc = evdev_device_handle_syn_dropped(device, ev);
+			break;
 		}
-	} while (rc == LIBEVDEV_READ_STATUS_SUCCESS);
 
-	if (rc != -EAGAIN && rc != -EINTR) {
+		if (evdev_update_libevdev_state(device, ev))
+			evdev_device_dispatch_one(device, ev);
+	}
+
+	PROBE2(dispatch_exit, device, i);
+
+	if (rc != 0 && rc != -EINTR) {
 		libinput_remove_source(libinput, device->source);
 		device->source = NULL;
 	}
@@ -1222,7 +1434,7 @@ evdev_device_init_pointer_acceleration(struct evdev_device *device)
 
 
 static inline int
-evdev_need_mtdev(struct evdev_device *device)
+evdev_is_protocol_a(struct evdev_device *device)
 {
 	struct libevdev *evdev = device->evdev;
 
@@ -1295,7 +1507,7 @@ evdev_configure_device(struct evdev_device *device)
 	int active_slot;
 	int slot;
 	unsigned int i;
-	const char *devnode = udev_device_get_devnode(device->udev_device);
+	const char *devnode = evdev_device_get_devnode(device);
 
 	has_rel = 0;
 	has_abs = 0;
@@ -1360,23 +1572,26 @@ evdev_configure_device(struct evdev_device *device)
 
 			/* We only handle the slotted Protocol B in libinput.
 			   Devices with ABS_MT_POSITION_* but not ABS_MT_SLOT
-			   require mtdev for conversion. */
-			if (evdev_need_mtdev(device)) {
-				device->mtdev = mtdev_new_open(device->fd);
-				if (!device->mtdev)
+			   are converted to slots as the events come in. */
+			if (evdev_is_protocol_a(device)) {
+				device->protocol_a =
+					zalloc_tag(LIBINPUT_MEMORY_TAG_DEVICE,
+						   sizeof *device->protocol_a);
+				if (!device->protocol_a)
 					return -1;
 
-				num_slots = device->mtdev->caps.slot.maximum;
-				if (device->mtdev->caps.slot.minimum < 0 ||
-				    num_slots <= 0)
-					return -1;
-				active_slot = device->mtdev->caps.slot.value;
+				mt_protocol_a_init(device->protocol_a,
+						   evdev_protocol_a_emit,
+						   device);
+				num_slots = MT_PROTOCOL_A_MAX_SLOTS;
+				active_slot = device->protocol_a->slot;
 			} else {
 				num_slots = libevdev_get_num_slots(device->evdev);
 				active_slot = libevdev_get_current_slot(evdev);
 			}
 
-			slots = calloc(num_slots, sizeof(struct mt_slot));
+			slots = zalloc_tag(LIBINPUT_MEMORY_TAG_DEVICE,
+					   num_slots * sizeof(struct mt_slot));
 			if (!slots)
 				return -1;
 
@@ -1468,27 +1683,55 @@ evdev_configure_device(struct evdev_device *device)
 	return 0;
 }
 
+static inline bool
+evdev_device_has_interest(struct evdev_device *device)
+{
+	return device->interest.tags != 0 || device->interest.seat_caps != 0;
+}
+
+static inline bool
+evdev_device_is_interested_in(struct evdev_device *device,
+			      struct evdev_device *other)
+{
+	return (device->interest.tags & other->tags) ||
+	       (device->interest.seat_caps & other->seat_caps);
+}
+
 static void
 evdev_notify_added_device(struct evdev_device *device)
 {
+	struct libinput_seat *seat = device->base.seat;
 	struct libinput_device *dev;
+	struct evdev_device *d;
 
-	list_for_each(dev, &device->base.seat->devices_list, link) {
-		struct evdev_device *d = (struct evdev_device*)dev;
-		if (dev == &device->base)
+	/* Notify existing devices interested in device */
+	list_for_each(d, &seat->interested_devices, interest.link) {
+		if (d == device)
 			continue;
 
-		/* Notify existing device d about addition of device device */
-		if (d->dispatch->interface->device_added)
+		if (d->dispatch->interface->device_added &&
+		    evdev_device_is_interested_in(d, device))
 			d->dispatch->interface->device_added(d, device);
+	}
 
-		/* Notify new device device about existing device d */
-		if (device->dispatch->interface->device_added)
-			device->dispatch->interface->device_added(device, d);
-
-		/* Notify new device device if existing device d is suspended */
-		if (d->suspended && device->dispatch->interface->device_suspended)
-			device->dispatch->interface->device_suspended(device, d);
+	/* Notify device about existing devices, only needed if it cares
+	 * at all */
+	if (evdev_device_has_interest(device)) {
+		list_for_each(dev, &seat->devices_list, link) {
+			d = (struct evdev_device*)dev;
+			if (d == device ||
+			    !evdev_device_is_interested_in(device, d))
+				continue;
+
+			if (device->dispatch->interface->device_added)
+				device->dispatch->interface->device_added(device, d);
+
+			/* Notify new device if existing device d is
+			 * suspended */
+			if (d->suspended &&
+			    device->dispatch->interface->device_suspended)
+				device->dispatch->interface->device_suspended(device, d);
+		}
 	}
 
 	notify_added_device(&device->base);
@@ -1517,47 +1760,247 @@ out:
 	return rc;
 }
 
+/* Use non-blocking mode so that we can loop on read on
+ * evdev_device_data() until all events on the fd are
+ * read. */
+#define EVDEV_OPEN_FLAGS (O_RDWR | O_NONBLOCK)
+
+static int
+evdev_device_verify_fd(struct libinput *libinput,
+		       struct udev_device *udev_device,
+		       int fd)
+{
+	if (fd < 0) {
+		log_info(libinput,
+			 "opening input device '%s' failed (%s).\n",
+			 udev_device_get_devnode(udev_device),
+			 strerror(-fd));
+		return fd;
+	}
+
+	if (evdev_device_compare_syspath(udev_device, fd) != 0) {
+		close_restricted(libinput, fd);
+		return -ENODEV;
+	}
+
+	return fd;
+}
+
+int
+evdev_device_open(struct libinput *libinput,
+		  struct udev_device *udev_device)
+{
+	const char *devnode = udev_device_get_devnode(udev_device);
+	int fd;
+
+	fd = open_restricted(libinput, devnode, EVDEV_OPEN_FLAGS);
+
+	return evdev_device_verify_fd(libinput, udev_device, fd);
+}
+
+struct evdev_open_many {
+	struct udev_device **udev_devices;
+	size_t count;
+	evdev_open_many_done_func done;
+	void *data;
+};
+
+/* Upper limit, fewer threads are started for small batches */
+#define EVDEV_PROBE_THREADS 8
+
+struct evdev_probe {
+	const int *fds;
+	struct libevdev **evdevs;
+	size_t count;
+	size_t next; /* atomic, the next fd to take */
+};
+
+static void *
+evdev_probe_thread(void *data)
+{
+	struct evdev_probe *probe = data;
+	size_t i;
+
+	while ((i = __atomic_fetch_add(&probe->next, 1,
+				       __ATOMIC_RELAXED)) < probe->count) {
+		if (probe->fds[i] < 0 ||
+		    libevdev_new_from_fd(probe->fds[i],
+					 &probe->evdevs[i]) != 0)
+			probe->evdevs[i] = NULL;
+	}
+
+	return NULL;
+}
+
+/* Setting up the libevdev context reads the whole device state, a few
+ * dozen ioctls that each wait for the driver. That only needs the fd and
+ * nothing of ours, so the fds of a batch are set up on several threads at
+ * once. evdevs[i] is NULL where that failed. */
+static void
+evdev_probe_fds(const int *fds, struct libevdev **evdevs, size_t count)
+{
+	pthread_t threads[EVDEV_PROBE_THREADS - 1];
+	struct evdev_probe probe = {
+		.fds = fds,
+		.evdevs = evdevs,
+		.count = count,
+		.next = 0,
+	};
+	size_t nthreads, i;
+
+	/* this thread does its share too */
+	nthreads = count > 1 ? min(count, EVDEV_PROBE_THREADS) - 1 : 0;
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_create(&threads[i], NULL,
+				   evdev_probe_thread, &probe) != 0)
+			break;
+	}
+	nthreads = i;
+
+	evdev_probe_thread(&probe);
+
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+}
+
+static int
+evdev_device_open_many_done(struct libinput *libinput,
+			    int *fds,
+			    size_t count,
+			    void *data)
+{
+	struct evdev_open_many *batch = data;
+	struct libevdev **evdevs;
+	size_t i;
+	int rc = 0;
+
+	/* NULL if cancelled */
+	if (fds) {
+		for (i = 0; i < count; i++)
+			fds[i] = evdev_device_verify_fd(libinput,
+							batch->udev_devices[i],
+							fds[i]);
+
+		/* without evdevs each device sets itself up */
+		evdevs = zalloc_tag(LIBINPUT_MEMORY_TAG_DEVICE,
+				    count * sizeof(*evdevs));
+		if (evdevs)
+			evdev_probe_fds(fds, evdevs, count);
+
+		rc = batch->done(libinput,
+				 batch->udev_devices,
+				 fds,
+				 evdevs,
+				 count,
+				 batch->data);
+		free_tag(LIBINPUT_MEMORY_TAG_DEVICE, evdevs);
+	}
+
+	for (i = 0; i < batch->count; i++)
+		udev_device_unref(batch->udev_devices[i]);
+	free_tag(LIBINPUT_MEMORY_TAG_DEVICE, batch->udev_devices);
+	free_tag(LIBINPUT_MEMORY_TAG_DEVICE, batch);
+
+	return rc;
+}
+
+int
+evdev_device_open_many(struct libinput *libinput,
+		       struct udev_device **udev_devices,
+		       size_t count,
+		       evdev_open_many_done_func done,
+		       void *data)
+{
+	struct evdev_open_many *batch;
+	const char **paths;
+	size_t i;
+	int rc;
+
+	paths = zalloc_tag(LIBINPUT_MEMORY_TAG_DEVICE, count * sizeof(*paths));
+	batch = zalloc_tag(LIBINPUT_MEMORY_TAG_DEVICE, sizeof *batch);
+	if (batch)
+		batch->udev_devices = zalloc_tag(LIBINPUT_MEMORY_TAG_DEVICE,
+						 count * sizeof(*udev_devices));
+
+	if (!paths || !batch || !batch->udev_devices) {
+		if (batch)
+			free_tag(LIBINPUT_MEMORY_TAG_DEVICE,
+				 batch->udev_devices);
+		free_tag(LIBINPUT_MEMORY_TAG_DEVICE, batch);
+		free_tag(LIBINPUT_MEMORY_TAG_DEVICE, paths);
+		return -1;
+	}
+
+	batch->count = count;
+	batch->done = done;
+	batch->data = data;
+
+	for (i = 0; i < count; i++) {
+		batch->udev_devices[i] = udev_device_ref(udev_devices[i]);
+		paths[i] = udev_device_get_devnode(udev_devices[i]);
+	}
+
+	rc = open_restricted_many(libinput,
+				  paths,
+				  count,
+				  EVDEV_OPEN_FLAGS,
+				  evdev_device_open_many_done,
+				  batch);
+	free_tag(LIBINPUT_MEMORY_TAG_DEVICE, paths);
+
+	return rc;
+}
+
 struct evdev_device *
 evdev_device_create(struct libinput_seat *seat,
 		    struct udev_device *udev_device)
 {
-	struct libinput *libinput = seat->libinput;
-	struct evdev_device *device = NULL;
-	int rc;
 	int fd;
-	int unhandled_device = 0;
-	const char *devnode = udev_device_get_devnode(udev_device);
 
-	/* Use non-blocking mode so that we can loop on read on
-	 * evdev_device_data() until all events on the fd are
-	 * read.  mtdev_get() also expects this. */
-	fd = open_restricted(libinput, devnode, O_RDWR | O_NONBLOCK);
-	if (fd < 0) {
-		log_info(libinput,
-			 "opening input device '%s' failed (%s).\n",
-			 devnode, strerror(-fd));
+	fd = evdev_device_open(seat->libinput, udev_device);
+	if (fd < 0)
 		return NULL;
-	}
 
-	if (evdev_device_compare_syspath(udev_device, fd) != 0)
-		goto err;
+	return evdev_device_create_from_fd(seat, udev_device, fd, NULL);
+}
+
+/* Takes ownership of evdev and fd. Virtual devices have no fd and no
+ * udev device, only a sysname */
+static struct evdev_device *
+evdev_device_create_from_evdev(struct libinput_seat *seat,
+			       struct udev_device *udev_device,
+			       const char *sysname,
+			       struct libevdev *evdev,
+			       int fd)
+{
+	struct libinput *libinput = seat->libinput;
+	struct evdev_device *device = NULL;
+	int unhandled_device = 0;
 
-	device = zalloc(sizeof *device);
-	if (device == NULL)
+	device = zalloc_tag(LIBINPUT_MEMORY_TAG_DEVICE, sizeof *device);
+	if (device == NULL) {
+		libevdev_free(evdev);
 		goto err;
+	}
 
 	libinput_device_init(&device->base, seat);
 	libinput_seat_ref(seat);
 
-	rc = libevdev_new_from_fd(fd, &device->evdev);
-	if (rc != 0)
-		goto err;
-
-	libevdev_set_clock_id(device->evdev, CLOCK_MONOTONIC);
+	device->evdev = evdev;
+	if (fd >= 0)
+		libevdev_set_clock_id(device->evdev, CLOCK_MONOTONIC);
+
+	if (sysname) {
+		device->sysname = strdup_tag(LIBINPUT_MEMORY_TAG_DEVICE,
+					     sysname);
+		if (!device->sysname)
+			goto err;
+		device->virtual_open = true;
+	}
 
 	device->seat_caps = 0;
 	device->is_mt = 0;
-	device->mtdev = NULL;
+	device->protocol_a = NULL;
 	device->udev_device = udev_device_ref(udev_device);
 	device->rel.dx = 0;
 	device->rel.dy = 0;
@@ -1566,6 +2009,7 @@ evdev_device_create(struct libinput_seat *seat,
 	device->fd = fd;
 	device->pending_event = EVDEV_NONE;
 	device->devname = libevdev_get_name(device->evdev);
+	PROBE2(device_create, device, device->devname);
 	device->scroll.threshold = 5.0; /* Default may be overridden */
 	device->scroll.direction = 0;
 	device->dpi = evdev_read_dpi_prop(device);
@@ -1584,18 +2028,28 @@ evdev_device_create(struct libinput_seat *seat,
 		goto err;
 	}
 
-	/* If the dispatch was not set up use the fallback. */
-	if (device->dispatch == NULL)
+	/* If the dispatch was not set up use the keyboard or fallback
+	 * dispatch. */
+	if (device->dispatch == NULL && evdev_is_keyboard_only(device))
+		device->dispatch = keyboard_dispatch_create(&device->base);
+	else if (device->dispatch == NULL)
 		device->dispatch = fallback_dispatch_create(&device->base);
 	if (device->dispatch == NULL)
 		goto err;
 
-	device->source =
-		libinput_add_fd(libinput, fd, evdev_device_dispatch, device);
-	if (!device->source)
-		goto err;
+	if (fd >= 0) {
+		device->source = libinput_add_fd_reader(libinput,
+							fd,
+							evdev_device_dispatch,
+							EVDEV_READ_BUFFER_SIZE,
+							device);
+		if (!device->source)
+			goto err;
+	}
 
 	list_insert(seat->devices_list.prev, &device->base.link);
+	if (evdev_device_has_interest(device))
+		list_insert(&seat->interested_devices, &device->interest.link);
 
 	evdev_tag_device(device);
 	evdev_notify_added_device(device);
@@ -1611,6 +2065,85 @@ err:
 	return unhandled_device ? EVDEV_UNHANDLED_DEVICE :  NULL;
 }
 
+struct evdev_device *
+evdev_device_create_from_fd(struct libinput_seat *seat,
+			    struct udev_device *udev_device,
+			    int fd,
+			    struct libevdev *evdev)
+{
+	if (fd < 0) {
+		libevdev_free(evdev);
+		return NULL;
+	}
+
+	if (!evdev && libevdev_new_from_fd(fd, &evdev) != 0) {
+		close_restricted(seat->libinput, fd);
+		return NULL;
+	}
+
+	return evdev_device_create_from_evdev(seat, udev_device, NULL,
+					      evdev, fd);
+}
+
+struct evdev_device *
+evdev_device_create_virtual(struct libinput_seat *seat,
+			    const char *sysname,
+			    struct libevdev *evdev)
+{
+	return evdev_device_create_from_evdev(seat, NULL, sysname, evdev, -1);
+}
+
+int
+evdev_device_inject(struct evdev_device *device,
+		    const struct input_event *events,
+		    size_t nevents)
+{
+	struct libinput *libinput = device->base.seat->libinput;
+	struct input_event buffer[EVDEV_READ_BUFFER_SIZE /
+				  sizeof(struct input_event)];
+	size_t i, n = 0;
+	uint64_t time;
+
+	if (device->was_removed)
+		return -ENODEV;
+
+	/* There is no kernel state to re-sync to */
+	for (i = 0; i < nevents; i++) {
+		if (events[i].type == EV_SYN && events[i].code == SYN_DROPPED)
+			return -EINVAL;
+	}
+
+	/* Disabled devices discard events, like a closed fd would */
+	if (!device->virtual_open)
+		return 0;
+
+	/* evdev_device_dispatch() processes the events in place, feed it
+	 * copies in the same batch size the fd reader uses. With the event
+	 * clock, timers that expire before an event have to run before
+	 * that event is processed. */
+	for (i = 0; i < nevents; i++) {
+		time = events[i].time.tv_sec * 1000ULL +
+		       events[i].time.tv_usec / 1000;
+
+		if (n == ARRAY_LENGTH(buffer) ||
+		    (libinput->timer.event_clock &&
+		     time > libinput->timer.now && n > 0)) {
+			evdev_device_dispatch(device, buffer, n * sizeof(*buffer));
+			n = 0;
+		}
+
+		if (libinput->timer.event_clock && time > libinput->timer.now)
+			libinput_timer_advance(libinput, time);
+
+		buffer[n++] = events[i];
+	}
+
+	if (n > 0)
+		evdev_device_dispatch(device, buffer, n * sizeof(*buffer));
+
+	return 0;
+}
+
 const char *
 evdev_device_get_output(struct evdev_device *device)
 {
@@ -1620,6 +2153,9 @@ evdev_device_get_output(struct evdev_device *device)
 const char *
 evdev_device_get_sysname(struct evdev_device *device)
 {
+	if (device->sysname)
+		return device->sysname;
+
 	return udev_device_get_sysname(device->udev_device);
 }
 
@@ -1793,6 +2329,10 @@ evdev_post_scroll(struct evdev_device *device,
 {
 	double trigger_horiz, trigger_vert;
 
+	if (!libinput_device_wants_event(&device->base,
+					 LIBINPUT_EVENT_POINTER_AXIS))
+		return;
+
 	if (!evdev_is_scrolling(device,
 				LIBINPUT_POINTER_AXIS_SCROLL_VERTICAL))
 		device->scroll.buildup_vertical += dy;
@@ -1923,17 +2463,17 @@ release_pressed_keys(struct evdev_device *device)
 void
 evdev_notify_suspended_device(struct evdev_device *device)
 {
-	struct libinput_device *it;
+	struct evdev_device *d;
 
 	if (device->suspended)
 		return;
 
-	list_for_each(it, &device->base.seat->devices_list, link) {
-		struct evdev_device *d = (struct evdev_device*)it;
-		if (it == &device->base)
+	list_for_each(d, &device->base.seat->interested_devices, interest.link) {
+		if (d == device)
 			continue;
 
-		if (d->dispatch->interface->device_suspended)
+		if (d->dispatch->interface->device_suspended &&
+		    evdev_device_is_interested_in(d, device))
 			d->dispatch->interface->device_suspended(d, device);
 	}
 
@@ -1943,17 +2483,17 @@ evdev_notify_suspended_device(struct evdev_device *device)
 void
 evdev_notify_resumed_device(struct evdev_device *device)
 {
-	struct libinput_device *it;
+	struct evdev_device *d;
 
 	if (!device->suspended)
 		return;
 
-	list_for_each(it, &device->base.seat->devices_list, link) {
-		struct evdev_device *d = (struct evdev_device*)it;
-		if (it == &device->base)
+	list_for_each(d, &device->base.seat->interested_devices, interest.link) {
+		if (d == device)
 			continue;
 
-		if (d->dispatch->interface->device_resumed)
+		if (d->dispatch->interface->device_resumed &&
+		    evdev_device_is_interested_in(d, device))
 			d->dispatch->interface->device_resumed(d, device);
 	}
 
@@ -1963,6 +2503,9 @@ evdev_notify_resumed_device(struct evdev_device *device)
 int
 evdev_device_suspend(struct evdev_device *device)
 {
+	/* we won't see the rest of the current frame */
+	device->base.in_frame = 0;
+
 	evdev_notify_suspended_device(device);
 
 	if (device->source) {
@@ -1973,10 +2516,7 @@ evdev_device_suspend(struct evdev_device *device)
 
 	release_pressed_keys(device);
 
-	if (device->mtdev) {
-		mtdev_close_delete(device->mtdev);
-		device->mtdev = NULL;
-	}
+	device->virtual_open = false;
 
 	if (device->fd != -1) {
 		close_restricted(device->base.seat->libinput, device->fd);
@@ -1991,7 +2531,6 @@ evdev_device_resume(struct evdev_device *device)
 {
 	struct libinput *libinput = device->base.seat->libinput;
 	int fd;
-	const char *devnode;
 	struct input_event ev;
 	enum libevdev_read_status status;
 
@@ -2001,24 +2540,30 @@ evdev_device_resume(struct evdev_device *device)
 	if (device->was_removed)
 		return -ENODEV;
 
-	devnode = udev_device_get_devnode(device->udev_device);
-	fd = open_restricted(libinput, devnode, O_RDWR | O_NONBLOCK);
+	/* virtual devices only need to accept events again */
+	if (!device->udev_device) {
+		if (device->virtual_open)
+			return 0;
 
-	if (fd < 0)
-		return -errno;
+		if (device->protocol_a)
+			mt_protocol_a_reset(device->protocol_a);
 
-	if (evdev_device_compare_syspath(device->udev_device, fd)) {
-		close_restricted(libinput, fd);
-		return -ENODEV;
+		memset(device->hw_key_mask, 0, sizeof(device->hw_key_mask));
+		device->virtual_open = true;
+
+		evdev_notify_resumed_device(device);
+
+		return 0;
 	}
 
+	fd = evdev_device_open(libinput, device->udev_device);
+	if (fd < 0)
+		return fd;
+
 	device->fd = fd;
 
-	if (evdev_need_mtdev(device)) {
-		device->mtdev = mtdev_new_open(device->fd);
-		if (!device->mtdev)
-			return -ENODEV;
-	}
+	if (device->protocol_a)
+		mt_protocol_a_reset(device->protocol_a);
 
 	libevdev_change_fd(device->evdev, fd);
 	libevdev_set_clock_id(device->evdev, CLOCK_MONOTONIC);
@@ -2034,12 +2579,13 @@ evdev_device_resume(struct evdev_device *device)
 					     &ev);
 	} while (status == LIBEVDEV_READ_STATUS_SYNC);
 
-	device->source =
-		libinput_add_fd(libinput, fd, evdev_device_dispatch, device);
-	if (!device->source) {
-		mtdev_close_delete(device->mtdev);
+	device->source = libinput_add_fd_reader(libinput,
+						fd,
+						evdev_device_dispatch,
+						EVDEV_READ_BUFFER_SIZE,
+						device);
+	if (!device->source)
 		return -ENOMEM;
-	}
 
 	memset(device->hw_key_mask, 0, sizeof(device->hw_key_mask));
 
@@ -2051,14 +2597,14 @@ evdev_device_resume(struct evdev_device *device)
 void
 evdev_device_remove(struct evdev_device *device)
 {
-	struct libinput_device *dev;
+	struct evdev_device *d;
 
-	list_for_each(dev, &device->base.seat->devices_list, link) {
-		struct evdev_device *d = (struct evdev_device*)dev;
-		if (dev == &device->base)
+	list_for_each(d, &device->base.seat->interested_devices, interest.link) {
+		if (d == device)
 			continue;
 
-		if (d->dispatch->interface->device_removed)
+		if (d->dispatch->interface->device_removed &&
+		    evdev_device_is_interested_in(d, device))
 			d->dispatch->interface->device_removed(d, device);
 	}
 
@@ -2072,8 +2618,11 @@ evdev_device_remove(struct evdev_device *device)
 	device->was_removed = true;
 
 	list_remove(&device->base.link);
+	if (evdev_device_has_interest(device))
+		list_remove(&device->interest.link);
 
 	notify_removed_device(&device->base);
+	libinput_device_retire(&device->base);
 	libinput_device_unref(&device->base);
 }
 
@@ -2090,6 +2639,9 @@ evdev_device_destroy(struct evdev_device *device)
 	libinput_seat_unref(device->base.seat);
 	libevdev_free(device->evdev);
 	udev_device_unref(device->udev_device);
-	free(device->mt.slots);
-	free(device);
+	free_tag(LIBINPUT_MEMORY_TAG_DEVICE, device->sysname);
+	free_tag(LIBINPUT_MEMORY_TAG_DEVICE, device->output_name);
+	free_tag(LIBINPUT_MEMORY_TAG_DEVICE, device->mt.slots);
+	free_tag(LIBINPUT_MEMORY_TAG_DEVICE, device->protocol_a);
+	free_tag(LIBINPUT_MEMORY_TAG_DEVICE, device);
 }
@@ -32,6 +32,16 @@
 
 #include "libinput-private.h"
 #include "timer.h"
+#include "filter.h"
+#include "evdev-mt-protocol-a.h"
+
+/* Maps an absolute axis onto [0, to_range), recalculated whenever the
+ * output size or the axis range changes. */
+struct evdev_axis_transform {
+	uint32_t to_range;
+	int32_t minimum, maximum;
+	double scale, offset;
+};
 
 enum evdev_event_type {
 	EVDEV_NONE,
@@ -71,7 +81,9 @@ struct evdev_device {
 	struct udev_device *udev_device;
 	char *output_name;
 	const char *devname;
+	char *sysname; /* virtual devices only */
 	bool was_removed;
+	bool virtual_open; /* virtual devices accept events */
 	int fd;
 	struct {
 		const struct input_absinfo *absinfo_x, *absinfo_y;
@@ -80,6 +92,8 @@ struct evdev_device {
 		int32_t x, y;
 		int32_t seat_slot;
 
+		struct evdev_axis_transform transform_x, transform_y;
+
 		int apply_calibration;
 		struct matrix calibration;
 		struct matrix default_calibration; /* from LIBINPUT_CALIBRATION_MATRIX */
@@ -91,7 +105,7 @@ struct evdev_device {
 		struct mt_slot *slots;
 		size_t slots_len;
 	} mt;
-	struct mtdev *mtdev;
+	struct mt_protocol_a *protocol_a;
 
 	struct {
 		int dx, dy;
@@ -125,12 +139,25 @@ struct evdev_device {
 	enum evdev_device_seat_capability seat_caps;
 	enum evdev_device_tags tags;
 
+	/* Tags and seat capabilities of the other devices on the seat the
+	 * dispatch wants device_added, device_removed, etc. for. Set by the
+	 * dispatch during creation, a device with no interest is never
+	 * notified about other devices. */
+	struct {
+		uint32_t tags;
+		uint32_t seat_caps;
+		struct list link; /* in seat->interested_devices */
+	} interest;
+
 	int is_mt;
 	int suspended;
 
 	struct {
 		struct libinput_device_config_accel config;
 		struct motion_filter *filter;
+		/* motion was skipped since the last filter_dispatch(), the
+		 * trackers need a restart */
+		bool filter_stale;
 	} pointer;
 
 	/* Bitmask of pressed keys used to ignore initial release events from
@@ -203,10 +230,59 @@ struct evdev_dispatch {
 	} sendevents;
 };
 
+/* Opens and verifies the device node, returns the fd or a negative
+ * errno */
+int
+evdev_device_open(struct libinput *libinput,
+		  struct udev_device *udev_device);
+
+/* fds[i] is the fd or a negative errno for udev_devices[i]. evdevs[i]
+ * is a libevdev context already set up for fds[i] or NULL, evdevs itself
+ * may be NULL. The callee takes ownership of the fds and evdevs. */
+typedef int (*evdev_open_many_done_func)(struct libinput *libinput,
+					 struct udev_device **udev_devices,
+					 int *fds,
+					 struct libevdev **evdevs,
+					 size_t count,
+					 void *data);
+
+/* Opens count device nodes in one go, through the caller's
+ * open_restricted_many if available, then sets up their libevdev
+ * contexts in parallel. done may be called after this function
+ * returns, or never if the request is cancelled. Returns done's return
+ * value if it was called synchronously. */
+int
+evdev_device_open_many(struct libinput *libinput,
+		       struct udev_device **udev_devices,
+		       size_t count,
+		       evdev_open_many_done_func done,
+		       void *data);
+
 struct evdev_device *
 evdev_device_create(struct libinput_seat *seat,
 		    struct udev_device *device);
 
+/* Like evdev_device_create() for an fd from evdev_device_open(). evdev
+ * is a libevdev context for the fd from evdev_device_open_many(), or NULL
+ * to set one up here. Takes ownership of both. */
+struct evdev_device *
+evdev_device_create_from_fd(struct libinput_seat *seat,
+			    struct udev_device *device,
+			    int fd,
+			    struct libevdev *evdev);
+
+/* A device without an fd or udev device, events are fed in with
+ * evdev_device_inject(). Takes ownership of evdev */
+struct evdev_device *
+evdev_device_create_virtual(struct libinput_seat *seat,
+			    const char *sysname,
+			    struct libevdev *evdev);
+
+int
+evdev_device_inject(struct evdev_device *device,
+		    const struct input_event *events,
+		    size_t nevents);
+
 int
 evdev_device_init_pointer_acceleration(struct evdev_device *device);
 
@@ -259,15 +335,74 @@ evdev_device_get_size(struct evdev_device *device,
 int
 evdev_device_has_button(struct evdev_device *device, uint32_t code);
 
-double
+void
+evdev_axis_transform_update(struct evdev_axis_transform *transform,
+			    const struct input_absinfo *absinfo,
+			    uint32_t to_range);
+
+static inline double
+evdev_axis_transform(struct evdev_axis_transform *transform,
+		     const struct input_absinfo *absinfo,
+		     double value,
+		     uint32_t to_range)
+{
+	if (transform->to_range != to_range ||
+	    transform->minimum != absinfo->minimum ||
+	    transform->maximum != absinfo->maximum)
+		evdev_axis_transform_update(transform, absinfo, to_range);
+
+	return value * transform->scale + transform->offset;
+}
+
+/* Same as evdev_axis_transform() but leaves the device alone, for event
+ * getters that may run on any thread. Uses the same arithmetic so the
+ * result doesn't depend on whether the cache is used. */
+static inline double
+evdev_axis_transform_uncached(const struct input_absinfo *absinfo,
+			      double value,
+			      uint32_t to_range)
+{
+	struct evdev_axis_transform transform;
+
+	evdev_axis_transform_update(&transform, absinfo, to_range);
+
+	return value * transform.scale + transform.offset;
+}
+
+static inline double
 evdev_device_transform_x(struct evdev_device *device,
 			 double x,
-			 uint32_t width);
+			 uint32_t width)
+{
+	if (device->base.seat->libinput->thread_safe_events)
+		return evdev_axis_transform_uncached(device->abs.absinfo_x,
+						     x, width);
 
-double
+	return evdev_axis_transform(&device->abs.transform_x,
+				    device->abs.absinfo_x,
+				    x, width);
+}
+
+static inline double
 evdev_device_transform_y(struct evdev_device *device,
 			 double y,
-			 uint32_t height);
+			 uint32_t height)
+{
+	if (device->base.seat->libinput->thread_safe_events)
+		return evdev_axis_transform_uncached(device->abs.absinfo_y,
+						     y, height);
+
+	return evdev_axis_transform(&device->abs.transform_y,
+				    device->abs.absinfo_y,
+				    y, height);
+}
+
+void
+evdev_device_get_transform(struct evdev_device *device,
+			   uint32_t width,
+			   uint32_t height,
+			   struct evdev_axis_transform *transform_x,
+			   struct evdev_axis_transform *transform_y);
 int
 evdev_device_suspend(struct evdev_device *device);
 
@@ -295,6 +430,14 @@ evdev_pointer_notify_button(struct evdev_device *device,
 void
 evdev_init_natural_scroll(struct evdev_device *device);
 
+/* filter_dispatch() on the device's accel filter, restarts it first if
+ * motion was skipped in the meantime */
+void
+evdev_filter_dispatch(struct evdev_device *device,
+		      struct motion_params *motion,
+		      void *data,
+		      uint64_t time);
+
 void
 evdev_post_scroll(struct evdev_device *device,
 		  uint64_t time,
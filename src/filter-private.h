@@ -34,6 +34,8 @@ struct motion_filter_interface {
 	void (*destroy)(struct motion_filter *filter);
 	bool (*set_speed)(struct motion_filter *filter,
 			  double speed);
+	void (*restart)(struct motion_filter *filter,
+			void *data, uint64_t time);
 };
 
 struct motion_filter {
@@ -41,6 +41,14 @@ filter_dispatch(struct motion_filter *filter,
 	filter->interface->filter(filter, motion, data, time);
 }
 
+void
+filter_restart(struct motion_filter *filter,
+	       void *data, uint64_t time)
+{
+	if (filter->interface->restart)
+		filter->interface->restart(filter, data, time);
+}
+
 void
 filter_destroy(struct motion_filter *filter)
 {
@@ -243,14 +251,35 @@ accelerator_filter(struct motion_filter *filter,
 	accel->last_velocity = velocity;
 }
 
+static void
+accelerator_restart(struct motion_filter *filter,
+		    void *data, uint64_t time)
+{
+	struct pointer_accelerator *accel =
+		(struct pointer_accelerator *) filter;
+	int i;
+
+	/* forget the history, the next motion is accelerated as if
+	 * the pointer had been at rest */
+	for (i = 0; i < NUM_POINTER_TRACKERS; i++) {
+		accel->trackers[i].dx = 0.0;
+		accel->trackers[i].dy = 0.0;
+		accel->trackers[i].time = time - MOTION_TIMEOUT - 1;
+		accel->trackers[i].dir = 0;
+	}
+
+	accel->velocity = 0.0;
+	accel->last_velocity = 0.0;
+}
+
 static void
 accelerator_destroy(struct motion_filter *filter)
 {
 	struct pointer_accelerator *accel =
 		(struct pointer_accelerator *) filter;
 
-	free(accel->trackers);
-	free(accel);
+	free_tag(LIBINPUT_MEMORY_TAG_FILTER, accel->trackers);
+	free_tag(LIBINPUT_MEMORY_TAG_FILTER, accel);
 }
 
 static bool
@@ -279,6 +308,7 @@ struct motion_filter_interface accelerator_interface = {
 	accelerator_filter,
 	accelerator_destroy,
 	accelerator_set_speed,
+	accelerator_restart,
 };
 
 struct motion_filter *
@@ -286,7 +316,7 @@ create_pointer_accelerator_filter(accel_profile_func_t profile)
 {
 	struct pointer_accelerator *filter;
 
-	filter = malloc(sizeof *filter);
+	filter = malloc_tag(LIBINPUT_MEMORY_TAG_FILTER, sizeof *filter);
 	if (filter == NULL)
 		return NULL;
 
@@ -298,7 +328,8 @@ create_pointer_accelerator_filter(accel_profile_func_t profile)
 	filter->last_dy = 0;
 
 	filter->trackers =
-		calloc(NUM_POINTER_TRACKERS, sizeof *filter->trackers);
+		zalloc_tag(LIBINPUT_MEMORY_TAG_FILTER,
+			   NUM_POINTER_TRACKERS * sizeof *filter->trackers);
 	filter->cur_tracker = 0;
 
 	filter->threshold = DEFAULT_THRESHOLD;
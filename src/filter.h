@@ -42,6 +42,9 @@ filter_dispatch(struct motion_filter *filter,
 		struct motion_params *motion,
 		void *data, uint64_t time);
 void
+filter_restart(struct motion_filter *filter,
+	       void *data, uint64_t time);
+void
 filter_destroy(struct motion_filter *filter);
 
 bool
@@ -24,13 +24,22 @@
 #define LIBINPUT_PRIVATE_H
 
 #include <errno.h>
+#include <stdbool.h>
+#include <sys/types.h>
 
 #include "linux/input.h"
 
 #include "libinput.h"
 #include "libinput-util.h"
+#include "libinput-probes.h"
 
+struct libinput_epoch;
 struct libinput_source;
+struct libinput_uring;
+
+/* Number of distinct values in enum libinput_event_type, see
+ * event_type_index() */
+#define LIBINPUT_EVENT_TYPE_COUNT 13
 
 struct libinput_interface_backend {
 	int (*resume)(struct libinput *libinput);
@@ -41,7 +50,10 @@ struct libinput_interface_backend {
 };
 
 struct libinput {
-	int epoll_fd;
+	int epoll_fd; /* the caller's fd, holds wakeup_fd and the timerfd */
+	int source_fd; /* epoll fd for the sources, unless using io_uring */
+	int wakeup_fd; /* source_fd or the io_uring fd */
+	struct libinput_uring *uring; /* NULL if we're using epoll */
 	struct list source_destroy_list;
 
 	struct list seat_list;
@@ -50,6 +62,11 @@ struct libinput {
 		struct list list;
 		struct libinput_source *source;
 		int fd;
+
+		/* Time follows the injected events instead of
+		 * CLOCK_MONOTONIC, see libinput_memory_set_event_clock() */
+		bool event_clock;
+		uint64_t now; /* ms, 0 until the first event */
 	} timer;
 
 	struct libinput_event **events;
@@ -58,9 +75,49 @@ struct libinput {
 	size_t events_in;
 	size_t events_out;
 
+	/* Events don't reference their device, removed devices are kept
+	 * until the events queued before are gone, see
+	 * libinput_device_retire() */
+	struct list epochs; /* newest first */
+	struct libinput_epoch *epoch; /* the newest, new events go here */
+
 	const struct libinput_interface *interface;
 	const struct libinput_interface_backend *interface_backend;
 
+	struct {
+		uint64_t deadline; /* usec, 0 unless wakeups are deferred */
+		int timerfd;
+	} deferred;
+
+	/* event_type_mask() of the types the caller wants, see
+	 * libinput_device_wants_event() */
+	uint32_t event_mask;
+
+	/* see libinput_set_thread_safe_events() */
+	int thread_safe_events;
+	struct {
+		/* lock-free stacks of objects whose last reference was
+		 * dropped, released on the context's thread */
+		struct libinput_device *devices;
+		struct libinput_seat *seats;
+	} retired;
+
+	struct {
+		/* event_type_mask() of the types that bypass the queue */
+		uint32_t mask;
+		struct {
+			libinput_event_sink_func func;
+			void *data;
+		} sink[LIBINPUT_EVENT_TYPE_COUNT];
+	} sinks;
+
+	struct {
+		libinput_open_restricted_many_func func;
+		struct list list; /* pending libinput_open_request */
+		struct libinput_source *source;
+		int fd; /* eventfd, signalled when a request completes */
+	} open_many;
+
 	libinput_log_handler log_handler;
 	enum libinput_log_priority log_priority;
 	void *user_data;
@@ -73,8 +130,12 @@ struct libinput_seat {
 	struct libinput *libinput;
 	struct list link;
 	struct list devices_list;
+	/* the subset of devices_list that wants to be notified about
+	 * other devices, see evdev_device::interest */
+	struct list interested_devices;
 	void *user_data;
-	int refcount;
+	int refcount; /* atomic */
+	struct libinput_seat *retired_next;
 	libinput_seat_destroy_func destroy;
 
 	char *physical_name;
@@ -83,6 +144,11 @@ struct libinput_seat {
 	uint32_t slot_map;
 
 	uint32_t button_count[KEY_CNT];
+
+	struct {
+		struct libinput_pointer_state_page *page; /* NULL until requested */
+		int fd; /* memfd backing the page, if any */
+	} pointer_state;
 };
 
 struct libinput_device_config_tap {
@@ -160,24 +226,108 @@ struct libinput_device {
 	struct libinput_seat *seat;
 	struct list link;
 	struct list event_listeners;
+	/* union of the event masks of all event_listeners, indexed by
+	 * event_type_mask(). Events without a subscriber skip the
+	 * listener list altogether */
+	uint32_t event_listener_mask;
+	/* the last sequence number handed out. Each hardware frame gets
+	 * one, so does each event generated outside of the device's own
+	 * frame processing (timers, events posted by another device) */
+	uint32_t last_seq;
+	/* sequence number of the hardware frame up to its SYN_REPORT */
+	uint32_t frame_seq;
+	int in_frame;
+	int in_process; /* while the dispatch processes one of our events */
 	void *user_data;
-	int refcount;
+	int refcount; /* atomic */
+	/* the retired.devices stack or the epoch's devices */
+	struct libinput_device *retired_next;
 	struct libinput_device_config config;
 };
 
 struct libinput_event {
 	enum libinput_event_type type;
 	struct libinput_device *device;
+	struct libinput_epoch *epoch; /* NULL unless queued */
+	uint32_t frame_seq;
 };
 
 struct libinput_event_listener {
 	struct list link;
+	uint32_t event_mask; /* event_type_mask() of the wanted types */
 	void (*notify_func)(uint64_t time, struct libinput_event *ev, void *notify_func_data);
 	void *notify_func_data;
 };
 
 typedef void (*libinput_source_dispatch_t)(void *data);
 
+/* len is the number of bytes read or a negative errno */
+typedef void (*libinput_source_read_t)(void *data,
+				       void *buffer,
+				       ssize_t len);
+
+/* Map the sparse enum libinput_event_type onto a dense index
+ * [0, LIBINPUT_EVENT_TYPE_COUNT) for use in bitmasks and lookup tables */
+static inline unsigned int
+event_type_index(enum libinput_event_type type)
+{
+	switch (type) {
+	case LIBINPUT_EVENT_NONE:
+		break;
+	case LIBINPUT_EVENT_DEVICE_ADDED:
+		return 1;
+	case LIBINPUT_EVENT_DEVICE_REMOVED:
+		return 2;
+	case LIBINPUT_EVENT_KEYBOARD_KEY:
+		return 3;
+	case LIBINPUT_EVENT_POINTER_MOTION:
+		return 4;
+	case LIBINPUT_EVENT_POINTER_MOTION_ABSOLUTE:
+		return 5;
+	case LIBINPUT_EVENT_POINTER_BUTTON:
+		return 6;
+	case LIBINPUT_EVENT_POINTER_AXIS:
+		return 7;
+	case LIBINPUT_EVENT_TOUCH_DOWN:
+		return 8;
+	case LIBINPUT_EVENT_TOUCH_UP:
+		return 9;
+	case LIBINPUT_EVENT_TOUCH_MOTION:
+		return 10;
+	case LIBINPUT_EVENT_TOUCH_CANCEL:
+		return 11;
+	case LIBINPUT_EVENT_TOUCH_FRAME:
+		return 12;
+	}
+
+	return 0;
+}
+
+static inline uint32_t
+event_type_mask(enum libinput_event_type type)
+{
+	return 1U << event_type_index(type);
+}
+
+/* Whether anyone is interested in events of this type from this device:
+ * the caller, an internal listener or the seat's pointer state page.
+ * Processing that only feeds events of this type can be skipped
+ * otherwise */
+static inline bool
+libinput_device_wants_event(struct libinput_device *device,
+			    enum libinput_event_type type)
+{
+	struct libinput_seat *seat = device->seat;
+	uint32_t mask = event_type_mask(type);
+
+	if ((seat->libinput->event_mask | device->event_listener_mask) & mask)
+		return true;
+
+	return seat->pointer_state.page &&
+	       (type == LIBINPUT_EVENT_POINTER_MOTION ||
+		type == LIBINPUT_EVENT_POINTER_BUTTON);
+}
+
 
 #define log_debug(li_, ...) log_msg((li_), LIBINPUT_LOG_PRIORITY_DEBUG, __VA_ARGS__)
 #define log_info(li_, ...) log_msg((li_), LIBINPUT_LOG_PRIORITY_INFO, __VA_ARGS__)
@@ -209,6 +359,17 @@ libinput_add_fd(struct libinput *libinput,
 		libinput_source_dispatch_t dispatch,
 		void *data);
 
+/* Like libinput_add_fd(), but the event loop reads the fd in chunks of
+ * up to read_size bytes and calls read with each result. With io_uring a
+ * read is kept posted on the fd, with epoll the fd is read until a short
+ * read once it is readable. */
+struct libinput_source *
+libinput_add_fd_reader(struct libinput *libinput,
+		       int fd,
+		       libinput_source_read_t read,
+		       size_t read_size,
+		       void *data);
+
 void
 libinput_remove_source(struct libinput *libinput,
 		       struct libinput_source *source);
@@ -220,6 +381,30 @@ open_restricted(struct libinput *libinput,
 void
 close_restricted(struct libinput *libinput, int fd);
 
+/* Called with the result of open_restricted_many(), ownership of the fds
+ * passes to the callee. fds is NULL if the request was cancelled, the
+ * callee only needs to release data then. */
+typedef int (*open_restricted_many_done_func)(struct libinput *libinput,
+					      int *fds,
+					      size_t count,
+					      void *data);
+
+/* Opens count paths through the caller's open_restricted_many if set,
+ * or open_restricted otherwise. done is called once all paths are
+ * opened, possibly after this function returned. Returns the return
+ * value of done if it was called synchronously, 0 if the request is
+ * pending or -1 on error. */
+int
+open_restricted_many(struct libinput *libinput,
+		     const char **paths,
+		     size_t count,
+		     int flags,
+		     open_restricted_many_done_func done,
+		     void *data);
+
+void
+libinput_destroy_retired(struct libinput *libinput);
+
 void
 libinput_seat_init(struct libinput_seat *seat,
 		   struct libinput *libinput,
@@ -231,9 +416,15 @@ void
 libinput_device_init(struct libinput_device *device,
 		     struct libinput_seat *seat);
 
+/* The device was removed, keeps a reference until the events queued so
+ * far are destroyed */
+void
+libinput_device_retire(struct libinput_device *device);
+
 void
 libinput_device_add_event_listener(struct libinput_device *device,
 				   struct libinput_event_listener *listener,
+				   uint32_t event_mask,
 				   void (*notify_func)(
 						uint64_t time,
 						struct libinput_event *event,
@@ -241,7 +432,8 @@ libinput_device_add_event_listener(struct libinput_device *device,
 				   void *notify_func_data);
 
 void
-libinput_device_remove_event_listener(struct libinput_event_listener *listener);
+libinput_device_remove_event_listener(struct libinput_device *device,
+				      struct libinput_event_listener *listener);
 
 void
 notify_added_device(struct libinput_device *device);
@@ -313,6 +505,9 @@ libinput_now(struct libinput *libinput)
 {
 	struct timespec ts = { 0, 0 };
 
+	if (libinput->timer.event_clock)
+		return libinput->timer.now;
+
 	if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
 		log_error(libinput, "clock_gettime failed: %s\n", strerror(errno));
 		return 0;
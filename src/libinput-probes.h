@@ -0,0 +1,63 @@
+/*
+ * Copyright © 2015 Red Hat, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#ifndef LIBINPUT_PROBES_H
+#define LIBINPUT_PROBES_H
+
+#include "config.h"
+
+/*
+ * USDT static probes in the "libinput" provider, see @ref probes for the
+ * list. A probe that no tracer is attached to is a single nop, so the
+ * arguments must be values we have at hand anyway, never anything that
+ * needs computing.
+ *
+ * Without sys/sdt.h the probes compile to nothing, the arguments are
+ * only referenced so that variables kept for a probe aren't unused.
+ */
+#ifdef HAVE_PROBES
+#include <sys/sdt.h>
+
+#define PROBE2(name, a, b) \
+	STAP_PROBE2(libinput, name, a, b)
+#define PROBE3(name, a, b, c) \
+	STAP_PROBE3(libinput, name, a, b, c)
+#define PROBE4(name, a, b, c, d) \
+	STAP_PROBE4(libinput, name, a, b, c, d)
+#define PROBE5(name, a, b, c, d, e) \
+	STAP_PROBE5(libinput, name, a, b, c, d, e)
+#define PROBE6(name, a, b, c, d, e, f) \
+	STAP_PROBE6(libinput, name, a, b, c, d, e, f)
+#else
+#define PROBE2(name, a, b) \
+	do { (void)(a); (void)(b); } while (0)
+#define PROBE3(name, a, b, c) \
+	do { PROBE2(name, a, b); (void)(c); } while (0)
+#define PROBE4(name, a, b, c, d) \
+	do { PROBE3(name, a, b, c); (void)(d); } while (0)
+#define PROBE5(name, a, b, c, d, e) \
+	do { PROBE4(name, a, b, c, d); (void)(e); } while (0)
+#define PROBE6(name, a, b, c, d, e, f) \
+	do { PROBE5(name, a, b, c, d, e); (void)(f); } while (0)
+#endif
+
+#endif
@@ -29,10 +29,16 @@
 #include "config.h"
 
 #include <ctype.h>
+#include <errno.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef HAVE_MEMORY_STATS
+#include <malloc.h>
+#endif
 
 #include "libinput-util.h"
 #include "libinput-private.h"
@@ -168,3 +174,148 @@ parse_mouse_dpi_property(const char *prop)
 	}
 	return dpi;
 }
+
+#ifdef HAVE_MEMORY_STATS
+struct memory_stats {
+	uint64_t live;
+	uint64_t peak;
+	uint64_t nallocs;
+
+	/* start of the interval for allocations_per_second, in ns */
+	uint64_t sample_time;
+	uint64_t sample_nallocs;
+};
+
+static struct memory_stats memory_stats[LIBINPUT_MEMORY_TAG_CONTEXT + 1];
+
+static inline uint64_t
+memory_stats_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void
+memory_stats_add(enum libinput_memory_tag tag, void *ptr)
+{
+	struct memory_stats *stats = &memory_stats[tag];
+	uint64_t live, peak, zero = 0;
+
+	if (!ptr)
+		return;
+
+	live = __atomic_add_fetch(&stats->live,
+				  malloc_usable_size(ptr),
+				  __ATOMIC_RELAXED);
+	__atomic_add_fetch(&stats->nallocs, 1, __ATOMIC_RELAXED);
+
+	peak = __atomic_load_n(&stats->peak, __ATOMIC_RELAXED);
+	while (live > peak &&
+	       !__atomic_compare_exchange_n(&stats->peak, &peak, live, true,
+					    __ATOMIC_RELAXED,
+					    __ATOMIC_RELAXED))
+		;
+
+	if (__atomic_load_n(&stats->sample_time, __ATOMIC_RELAXED) == 0)
+		__atomic_compare_exchange_n(&stats->sample_time, &zero,
+					    memory_stats_now(), false,
+					    __ATOMIC_RELAXED,
+					    __ATOMIC_RELAXED);
+}
+
+static void
+memory_stats_remove(enum libinput_memory_tag tag, void *ptr)
+{
+	if (!ptr)
+		return;
+
+	__atomic_sub_fetch(&memory_stats[tag].live,
+			   malloc_usable_size(ptr),
+			   __ATOMIC_RELAXED);
+}
+
+void *
+zalloc_tag(enum libinput_memory_tag tag, size_t size)
+{
+	void *ptr = calloc(1, size);
+
+	memory_stats_add(tag, ptr);
+
+	return ptr;
+}
+
+void *
+malloc_tag(enum libinput_memory_tag tag, size_t size)
+{
+	void *ptr = malloc(size);
+
+	memory_stats_add(tag, ptr);
+
+	return ptr;
+}
+
+void *
+realloc_tag(enum libinput_memory_tag tag, void *ptr, size_t size)
+{
+	size_t old_size = ptr ? malloc_usable_size(ptr) : 0;
+	void *new_ptr;
+
+	new_ptr = realloc(ptr, size);
+	if (!new_ptr)
+		return NULL;
+
+	__atomic_sub_fetch(&memory_stats[tag].live, old_size, __ATOMIC_RELAXED);
+	memory_stats_add(tag, new_ptr);
+
+	return new_ptr;
+}
+
+char *
+strdup_tag(enum libinput_memory_tag tag, const char *str)
+{
+	char *ptr = strdup(str);
+
+	memory_stats_add(tag, ptr);
+
+	return ptr;
+}
+
+void
+free_tag(enum libinput_memory_tag tag, void *ptr)
+{
+	memory_stats_remove(tag, ptr);
+	free(ptr);
+}
+
+int
+memory_stats_get(enum libinput_memory_tag tag,
+		 struct libinput_memory_stats *stats)
+{
+	struct memory_stats *s;
+	uint64_t now, then, nallocs, sample_nallocs;
+
+	if ((unsigned int)tag >= ARRAY_LENGTH(memory_stats))
+		return -EINVAL;
+
+	s = &memory_stats[tag];
+	now = memory_stats_now();
+	nallocs = __atomic_load_n(&s->nallocs, __ATOMIC_RELAXED);
+	then = __atomic_exchange_n(&s->sample_time, now, __ATOMIC_RELAXED);
+	sample_nallocs = __atomic_exchange_n(&s->sample_nallocs, nallocs,
+					     __ATOMIC_RELAXED);
+
+	stats->live_bytes = __atomic_load_n(&s->live, __ATOMIC_RELAXED);
+	stats->peak_bytes = __atomic_load_n(&s->peak, __ATOMIC_RELAXED);
+	stats->allocations = nallocs;
+	if (then != 0 && now > then)
+		stats->allocations_per_second =
+			(nallocs - sample_nallocs) * 1e9 / (now - then);
+	else
+		stats->allocations_per_second = 0.0;
+
+	return 0;
+}
+#endif
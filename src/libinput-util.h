@@ -91,6 +91,58 @@ zalloc(size_t size)
 	return calloc(1, size);
 }
 
+/*
+ * Allocations inside libinput go through these so they can be accounted
+ * to a subsystem, see libinput_get_memory_stats(). Memory must be freed
+ * with free_tag() and the same tag. Without --enable-memory-stats they
+ * are plain calloc/malloc/realloc/strdup/free.
+ */
+#ifdef HAVE_MEMORY_STATS
+void *
+zalloc_tag(enum libinput_memory_tag tag, size_t size);
+void *
+malloc_tag(enum libinput_memory_tag tag, size_t size);
+void *
+realloc_tag(enum libinput_memory_tag tag, void *ptr, size_t size);
+char *
+strdup_tag(enum libinput_memory_tag tag, const char *str);
+void
+free_tag(enum libinput_memory_tag tag, void *ptr);
+int
+memory_stats_get(enum libinput_memory_tag tag,
+		 struct libinput_memory_stats *stats);
+#else
+static inline void *
+zalloc_tag(enum libinput_memory_tag tag, size_t size)
+{
+	return calloc(1, size);
+}
+
+static inline void *
+malloc_tag(enum libinput_memory_tag tag, size_t size)
+{
+	return malloc(size);
+}
+
+static inline void *
+realloc_tag(enum libinput_memory_tag tag, void *ptr, size_t size)
+{
+	return realloc(ptr, size);
+}
+
+static inline char *
+strdup_tag(enum libinput_memory_tag tag, const char *str)
+{
+	return strdup(str);
+}
+
+static inline void
+free_tag(enum libinput_memory_tag tag, void *ptr)
+{
+	free(ptr);
+}
+#endif
+
 static inline void
 msleep(unsigned int ms)
 {
@@ -23,12 +23,21 @@
 #include "config.h"
 
 #include <errno.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/timerfd.h>
+#include <time.h>
 #include <unistd.h>
 #include <assert.h>
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
 
 #include "libinput.h"
 #include "libinput-private.h"
@@ -37,9 +46,52 @@
 
 struct libinput_source {
 	libinput_source_dispatch_t dispatch;
+	libinput_source_read_t read;
 	void *user_data;
 	int fd;
 	struct list link;
+
+	void *buffer; /* read_size bytes, for sources with a read func */
+	size_t read_size;
+	int pending; /* io_uring completions still to come */
+};
+
+/* A seqlock: the sequence number is odd while the state is written */
+struct libinput_pointer_state_page {
+	uint32_t seq;
+	struct libinput_pointer_state state;
+};
+
+struct libinput_open_request {
+	struct libinput *libinput; /* NULL once the context is gone */
+	struct list link;
+
+	/* to close the fds after the context is gone */
+	const struct libinput_interface *interface;
+	void *user_data;
+
+	char **paths;
+	int *fds;
+	size_t count;
+
+	bool in_callback;
+	bool completed;
+	bool cancelled;
+
+	open_restricted_many_done_func done;
+	void *done_data;
+};
+
+/* Events count towards the epoch they were queued in instead of holding
+ * a reference to their device. A device removed while events are around
+ * is attached to the current epoch with a reference and a new epoch
+ * starts, the reference is dropped once all events of its epoch and the
+ * ones before are gone. No event queued after the removal can refer to
+ * the device. */
+struct libinput_epoch {
+	struct list link;
+	int live; /* atomic, events that are not yet destroyed */
+	struct libinput_device *devices; /* via retired_next, referenced */
 };
 
 struct libinput_event_device_notify {
@@ -143,6 +195,15 @@ static void
 libinput_post_event(struct libinput *libinput,
 		    struct libinput_event *event);
 
+static struct libinput_epoch *
+libinput_epoch_new(struct libinput *libinput);
+
+static void
+libinput_epoch_collect(struct libinput *libinput);
+
+static void
+libinput_epochs_destroy(struct libinput *libinput);
+
 LIBINPUT_EXPORT enum libinput_event_type
 libinput_event_get_type(struct libinput_event *event)
 {
@@ -161,6 +222,12 @@ libinput_event_get_device(struct libinput_event *event)
 	return event->device;
 }
 
+LIBINPUT_EXPORT uint32_t
+libinput_event_get_frame_sequence(struct libinput_event *event)
+{
+	return event->frame_seq;
+}
+
 LIBINPUT_EXPORT struct libinput_event_pointer *
 libinput_event_get_pointer_event(struct libinput_event *event)
 {
@@ -453,61 +520,519 @@ libinput_event_touch_get_y(struct libinput_event_touch *event)
 	return evdev_convert_to_mm(device->abs.absinfo_y, event->y);
 }
 
-struct libinput_source *
-libinput_add_fd(struct libinput *libinput,
-		int fd,
-		libinput_source_dispatch_t dispatch,
-		void *user_data)
+LIBINPUT_EXPORT void
+libinput_event_touch_get_transformed_batch(struct libinput_event_touch **events,
+					   size_t nevents,
+					   uint32_t width,
+					   uint32_t height,
+					   double *x,
+					   double *y)
+{
+	struct evdev_device *device, *last = NULL;
+	struct evdev_axis_transform transform_x, transform_y;
+	size_t i;
+
+	for (i = 0; i < nevents; i++) {
+		device = (struct evdev_device *) events[i]->base.device;
+
+		/* A frame's events are all from one device, so this is
+		 * usually only needed for the first event. */
+		if (device != last) {
+			evdev_device_get_transform(device, width, height,
+						   &transform_x, &transform_y);
+			last = device;
+		}
+
+		x[i] = events[i]->x * transform_x.scale + transform_x.offset;
+		y[i] = events[i]->y * transform_y.scale + transform_y.offset;
+	}
+}
+
+static void
+libinput_source_read(struct libinput_source *source)
+{
+	ssize_t len;
+
+	/* The caller may only dispatch once per frame, so we have to read
+	 * everything available or there will be input lag. A short read
+	 * means the fd is drained, that saves us the read() that would
+	 * only return EAGAIN. */
+	do {
+		len = read(source->fd, source->buffer, source->read_size);
+		if (len < 0)
+			len = -errno;
+
+		source->read(source->user_data, source->buffer, len);
+	} while (len == (ssize_t)source->read_size && source->fd != -1);
+}
+
+#ifdef HAVE_LIBURING
+
+#define URING_ENTRIES 256
+
+/* The poll linked in front of a read is tagged so it can be told apart
+ * from the read in cancel requests and completions */
+#define URING_POLL_TAG 0x1
+
+struct libinput_uring {
+	struct io_uring ring;
+	struct list cancelled_list; /* removed sources, pending > 0 */
+};
+
+static void
+libinput_uring_init(struct libinput *libinput)
+{
+	struct libinput_uring *uring;
+	struct io_uring_probe *probe;
+	const char *env;
+	bool supported = false;
+	int rc;
+
+	/* lets the test suite run on both loops, and is a way out if the
+	 * ring misbehaves on some kernel */
+	env = getenv("LIBINPUT_IO_URING");
+	if (env && strcmp(env, "0") == 0) {
+		log_info(libinput, "io_uring disabled, using epoll\n");
+		return;
+	}
+
+	uring = zalloc_tag(LIBINPUT_MEMORY_TAG_SOURCE, sizeof *uring);
+	if (!uring)
+		return;
+
+	rc = io_uring_queue_init(URING_ENTRIES, &uring->ring, 0);
+	if (rc < 0) {
+		log_info(libinput,
+			 "io_uring not available (%s), using epoll\n",
+			 strerror(-rc));
+		free_tag(LIBINPUT_MEMORY_TAG_SOURCE, uring);
+		return;
+	}
+
+	probe = io_uring_get_probe_ring(&uring->ring);
+	if (probe) {
+		supported =
+			io_uring_opcode_supported(probe, IORING_OP_READ) &&
+			io_uring_opcode_supported(probe, IORING_OP_POLL_ADD) &&
+			io_uring_opcode_supported(probe, IORING_OP_ASYNC_CANCEL);
+		io_uring_free_probe(probe);
+	}
+
+	if (!supported) {
+		log_info(libinput, "io_uring not usable, using epoll\n");
+		io_uring_queue_exit(&uring->ring);
+		free_tag(LIBINPUT_MEMORY_TAG_SOURCE, uring);
+		return;
+	}
+
+	list_init(&uring->cancelled_list);
+	libinput->uring = uring;
+
+	/* readable when there are completions */
+	libinput->wakeup_fd = uring->ring.ring_fd;
+}
+
+static bool
+libinput_uring_reserve(struct libinput_uring *uring, unsigned int count)
+{
+	if (io_uring_sq_space_left(&uring->ring) < count)
+		io_uring_submit(&uring->ring);
+
+	return io_uring_sq_space_left(&uring->ring) >= count;
+}
+
+/* Queues a cancel request for the source's pending request, the caller
+ * submits it */
+static bool
+libinput_uring_cancel(struct libinput_uring *uring,
+		      struct libinput_source *source)
+{
+	struct io_uring_sqe *sqe;
+	void *target = source;
+
+	/* For a read, cancelling the poll cancels the linked read too. If
+	 * the read is already running we get its completion as usual. */
+	if (source->read)
+		target = (void*)((uintptr_t)source | URING_POLL_TAG);
+
+	if (!libinput_uring_reserve(uring, 1))
+		return false;
+
+	sqe = io_uring_get_sqe(&uring->ring);
+	io_uring_prep_cancel(sqe, target, 0);
+	io_uring_sqe_set_data(sqe, NULL);
+
+	return true;
+}
+
+static void
+libinput_uring_destroy(struct libinput *libinput)
+{
+	struct libinput_uring *uring = libinput->uring;
+	struct libinput_source *source, *next;
+	struct io_uring_cqe *cqe;
+	int rc;
+
+	if (!uring)
+		return;
+
+	/* io_uring_queue_exit() doesn't wait for requests still in flight,
+	 * the kernel may write into a source's buffer after it returned.
+	 * Every source is removed by now, cancel again whatever is left in
+	 * case that failed at removal and wait for the last completions
+	 * before anything is freed. */
+	list_for_each(source, &uring->cancelled_list, link)
+		libinput_uring_cancel(uring, source);
+	io_uring_submit(&uring->ring);
+
+	while (!list_empty(&uring->cancelled_list)) {
+		rc = io_uring_wait_cqe(&uring->ring, &cqe);
+		if (rc == -EINTR)
+			continue;
+		if (rc < 0) {
+			/* we can't tell when the kernel is done with the
+			 * buffers, better leak them than free them */
+			log_bug_libinput(libinput,
+					 "io_uring teardown failed (%s)\n",
+					 strerror(-rc));
+			list_init(&uring->cancelled_list);
+			break;
+		}
+
+		source = io_uring_cqe_get_data(cqe);
+		io_uring_cqe_seen(&uring->ring, cqe);
+
+		if (!source || ((uintptr_t)source & URING_POLL_TAG))
+			continue;
+
+		if (--source->pending == 0) {
+			list_remove(&source->link);
+			free_tag(LIBINPUT_MEMORY_TAG_SOURCE, source);
+		}
+	}
+
+	io_uring_queue_exit(&uring->ring);
+
+	list_for_each_safe(source, next, &uring->cancelled_list, link)
+		free_tag(LIBINPUT_MEMORY_TAG_SOURCE, source);
+
+	free_tag(LIBINPUT_MEMORY_TAG_SOURCE, uring);
+	libinput->uring = NULL;
+}
+
+/* Queues the request for the next time the source is ready. Our fds are
+ * all O_NONBLOCK, so a read can't wait for data by itself and gets a
+ * poll linked in front of it. Either way there is exactly one
+ * completion for the source itself. */
+static int
+libinput_uring_arm(struct libinput_uring *uring,
+		   struct libinput_source *source)
+{
+	struct io_uring_sqe *sqe;
+
+	if (!libinput_uring_reserve(uring, source->read ? 2 : 1))
+		return -EBUSY;
+
+	sqe = io_uring_get_sqe(&uring->ring);
+	io_uring_prep_poll_add(sqe, source->fd, POLLIN);
+
+	if (source->read) {
+		io_uring_sqe_set_data(sqe,
+				      (void*)((uintptr_t)source | URING_POLL_TAG));
+		io_uring_sqe_set_flags(sqe, IOSQE_IO_LINK);
+
+		sqe = io_uring_get_sqe(&uring->ring);
+		io_uring_prep_read(sqe,
+				   source->fd,
+				   source->buffer,
+				   source->read_size,
+				   -1);
+	}
+
+	io_uring_sqe_set_data(sqe, source);
+	source->pending++;
+
+	return 0;
+}
+
+static int
+libinput_uring_add_source(struct libinput *libinput,
+			  struct libinput_source *source)
+{
+	struct libinput_uring *uring = libinput->uring;
+	int rc;
+
+	rc = libinput_uring_arm(uring, source);
+	if (rc < 0)
+		return rc;
+
+	/* Nobody would submit it otherwise if the caller only polls our
+	 * fd, e.g. for devices added outside of libinput_dispatch(). If
+	 * this fails it's still queued for the next one. */
+	io_uring_submit(&uring->ring);
+
+	return 0;
+}
+
+static void
+libinput_uring_remove_source(struct libinput *libinput,
+			     struct libinput_source *source)
+{
+	struct libinput_uring *uring = libinput->uring;
+
+	if (source->pending == 0) {
+		list_insert(&libinput->source_destroy_list, &source->link);
+		return;
+	}
+
+	if (libinput_uring_cancel(uring, source))
+		io_uring_submit(&uring->ring);
+
+	/* freed once its last completion comes in */
+	list_insert(&uring->cancelled_list, &source->link);
+}
+
+static int
+libinput_uring_dispatch(struct libinput *libinput)
+{
+	struct libinput_uring *uring = libinput->uring;
+	struct io_uring_cqe *cqes[32];
+	struct {
+		struct libinput_source *source;
+		int res;
+	} completions[ARRAY_LENGTH(cqes)];
+	struct libinput_source *source;
+	unsigned int i, count;
+	int rc;
+
+	/* Reaping completions doesn't need a syscall. The dispatch
+	 * functions may queue new requests, so take what we need and
+	 * hand the completion slots back first. */
+	count = io_uring_peek_batch_cqe(&uring->ring, cqes, ARRAY_LENGTH(cqes));
+	for (i = 0; i < count; i++) {
+		completions[i].source = io_uring_cqe_get_data(cqes[i]);
+		completions[i].res = cqes[i]->res;
+	}
+	io_uring_cq_advance(&uring->ring, count);
+
+	for (i = 0; i < count; i++) {
+		source = completions[i].source;
+
+		/* cancel requests and polls linked to a read */
+		if (!source || ((uintptr_t)source & URING_POLL_TAG))
+			continue;
+
+		source->pending--;
+
+		if (source->fd == -1) {
+			if (source->pending == 0) {
+				list_remove(&source->link);
+				free_tag(LIBINPUT_MEMORY_TAG_SOURCE, source);
+			}
+			continue;
+		}
+
+		if (source->read) {
+			source->read(source->user_data,
+				     source->buffer,
+				     completions[i].res);
+
+			/* a full buffer means there's more, get it now
+			 * rather than on the next dispatch */
+			if (completions[i].res == (int)source->read_size &&
+			    source->fd != -1)
+				libinput_source_read(source);
+		} else {
+			source->dispatch(source->user_data);
+		}
+
+		/* the dispatch function may have removed it */
+		if (source->fd != -1 &&
+		    libinput_uring_arm(uring, source) < 0)
+			log_error(libinput,
+				  "failed to queue io_uring request for fd %d\n",
+				  source->fd);
+	}
+
+	/* All the new requests in one go, this is usually the only
+	 * syscall for the whole dispatch */
+	rc = io_uring_submit(&uring->ring);
+
+	return rc < 0 ? rc : 0;
+}
+
+#else
+
+static inline void
+libinput_uring_init(struct libinput *libinput)
+{
+}
+
+static inline void
+libinput_uring_destroy(struct libinput *libinput)
+{
+}
+
+static inline int
+libinput_uring_add_source(struct libinput *libinput,
+			  struct libinput_source *source)
+{
+	return -ENOSYS;
+}
+
+static inline void
+libinput_uring_remove_source(struct libinput *libinput,
+			     struct libinput_source *source)
+{
+}
+
+static inline int
+libinput_uring_dispatch(struct libinput *libinput)
+{
+	return -ENOSYS;
+}
+
+#endif
+
+static struct libinput_source *
+libinput_add_source(struct libinput *libinput,
+		    int fd,
+		    libinput_source_dispatch_t dispatch,
+		    libinput_source_read_t read,
+		    size_t read_size,
+		    void *user_data)
 {
 	struct libinput_source *source;
 	struct epoll_event ep;
 
-	source = malloc(sizeof *source);
+	source = zalloc_tag(LIBINPUT_MEMORY_TAG_SOURCE,
+			    sizeof *source + read_size);
 	if (!source)
 		return NULL;
 
 	source->dispatch = dispatch;
+	source->read = read;
 	source->user_data = user_data;
 	source->fd = fd;
+	source->buffer = read_size ? source + 1 : NULL;
+	source->read_size = read_size;
+
+	if (libinput->uring) {
+		/* nothing is queued if this fails */
+		if (libinput_uring_add_source(libinput, source) < 0) {
+			free_tag(LIBINPUT_MEMORY_TAG_SOURCE, source);
+			return NULL;
+		}
+
+		return source;
+	}
 
 	memset(&ep, 0, sizeof ep);
 	ep.events = EPOLLIN;
 	ep.data.ptr = source;
 
-	if (epoll_ctl(libinput->epoll_fd, EPOLL_CTL_ADD, fd, &ep) < 0) {
-		free(source);
+	if (epoll_ctl(libinput->source_fd, EPOLL_CTL_ADD, fd, &ep) < 0) {
+		free_tag(LIBINPUT_MEMORY_TAG_SOURCE, source);
 		return NULL;
 	}
 
 	return source;
 }
 
+struct libinput_source *
+libinput_add_fd(struct libinput *libinput,
+		int fd,
+		libinput_source_dispatch_t dispatch,
+		void *user_data)
+{
+	return libinput_add_source(libinput, fd, dispatch,
+				   NULL, 0, user_data);
+}
+
+struct libinput_source *
+libinput_add_fd_reader(struct libinput *libinput,
+		       int fd,
+		       libinput_source_read_t read,
+		       size_t read_size,
+		       void *user_data)
+{
+	return libinput_add_source(libinput, fd, NULL,
+				   read, read_size, user_data);
+}
+
 void
 libinput_remove_source(struct libinput *libinput,
 		       struct libinput_source *source)
 {
-	epoll_ctl(libinput->epoll_fd, EPOLL_CTL_DEL, source->fd, NULL);
+	if (libinput->uring) {
+		source->fd = -1;
+		libinput_uring_remove_source(libinput, source);
+		return;
+	}
+
+	epoll_ctl(libinput->source_fd, EPOLL_CTL_DEL, source->fd, NULL);
 	source->fd = -1;
 	list_insert(&libinput->source_destroy_list, &source->link);
 }
 
+static int
+libinput_wakeup_attach(struct libinput *libinput)
+{
+	struct epoll_event ep;
+
+	memset(&ep, 0, sizeof ep);
+	ep.events = EPOLLIN;
+	ep.data.ptr = NULL;
+
+	return epoll_ctl(libinput->epoll_fd, EPOLL_CTL_ADD,
+			 libinput->wakeup_fd, &ep);
+}
+
+static void
+libinput_wakeup_detach(struct libinput *libinput)
+{
+	epoll_ctl(libinput->epoll_fd, EPOLL_CTL_DEL, libinput->wakeup_fd, NULL);
+}
+
+static void
+libinput_close_fds(struct libinput *libinput)
+{
+	if (libinput->deferred.timerfd != -1)
+		close(libinput->deferred.timerfd);
+	if (libinput->source_fd != -1)
+		close(libinput->source_fd);
+	close(libinput->epoll_fd);
+}
+
 int
 libinput_init(struct libinput *libinput,
 	      const struct libinput_interface *interface,
 	      const struct libinput_interface_backend *interface_backend,
 	      void *user_data)
 {
+	libinput->source_fd = -1;
+	libinput->deferred.timerfd = -1;
+	libinput->event_mask = ~0U;
+
 	libinput->epoll_fd = epoll_create1(EPOLL_CLOEXEC);;
 	if (libinput->epoll_fd < 0)
 		return -1;
 
 	libinput->events_len = 4;
-	libinput->events = zalloc(libinput->events_len * sizeof(*libinput->events));
+	libinput->events = zalloc_tag(LIBINPUT_MEMORY_TAG_EVENT,
+				      libinput->events_len * sizeof(*libinput->events));
 	if (!libinput->events) {
 		close(libinput->epoll_fd);
 		return -1;
 	}
 
+	list_init(&libinput->epochs);
+	if (!libinput_epoch_new(libinput)) {
+		free_tag(LIBINPUT_MEMORY_TAG_EVENT, libinput->events);
+		close(libinput->epoll_fd);
+		return -1;
+	}
+
 	libinput->log_handler = libinput_default_log_func;
 	libinput->log_priority = LIBINPUT_LOG_PRIORITY_ERROR;
 	libinput->interface = interface;
@@ -516,10 +1041,26 @@ libinput_init(struct libinput *libinput,
 	libinput->refcount = 1;
 	list_init(&libinput->source_destroy_list);
 	list_init(&libinput->seat_list);
+	list_init(&libinput->open_many.list);
+	libinput->open_many.fd = -1;
 
-	if (libinput_timer_subsys_init(libinput) != 0) {
-		free(libinput->events);
-		close(libinput->epoll_fd);
+	libinput_uring_init(libinput);
+
+	/* The sources live on their own epoll fd (or the ring) that's
+	 * nested in the caller's fd, so we can hold back the caller's
+	 * wakeups, see libinput_set_dispatch_deadline() */
+	if (!libinput->uring) {
+		libinput->source_fd = epoll_create1(EPOLL_CLOEXEC);
+		libinput->wakeup_fd = libinput->source_fd;
+	}
+
+	if (libinput->wakeup_fd < 0 ||
+	    libinput_wakeup_attach(libinput) < 0 ||
+	    libinput_timer_subsys_init(libinput) != 0) {
+		libinput_uring_destroy(libinput);
+		libinput_epochs_destroy(libinput);
+		free_tag(LIBINPUT_MEMORY_TAG_EVENT, libinput->events);
+		libinput_close_fds(libinput);
 		return -1;
 	}
 
@@ -532,13 +1073,16 @@ libinput_device_destroy(struct libinput_device *device);
 static void
 libinput_seat_destroy(struct libinput_seat *seat);
 
+static void
+libinput_open_many_destroy(struct libinput *libinput);
+
 static void
 libinput_drop_destroyed_sources(struct libinput *libinput)
 {
 	struct libinput_source *source, *next;
 
 	list_for_each_safe(source, next, &libinput->source_destroy_list, link)
-		free(source);
+		free_tag(LIBINPUT_MEMORY_TAG_SOURCE, source);
 	list_init(&libinput->source_destroy_list);
 }
 
@@ -571,7 +1115,12 @@ libinput_unref(struct libinput *libinput)
 	while ((event = libinput_get_event(libinput)))
 	       libinput_event_destroy(event);
 
-	free(libinput->events);
+	/* all events are gone, nothing can race with us anymore */
+	libinput_destroy_retired(libinput);
+	libinput->thread_safe_events = 0;
+	libinput_epochs_destroy(libinput);
+
+	free_tag(LIBINPUT_MEMORY_TAG_EVENT, libinput->events);
 
 	list_for_each_safe(seat, next_seat, &libinput->seat_list, link) {
 		list_for_each_safe(device, next_device,
@@ -582,10 +1131,12 @@ libinput_unref(struct libinput *libinput)
 		libinput_seat_destroy(seat);
 	}
 
+	libinput_open_many_destroy(libinput);
 	libinput_timer_subsys_destroy(libinput);
+	libinput_uring_destroy(libinput);
 	libinput_drop_destroyed_sources(libinput);
-	close(libinput->epoll_fd);
-	free(libinput);
+	libinput_close_fds(libinput);
+	free_tag(LIBINPUT_MEMORY_TAG_CONTEXT, libinput);
 
 	return NULL;
 }
@@ -593,13 +1144,29 @@ libinput_unref(struct libinput *libinput)
 LIBINPUT_EXPORT void
 libinput_event_destroy(struct libinput_event *event)
 {
+	struct libinput_epoch *epoch;
+	struct libinput *libinput;
+	int live;
+
 	if (event == NULL)
 		return;
 
-	if (event->device)
-		libinput_device_unref(event->device);
+	epoch = event->epoch;
+	if (epoch) {
+		libinput = event->device->seat->libinput;
+		live = __atomic_sub_fetch(&epoch->live, 1, __ATOMIC_ACQ_REL);
+
+		/* With thread-safe events we may not be on the context's
+		 * thread, libinput_dispatch() collects instead. Check that
+		 * first, the context's epoch is only safe to read on its
+		 * own thread. */
+		if (live == 0 &&
+		    !libinput->thread_safe_events &&
+		    epoch != libinput->epoch)
+			libinput_epoch_collect(libinput);
+	}
 
-	free(event);
+	free_tag(LIBINPUT_MEMORY_TAG_EVENT, event);
 }
 
 int
@@ -617,71 +1184,355 @@ close_restricted(struct libinput *libinput, int fd)
 	return libinput->interface->close_restricted(fd, libinput->user_data);
 }
 
-void
-libinput_seat_init(struct libinput_seat *seat,
-		   struct libinput *libinput,
-		   const char *physical_name,
-		   const char *logical_name,
-		   libinput_seat_destroy_func destroy)
+static struct libinput_open_request *
+open_request_create(struct libinput *libinput,
+		    const char **paths,
+		    size_t count,
+		    open_restricted_many_done_func done,
+		    void *data)
 {
-	seat->refcount = 1;
-	seat->libinput = libinput;
-	seat->physical_name = strdup(physical_name);
-	seat->logical_name = strdup(logical_name);
-	seat->destroy = destroy;
-	list_init(&seat->devices_list);
-	list_insert(&libinput->seat_list, &seat->link);
-}
+	struct libinput_open_request *request;
+	size_t i;
 
-LIBINPUT_EXPORT struct libinput_seat *
-libinput_seat_ref(struct libinput_seat *seat)
-{
-	seat->refcount++;
-	return seat;
+	request = zalloc_tag(LIBINPUT_MEMORY_TAG_DEVICE, sizeof *request);
+	if (!request)
+		return NULL;
+
+	request->libinput = libinput;
+	request->interface = libinput->interface;
+	request->user_data = libinput->user_data;
+	request->count = count;
+	request->done = done;
+	request->done_data = data;
+	request->paths = zalloc_tag(LIBINPUT_MEMORY_TAG_DEVICE,
+				    count * sizeof(*request->paths));
+	request->fds = zalloc_tag(LIBINPUT_MEMORY_TAG_DEVICE,
+				  count * sizeof(*request->fds));
+	if (!request->paths || !request->fds)
+		goto err;
+
+	for (i = 0; i < count; i++) {
+		request->fds[i] = -ECANCELED;
+		request->paths[i] = strdup_tag(LIBINPUT_MEMORY_TAG_DEVICE,
+					       paths[i]);
+		if (!request->paths[i])
+			goto err;
+	}
+
+	return request;
+
+err:
+	if (request->paths) {
+		for (i = 0; i < count; i++)
+			free_tag(LIBINPUT_MEMORY_TAG_DEVICE, request->paths[i]);
+	}
+	free_tag(LIBINPUT_MEMORY_TAG_DEVICE, request->paths);
+	free_tag(LIBINPUT_MEMORY_TAG_DEVICE, request->fds);
+	free_tag(LIBINPUT_MEMORY_TAG_DEVICE, request);
+	return NULL;
 }
 
 static void
-libinput_seat_destroy(struct libinput_seat *seat)
+open_request_destroy(struct libinput_open_request *request)
 {
-	list_remove(&seat->link);
-	free(seat->logical_name);
-	free(seat->physical_name);
-	seat->destroy(seat);
+	size_t i;
+
+	for (i = 0; i < request->count; i++)
+		free_tag(LIBINPUT_MEMORY_TAG_DEVICE, request->paths[i]);
+	free_tag(LIBINPUT_MEMORY_TAG_DEVICE, request->paths);
+	free_tag(LIBINPUT_MEMORY_TAG_DEVICE, request->fds);
+	free_tag(LIBINPUT_MEMORY_TAG_DEVICE, request);
 }
 
-LIBINPUT_EXPORT struct libinput_seat *
-libinput_seat_unref(struct libinput_seat *seat)
+static void
+open_request_close_fds(struct libinput_open_request *request)
 {
-	assert(seat->refcount > 0);
-	seat->refcount--;
-	if (seat->refcount == 0) {
-		libinput_seat_destroy(seat);
-		return NULL;
-	} else {
-		return seat;
+	size_t i;
+
+	for (i = 0; i < request->count; i++) {
+		if (request->fds[i] >= 0)
+			request->interface->close_restricted(request->fds[i],
+							     request->user_data);
+		request->fds[i] = -ECANCELED;
 	}
 }
 
-LIBINPUT_EXPORT void
-libinput_seat_set_user_data(struct libinput_seat *seat, void *user_data)
+static int
+open_request_finish(struct libinput_open_request *request)
 {
-	seat->user_data = user_data;
-}
+	int rc;
 
-LIBINPUT_EXPORT void *
-libinput_seat_get_user_data(struct libinput_seat *seat)
-{
-	return seat->user_data;
-}
+	list_remove(&request->link);
+	rc = request->done(request->libinput,
+			   request->fds,
+			   request->count,
+			   request->done_data);
+	open_request_destroy(request);
 
-LIBINPUT_EXPORT struct libinput *
-libinput_seat_get_context(struct libinput_seat *seat)
-{
-	return seat->libinput;
+	return rc;
 }
 
-LIBINPUT_EXPORT const char *
-libinput_seat_get_physical_name(struct libinput_seat *seat)
+static void
+libinput_open_many_dispatch(void *data)
+{
+	struct libinput *libinput = data;
+	struct libinput_open_request *request, *tmp;
+	uint64_t count;
+
+	if (read(libinput->open_many.fd, &count, sizeof(count)) < 0 &&
+	    errno != EAGAIN)
+		log_error(libinput,
+			  "failed to read open request notification (%s)\n",
+			  strerror(errno));
+
+	list_for_each_safe(request, tmp, &libinput->open_many.list, link) {
+		if (!request->completed)
+			continue;
+
+		if (open_request_finish(request) != 0)
+			log_error(libinput,
+				  "failed to set up devices after opening them\n");
+	}
+}
+
+static void
+libinput_open_many_cancel(struct libinput *libinput)
+{
+	struct libinput_open_request *request, *tmp;
+
+	list_for_each_safe(request, tmp, &libinput->open_many.list, link) {
+		if (request->cancelled)
+			continue;
+
+		request->cancelled = true;
+		request->done(libinput, NULL, request->count, request->done_data);
+
+		/* completed but not yet dispatched, otherwise the fds are
+		 * closed in libinput_open_request_complete() */
+		if (request->completed) {
+			open_request_close_fds(request);
+			list_remove(&request->link);
+			open_request_destroy(request);
+		}
+	}
+}
+
+static void
+libinput_open_many_destroy(struct libinput *libinput)
+{
+	struct libinput_open_request *request, *tmp;
+
+	/* all requests are cancelled by now, the caller still owns them
+	 * and will complete them at some point */
+	list_for_each_safe(request, tmp, &libinput->open_many.list, link) {
+		list_remove(&request->link);
+		request->libinput = NULL;
+	}
+
+	if (libinput->open_many.source)
+		libinput_remove_source(libinput, libinput->open_many.source);
+	if (libinput->open_many.fd != -1)
+		close(libinput->open_many.fd);
+}
+
+int
+open_restricted_many(struct libinput *libinput,
+		     const char **paths,
+		     size_t count,
+		     int flags,
+		     open_restricted_many_done_func done,
+		     void *data)
+{
+	struct libinput_open_request *request;
+	int *fds;
+	size_t i;
+	int rc;
+
+	if (!libinput->open_many.func) {
+		fds = zalloc_tag(LIBINPUT_MEMORY_TAG_DEVICE,
+				 count * sizeof(*fds));
+		if (!fds) {
+			done(libinput, NULL, count, data);
+			return -1;
+		}
+
+		for (i = 0; i < count; i++)
+			fds[i] = open_restricted(libinput, paths[i], flags);
+
+		rc = done(libinput, fds, count, data);
+		free_tag(LIBINPUT_MEMORY_TAG_DEVICE, fds);
+
+		return rc;
+	}
+
+	request = open_request_create(libinput, paths, count, done, data);
+	if (!request) {
+		done(libinput, NULL, count, data);
+		return -1;
+	}
+
+	list_insert(&libinput->open_many.list, &request->link);
+
+	request->in_callback = true;
+	libinput->open_many.func(request,
+				 (const char **)request->paths,
+				 count,
+				 flags,
+				 libinput->user_data);
+	request->in_callback = false;
+
+	if (request->completed)
+		return open_request_finish(request);
+
+	return 0;
+}
+
+LIBINPUT_EXPORT int
+libinput_set_open_restricted_many(struct libinput *libinput,
+				  libinput_open_restricted_many_func open_many)
+{
+	int fd;
+
+	if (open_many && libinput->open_many.fd == -1) {
+		fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		if (fd < 0)
+			return -errno;
+
+		libinput->open_many.source =
+			libinput_add_fd(libinput,
+					fd,
+					libinput_open_many_dispatch,
+					libinput);
+		if (!libinput->open_many.source) {
+			close(fd);
+			return -ENOMEM;
+		}
+
+		libinput->open_many.fd = fd;
+	}
+
+	libinput->open_many.func = open_many;
+
+	return 0;
+}
+
+LIBINPUT_EXPORT void
+libinput_open_request_complete(struct libinput_open_request *request,
+			       const int *fds)
+{
+	struct libinput *libinput = request->libinput;
+	uint64_t one = 1;
+
+	memcpy(request->fds, fds, request->count * sizeof(*fds));
+
+	if (!libinput || request->cancelled) {
+		open_request_close_fds(request);
+		if (libinput)
+			list_remove(&request->link);
+		open_request_destroy(request);
+		return;
+	}
+
+	request->completed = true;
+
+	/* open_restricted_many() takes it from here */
+	if (request->in_callback)
+		return;
+
+	if (write(libinput->open_many.fd, &one, sizeof(one)) != sizeof(one))
+		log_error(libinput,
+			  "failed to signal open request completion (%s)\n",
+			  strerror(errno));
+}
+
+void
+libinput_seat_init(struct libinput_seat *seat,
+		   struct libinput *libinput,
+		   const char *physical_name,
+		   const char *logical_name,
+		   libinput_seat_destroy_func destroy)
+{
+	seat->refcount = 1;
+	seat->libinput = libinput;
+	seat->physical_name = strdup_tag(LIBINPUT_MEMORY_TAG_SEAT,
+					 physical_name);
+	seat->logical_name = strdup_tag(LIBINPUT_MEMORY_TAG_SEAT, logical_name);
+	seat->destroy = destroy;
+	seat->pointer_state.fd = -1;
+	list_init(&seat->devices_list);
+	list_init(&seat->interested_devices);
+	list_insert(&libinput->seat_list, &seat->link);
+}
+
+LIBINPUT_EXPORT struct libinput_seat *
+libinput_seat_ref(struct libinput_seat *seat)
+{
+	__atomic_add_fetch(&seat->refcount, 1, __ATOMIC_RELAXED);
+	return seat;
+}
+
+static void
+libinput_seat_destroy(struct libinput_seat *seat)
+{
+	list_remove(&seat->link);
+	free_tag(LIBINPUT_MEMORY_TAG_SEAT, seat->logical_name);
+	free_tag(LIBINPUT_MEMORY_TAG_SEAT, seat->physical_name);
+	if (seat->pointer_state.page)
+		munmap(seat->pointer_state.page,
+		       sizeof(*seat->pointer_state.page));
+	if (seat->pointer_state.fd != -1)
+		close(seat->pointer_state.fd);
+	seat->destroy(seat);
+}
+
+LIBINPUT_EXPORT struct libinput_seat *
+libinput_seat_unref(struct libinput_seat *seat)
+{
+	struct libinput *libinput = seat->libinput;
+	int refcount;
+
+	refcount = __atomic_sub_fetch(&seat->refcount, 1, __ATOMIC_ACQ_REL);
+	assert(refcount >= 0);
+	if (refcount > 0)
+		return seat;
+
+	if (libinput->thread_safe_events) {
+		seat->retired_next = __atomic_load_n(&libinput->retired.seats,
+						     __ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(&libinput->retired.seats,
+						    &seat->retired_next,
+						    seat,
+						    true,
+						    __ATOMIC_RELEASE,
+						    __ATOMIC_RELAXED))
+			;
+	} else {
+		libinput_seat_destroy(seat);
+	}
+
+	return NULL;
+}
+
+LIBINPUT_EXPORT void
+libinput_seat_set_user_data(struct libinput_seat *seat, void *user_data)
+{
+	seat->user_data = user_data;
+}
+
+LIBINPUT_EXPORT void *
+libinput_seat_get_user_data(struct libinput_seat *seat)
+{
+	return seat->user_data;
+}
+
+LIBINPUT_EXPORT struct libinput *
+libinput_seat_get_context(struct libinput_seat *seat)
+{
+	return seat->libinput;
+}
+
+LIBINPUT_EXPORT const char *
+libinput_seat_get_physical_name(struct libinput_seat *seat)
 {
 	return seat->physical_name;
 }
@@ -692,6 +1543,181 @@ libinput_seat_get_logical_name(struct libinput_seat *seat)
 	return seat->logical_name;
 }
 
+static int
+libinput_seat_init_pointer_state(struct libinput_seat *seat)
+{
+	size_t size = sizeof(*seat->pointer_state.page);
+	void *page;
+	int fd = -1;
+
+	if (seat->pointer_state.page)
+		return 0;
+
+#ifdef HAVE_MEMFD_CREATE
+	fd = memfd_create("libinput-pointer-state",
+			  MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd < 0)
+		return -errno;
+
+	/* other processes get this fd, they must not be able to
+	 * truncate it under our feet */
+	if (ftruncate(fd, size) < 0 ||
+	    fcntl(fd, F_ADD_SEALS,
+		  F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0) {
+		close(fd);
+		return -errno;
+	}
+
+	page = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+#else
+	page = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+#endif
+	if (page == MAP_FAILED) {
+		if (fd != -1)
+			close(fd);
+		return -errno;
+	}
+
+	seat->pointer_state.page = page;
+	seat->pointer_state.fd = fd;
+
+	return 0;
+}
+
+LIBINPUT_EXPORT const struct libinput_pointer_state_page *
+libinput_seat_get_pointer_state_page(struct libinput_seat *seat)
+{
+	if (libinput_seat_init_pointer_state(seat) < 0)
+		return NULL;
+
+	return seat->pointer_state.page;
+}
+
+LIBINPUT_EXPORT int
+libinput_seat_get_pointer_state_fd(struct libinput_seat *seat)
+{
+	int rc;
+
+	rc = libinput_seat_init_pointer_state(seat);
+	if (rc < 0)
+		return rc;
+
+	return seat->pointer_state.fd != -1 ? seat->pointer_state.fd : -ENOSYS;
+}
+
+LIBINPUT_EXPORT void
+libinput_pointer_state_page_read(const struct libinput_pointer_state_page *page,
+				 struct libinput_pointer_state *state)
+{
+	uint32_t seq;
+
+	do {
+		seq = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+		memcpy(state, &page->state, sizeof(*state));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while ((seq & 1) ||
+		 seq != __atomic_load_n(&page->seq, __ATOMIC_RELAXED));
+}
+
+static inline struct libinput_pointer_state *
+pointer_state_write_begin(struct libinput_seat *seat)
+{
+	struct libinput_pointer_state_page *page = seat->pointer_state.page;
+
+	__atomic_store_n(&page->seq, page->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	return &page->state;
+}
+
+static inline void
+pointer_state_write_end(struct libinput_seat *seat)
+{
+	struct libinput_pointer_state_page *page = seat->pointer_state.page;
+
+	__atomic_store_n(&page->seq, page->seq + 1, __ATOMIC_RELEASE);
+}
+
+static struct libinput_epoch *
+libinput_epoch_new(struct libinput *libinput)
+{
+	struct libinput_epoch *epoch;
+
+	epoch = zalloc_tag(LIBINPUT_MEMORY_TAG_EVENT, sizeof *epoch);
+	if (!epoch)
+		return NULL;
+
+	list_insert(&libinput->epochs, &epoch->link);
+	libinput->epoch = epoch;
+
+	return epoch;
+}
+
+static void
+libinput_epoch_destroy(struct libinput_epoch *epoch)
+{
+	struct libinput_device *device;
+
+	while ((device = epoch->devices)) {
+		epoch->devices = device->retired_next;
+		libinput_device_unref(device);
+	}
+
+	list_remove(&epoch->link);
+	free_tag(LIBINPUT_MEMORY_TAG_EVENT, epoch);
+}
+
+/* Destroy the oldest epochs without live events, and their devices */
+static void
+libinput_epoch_collect(struct libinput *libinput)
+{
+	struct libinput_epoch *epoch;
+
+	while (libinput->epochs.prev != &libinput->epochs) {
+		epoch = container_of(libinput->epochs.prev, epoch, link);
+		if (epoch == libinput->epoch ||
+		    __atomic_load_n(&epoch->live, __ATOMIC_ACQUIRE) > 0)
+			break;
+
+		libinput_epoch_destroy(epoch);
+	}
+}
+
+/* All events must be destroyed */
+static void
+libinput_epochs_destroy(struct libinput *libinput)
+{
+	struct libinput_epoch *epoch, *tmp;
+
+	list_for_each_safe(epoch, tmp, &libinput->epochs, link)
+		libinput_epoch_destroy(epoch);
+
+	libinput->epoch = NULL;
+}
+
+void
+libinput_device_retire(struct libinput_device *device)
+{
+	struct libinput *libinput = device->seat->libinput;
+	struct libinput_epoch *epoch;
+
+	libinput_epoch_collect(libinput);
+
+	/* no event could refer to the device */
+	epoch = libinput->epoch;
+	if (libinput->epochs.next == libinput->epochs.prev &&
+	    __atomic_load_n(&epoch->live, __ATOMIC_ACQUIRE) == 0)
+		return;
+
+	device->retired_next = epoch->devices;
+	epoch->devices = libinput_device_ref(device);
+
+	/* If this fails, the device waits for the current epoch to end
+	 * along with the next device removed */
+	libinput_epoch_new(libinput);
+}
+
 void
 libinput_device_init(struct libinput_device *device,
 		     struct libinput_seat *seat)
@@ -699,12 +1725,17 @@ libinput_device_init(struct libinput_device *device,
 	device->seat = seat;
 	device->refcount = 1;
 	list_init(&device->event_listeners);
+	device->event_listener_mask = 0;
+	device->last_seq = 0;
+	device->frame_seq = 0;
+	device->in_frame = 0;
+	device->in_process = 0;
 }
 
 LIBINPUT_EXPORT struct libinput_device *
 libinput_device_ref(struct libinput_device *device)
 {
-	device->refcount++;
+	__atomic_add_fetch(&device->refcount, 1, __ATOMIC_RELAXED);
 	return device;
 }
 
@@ -718,30 +1749,245 @@ libinput_device_destroy(struct libinput_device *device)
 LIBINPUT_EXPORT struct libinput_device *
 libinput_device_unref(struct libinput_device *device)
 {
-	assert(device->refcount > 0);
-	device->refcount--;
-	if (device->refcount == 0) {
-		libinput_device_destroy(device);
-		return NULL;
-	} else {
+	struct libinput *libinput = device->seat->libinput;
+	int refcount;
+
+	refcount = __atomic_sub_fetch(&device->refcount, 1, __ATOMIC_ACQ_REL);
+	assert(refcount >= 0);
+	if (refcount > 0)
 		return device;
+
+	/* We may not be on the context's thread, destroying the device
+	 * touches the seat and the event loop */
+	if (libinput->thread_safe_events) {
+		device->retired_next = __atomic_load_n(&libinput->retired.devices,
+						       __ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(&libinput->retired.devices,
+						    &device->retired_next,
+						    device,
+						    true,
+						    __ATOMIC_RELEASE,
+						    __ATOMIC_RELAXED))
+			;
+	} else {
+		libinput_device_destroy(device);
+	}
+
+	return NULL;
+}
+
+/* Destroy the devices and seats released since the last call, possibly
+ * from other threads. Devices first, they hold seat references */
+void
+libinput_destroy_retired(struct libinput *libinput)
+{
+	struct libinput_device *device, *next_device;
+	struct libinput_seat *seat, *next_seat;
+
+	device = __atomic_exchange_n(&libinput->retired.devices, NULL,
+				     __ATOMIC_ACQUIRE);
+	while (device) {
+		next_device = device->retired_next;
+		libinput_device_destroy(device);
+		device = next_device;
+	}
+
+	libinput_epoch_collect(libinput);
+
+	seat = __atomic_exchange_n(&libinput->retired.seats, NULL,
+				   __ATOMIC_ACQUIRE);
+	while (seat) {
+		next_seat = seat->retired_next;
+		libinput_seat_destroy(seat);
+		seat = next_seat;
 	}
 }
 
+LIBINPUT_EXPORT int
+libinput_set_thread_safe_events(struct libinput *libinput, int enable)
+{
+	libinput->thread_safe_events = !!enable;
+	if (!enable)
+		libinput_destroy_retired(libinput);
+
+	return 0;
+}
+
 LIBINPUT_EXPORT int
 libinput_get_fd(struct libinput *libinput)
 {
 	return libinput->epoll_fd;
 }
 
+static inline uint64_t
+libinput_now_usec(void)
+{
+	struct timespec ts = { 0, 0 };
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+/* Back to waking up the caller whenever there's something to do */
+static void
+libinput_end_deferred_dispatch(struct libinput *libinput)
+{
+	struct itimerspec its = { { 0, 0 }, { 0, 0 } };
+
+	if (libinput->deferred.deadline == 0)
+		return;
+
+	libinput->deferred.deadline = 0;
+
+	/* disarming also resets the expiration count, so the timerfd
+	 * isn't readable anymore */
+	timerfd_settime(libinput->deferred.timerfd, 0, &its, NULL);
+
+	if (libinput_wakeup_attach(libinput) < 0)
+		log_error(libinput,
+			  "failed to re-enable wakeups (%s)\n",
+			  strerror(errno));
+}
+
+LIBINPUT_EXPORT int
+libinput_set_dispatch_deadline(struct libinput *libinput,
+			       uint64_t deadline)
+{
+	struct epoll_event ep;
+	struct itimerspec its = { { 0, 0 }, { 0, 0 } };
+	int fd;
+
+	if (deadline == 0) {
+		libinput_end_deferred_dispatch(libinput);
+		return 0;
+	}
+
+	if (libinput->deferred.timerfd == -1) {
+		fd = timerfd_create(CLOCK_MONOTONIC,
+				    TFD_CLOEXEC | TFD_NONBLOCK);
+		if (fd < 0)
+			return -errno;
+
+		memset(&ep, 0, sizeof ep);
+		ep.events = EPOLLIN;
+		ep.data.ptr = NULL;
+
+		if (epoll_ctl(libinput->epoll_fd, EPOLL_CTL_ADD, fd, &ep) < 0) {
+			close(fd);
+			return -errno;
+		}
+
+		libinput->deferred.timerfd = fd;
+	}
+
+	its.it_value.tv_sec = deadline / 1000000;
+	its.it_value.tv_nsec = (deadline % 1000000) * 1000;
+
+	/* a deadline in the past fires right away */
+	if (timerfd_settime(libinput->deferred.timerfd,
+			    TFD_TIMER_ABSTIME, &its, NULL) < 0)
+		return -errno;
+
+	if (libinput->deferred.deadline == 0)
+		libinput_wakeup_detach(libinput);
+
+	libinput->deferred.deadline = deadline;
+
+	return 0;
+}
+
+LIBINPUT_EXPORT int
+libinput_set_event_mask(struct libinput *libinput,
+			const enum libinput_event_type *types,
+			size_t ntypes)
+{
+	uint32_t mask;
+	size_t i;
+
+	if (!types) {
+		libinput->event_mask = ~0U;
+		return 0;
+	}
+
+	mask = event_type_mask(LIBINPUT_EVENT_DEVICE_ADDED) |
+	       event_type_mask(LIBINPUT_EVENT_DEVICE_REMOVED);
+
+	for (i = 0; i < ntypes; i++) {
+		if (event_type_index(types[i]) == 0)
+			return -EINVAL;
+
+		mask |= event_type_mask(types[i]);
+	}
+
+	libinput->event_mask = mask;
+
+	return 0;
+}
+
+LIBINPUT_EXPORT int
+libinput_get_memory_stats(enum libinput_memory_tag tag,
+			  struct libinput_memory_stats *stats)
+{
+#ifdef HAVE_MEMORY_STATS
+	return memory_stats_get(tag, stats);
+#else
+	return -ENOSYS;
+#endif
+}
+
+LIBINPUT_EXPORT int
+libinput_set_event_sink(struct libinput *libinput,
+			enum libinput_event_type type,
+			libinput_event_sink_func sink,
+			void *data)
+{
+	unsigned int idx;
+
+	switch (type) {
+	case LIBINPUT_EVENT_NONE:
+	case LIBINPUT_EVENT_DEVICE_ADDED:
+	case LIBINPUT_EVENT_DEVICE_REMOVED:
+		return -EINVAL;
+	default:
+		break;
+	}
+
+	idx = event_type_index(type);
+	if (idx == 0)
+		return -EINVAL;
+
+	libinput->sinks.sink[idx].func = sink;
+	libinput->sinks.sink[idx].data = data;
+
+	if (sink)
+		libinput->sinks.mask |= event_type_mask(type);
+	else
+		libinput->sinks.mask &= ~event_type_mask(type);
+
+	return 0;
+}
+
 LIBINPUT_EXPORT int
 libinput_dispatch(struct libinput *libinput)
 {
 	struct libinput_source *source;
 	struct epoll_event ep[32];
-	int i, count;
+	int i, count, rc;
+
+	if (libinput->deferred.deadline != 0 &&
+	    libinput_now_usec() >= libinput->deferred.deadline)
+		libinput_end_deferred_dispatch(libinput);
+
+	libinput_destroy_retired(libinput);
 
-	count = epoll_wait(libinput->epoll_fd, ep, ARRAY_LENGTH(ep), 0);
+	if (libinput->uring) {
+		rc = libinput_uring_dispatch(libinput);
+		libinput_drop_destroyed_sources(libinput);
+		return rc;
+	}
+
+	count = epoll_wait(libinput->source_fd, ep, ARRAY_LENGTH(ep), 0);
 	if (count < 0)
 		return -errno;
 
@@ -750,7 +1996,10 @@ libinput_dispatch(struct libinput *libinput)
 		if (source->fd == -1)
 			continue;
 
-		source->dispatch(source->user_data);
+		if (source->read)
+			libinput_source_read(source);
+		else
+			source->dispatch(source->user_data);
 	}
 
 	libinput_drop_destroyed_sources(libinput);
@@ -761,21 +2010,32 @@ libinput_dispatch(struct libinput *libinput)
 void
 libinput_device_add_event_listener(struct libinput_device *device,
 				   struct libinput_event_listener *listener,
+				   uint32_t event_mask,
 				   void (*notify_func)(
 						uint64_t time,
 						struct libinput_event *event,
 						void *notify_func_data),
 				   void *notify_func_data)
 {
+	listener->event_mask = event_mask;
 	listener->notify_func = notify_func;
 	listener->notify_func_data = notify_func_data;
 	list_insert(&device->event_listeners, &listener->link);
+
+	device->event_listener_mask |= event_mask;
 }
 
 void
-libinput_device_remove_event_listener(struct libinput_event_listener *listener)
+libinput_device_remove_event_listener(struct libinput_device *device,
+				      struct libinput_event_listener *listener)
 {
+	struct libinput_event_listener *l;
+
 	list_remove(&listener->link);
+
+	device->event_listener_mask = 0;
+	list_for_each(l, &device->event_listeners, link)
+		device->event_listener_mask |= l->event_mask;
 }
 
 static uint32_t
@@ -827,6 +2087,14 @@ init_event_base(struct libinput_event *event,
 {
 	event->type = type;
 	event->device = device;
+
+	/* A frame can span several reads, so a timer may fire between two
+	 * of its events. Only what the device's own processing generates
+	 * belongs to the frame. */
+	if (device->in_process)
+		event->frame_seq = device->frame_seq;
+	else
+		event->frame_seq = ++device->last_seq;
 }
 
 static void
@@ -839,20 +2107,47 @@ post_base_event(struct libinput_device *device,
 	libinput_post_event(libinput, event);
 }
 
+/* event is the base of a caller-owned (usually stack) event of the given
+ * size. It goes to the sink if there is one, otherwise a copy is queued */
 static void
 post_device_event(struct libinput_device *device,
 		  uint64_t time,
 		  enum libinput_event_type type,
-		  struct libinput_event *event)
+		  struct libinput_event *event,
+		  size_t size)
 {
+	struct libinput *libinput = device->seat->libinput;
 	struct libinput_event_listener *listener, *tmp;
+	struct libinput_event *copy;
+	uint32_t mask = event_type_mask(type);
+	unsigned int idx;
 
 	init_event_base(event, device, type);
 
-	list_for_each_safe(listener, tmp, &device->event_listeners, link)
-		listener->notify_func(time, event, listener->notify_func_data);
+	if (device->event_listener_mask & mask) {
+		list_for_each_safe(listener, tmp, &device->event_listeners, link) {
+			if (listener->event_mask & mask)
+				listener->notify_func(time, event,
+						      listener->notify_func_data);
+		}
+	}
+
+	if (!(libinput->event_mask & mask))
+		return;
+
+	if (libinput->sinks.mask & mask) {
+		idx = event_type_index(type);
+		libinput->sinks.sink[idx].func(event,
+					       libinput->sinks.sink[idx].data);
+		return;
+	}
+
+	copy = malloc_tag(LIBINPUT_MEMORY_TAG_EVENT, size);
+	if (!copy)
+		return;
 
-	libinput_post_event(device->seat->libinput, event);
+	memcpy(copy, event, size);
+	libinput_post_event(libinput, copy);
 }
 
 void
@@ -860,7 +2155,8 @@ notify_added_device(struct libinput_device *device)
 {
 	struct libinput_event_device_notify *added_device_event;
 
-	added_device_event = zalloc(sizeof *added_device_event);
+	added_device_event = zalloc_tag(LIBINPUT_MEMORY_TAG_EVENT,
+					sizeof *added_device_event);
 	if (!added_device_event)
 		return;
 
@@ -874,7 +2170,8 @@ notify_removed_device(struct libinput_device *device)
 {
 	struct libinput_event_device_notify *removed_device_event;
 
-	removed_device_event = zalloc(sizeof *removed_device_event);
+	removed_device_event = zalloc_tag(LIBINPUT_MEMORY_TAG_EVENT,
+					  sizeof *removed_device_event);
 	if (!removed_device_event)
 		return;
 
@@ -889,16 +2186,12 @@ keyboard_notify_key(struct libinput_device *device,
 		    uint32_t key,
 		    enum libinput_key_state state)
 {
-	struct libinput_event_keyboard *key_event;
+	struct libinput_event_keyboard key_event;
 	uint32_t seat_key_count;
 
-	key_event = zalloc(sizeof *key_event);
-	if (!key_event)
-		return;
-
 	seat_key_count = update_seat_key_count(device->seat, key, state);
 
-	*key_event = (struct libinput_event_keyboard) {
+	key_event = (struct libinput_event_keyboard) {
 		.time = time,
 		.key = key,
 		.state = state,
@@ -907,7 +2200,7 @@ keyboard_notify_key(struct libinput_device *device,
 
 	post_device_event(device, time,
 			  LIBINPUT_EVENT_KEYBOARD_KEY,
-			  &key_event->base);
+			  &key_event.base, sizeof key_event);
 }
 
 void
@@ -918,13 +2211,18 @@ pointer_notify_motion(struct libinput_device *device,
 		      double dx_unaccel,
 		      double dy_unaccel)
 {
-	struct libinput_event_pointer *motion_event;
+	struct libinput_event_pointer motion_event;
+	struct libinput_pointer_state *state;
 
-	motion_event = zalloc(sizeof *motion_event);
-	if (!motion_event)
-		return;
+	if (device->seat->pointer_state.page) {
+		state = pointer_state_write_begin(device->seat);
+		state->x += dx;
+		state->y += dy;
+		state->time = time;
+		pointer_state_write_end(device->seat);
+	}
 
-	*motion_event = (struct libinput_event_pointer) {
+	motion_event = (struct libinput_event_pointer) {
 		.time = time,
 		.x = dx,
 		.y = dy,
@@ -934,7 +2232,7 @@ pointer_notify_motion(struct libinput_device *device,
 
 	post_device_event(device, time,
 			  LIBINPUT_EVENT_POINTER_MOTION,
-			  &motion_event->base);
+			  &motion_event.base, sizeof motion_event);
 }
 
 void
@@ -943,13 +2241,9 @@ pointer_notify_motion_absolute(struct libinput_device *device,
 			       double x,
 			       double y)
 {
-	struct libinput_event_pointer *motion_absolute_event;
+	struct libinput_event_pointer motion_absolute_event;
 
-	motion_absolute_event = zalloc(sizeof *motion_absolute_event);
-	if (!motion_absolute_event)
-		return;
-
-	*motion_absolute_event = (struct libinput_event_pointer) {
+	motion_absolute_event = (struct libinput_event_pointer) {
 		.time = time,
 		.x = x,
 		.y = y,
@@ -957,7 +2251,7 @@ pointer_notify_motion_absolute(struct libinput_device *device,
 
 	post_device_event(device, time,
 			  LIBINPUT_EVENT_POINTER_MOTION_ABSOLUTE,
-			  &motion_absolute_event->base);
+			  &motion_absolute_event.base, sizeof motion_absolute_event);
 }
 
 void
@@ -966,18 +2260,26 @@ pointer_notify_button(struct libinput_device *device,
 		      int32_t button,
 		      enum libinput_button_state state)
 {
-	struct libinput_event_pointer *button_event;
+	struct libinput_event_pointer button_event;
+	struct libinput_pointer_state *pointer_state;
 	int32_t seat_button_count;
 
-	button_event = zalloc(sizeof *button_event);
-	if (!button_event)
-		return;
-
 	seat_button_count = update_seat_button_count(device->seat,
 						     button,
 						     state);
 
-	*button_event = (struct libinput_event_pointer) {
+	if (device->seat->pointer_state.page &&
+	    button >= BTN_LEFT && button < BTN_LEFT + 32) {
+		pointer_state = pointer_state_write_begin(device->seat);
+		if (seat_button_count > 0)
+			pointer_state->buttons |= 1u << (button - BTN_LEFT);
+		else
+			pointer_state->buttons &= ~(1u << (button - BTN_LEFT));
+		pointer_state->time = time;
+		pointer_state_write_end(device->seat);
+	}
+
+	button_event = (struct libinput_event_pointer) {
 		.time = time,
 		.button = button,
 		.state = state,
@@ -986,7 +2288,7 @@ pointer_notify_button(struct libinput_device *device,
 
 	post_device_event(device, time,
 			  LIBINPUT_EVENT_POINTER_BUTTON,
-			  &button_event->base);
+			  &button_event.base, sizeof button_event);
 }
 
 void
@@ -996,13 +2298,9 @@ pointer_notify_axis(struct libinput_device *device,
 		    enum libinput_pointer_axis_source source,
 		    double value)
 {
-	struct libinput_event_pointer *axis_event;
+	struct libinput_event_pointer axis_event;
 
-	axis_event = zalloc(sizeof *axis_event);
-	if (!axis_event)
-		return;
-
-	*axis_event = (struct libinput_event_pointer) {
+	axis_event = (struct libinput_event_pointer) {
 		.time = time,
 		.axis = axis,
 		.value = value,
@@ -1011,7 +2309,7 @@ pointer_notify_axis(struct libinput_device *device,
 
 	post_device_event(device, time,
 			  LIBINPUT_EVENT_POINTER_AXIS,
-			  &axis_event->base);
+			  &axis_event.base, sizeof axis_event);
 }
 
 void
@@ -1022,13 +2320,9 @@ touch_notify_touch_down(struct libinput_device *device,
 			double x,
 			double y)
 {
-	struct libinput_event_touch *touch_event;
-
-	touch_event = zalloc(sizeof *touch_event);
-	if (!touch_event)
-		return;
+	struct libinput_event_touch touch_event;
 
-	*touch_event = (struct libinput_event_touch) {
+	touch_event = (struct libinput_event_touch) {
 		.time = time,
 		.slot = slot,
 		.seat_slot = seat_slot,
@@ -1038,7 +2332,7 @@ touch_notify_touch_down(struct libinput_device *device,
 
 	post_device_event(device, time,
 			  LIBINPUT_EVENT_TOUCH_DOWN,
-			  &touch_event->base);
+			  &touch_event.base, sizeof touch_event);
 }
 
 void
@@ -1049,13 +2343,9 @@ touch_notify_touch_motion(struct libinput_device *device,
 			  double x,
 			  double y)
 {
-	struct libinput_event_touch *touch_event;
-
-	touch_event = zalloc(sizeof *touch_event);
-	if (!touch_event)
-		return;
+	struct libinput_event_touch touch_event;
 
-	*touch_event = (struct libinput_event_touch) {
+	touch_event = (struct libinput_event_touch) {
 		.time = time,
 		.slot = slot,
 		.seat_slot = seat_slot,
@@ -1065,7 +2355,7 @@ touch_notify_touch_motion(struct libinput_device *device,
 
 	post_device_event(device, time,
 			  LIBINPUT_EVENT_TOUCH_MOTION,
-			  &touch_event->base);
+			  &touch_event.base, sizeof touch_event);
 }
 
 void
@@ -1074,13 +2364,9 @@ touch_notify_touch_up(struct libinput_device *device,
 		      int32_t slot,
 		      int32_t seat_slot)
 {
-	struct libinput_event_touch *touch_event;
+	struct libinput_event_touch touch_event;
 
-	touch_event = zalloc(sizeof *touch_event);
-	if (!touch_event)
-		return;
-
-	*touch_event = (struct libinput_event_touch) {
+	touch_event = (struct libinput_event_touch) {
 		.time = time,
 		.slot = slot,
 		.seat_slot = seat_slot,
@@ -1088,26 +2374,22 @@ touch_notify_touch_up(struct libinput_device *device,
 
 	post_device_event(device, time,
 			  LIBINPUT_EVENT_TOUCH_UP,
-			  &touch_event->base);
+			  &touch_event.base, sizeof touch_event);
 }
 
 void
 touch_notify_frame(struct libinput_device *device,
 		   uint64_t time)
 {
-	struct libinput_event_touch *touch_event;
+	struct libinput_event_touch touch_event;
 
-	touch_event = zalloc(sizeof *touch_event);
-	if (!touch_event)
-		return;
-
-	*touch_event = (struct libinput_event_touch) {
+	touch_event = (struct libinput_event_touch) {
 		.time = time,
 	};
 
 	post_device_event(device, time,
 			  LIBINPUT_EVENT_TOUCH_FRAME,
-			  &touch_event->base);
+			  &touch_event.base, sizeof touch_event);
 }
 
 static void
@@ -1123,7 +2405,8 @@ libinput_post_event(struct libinput *libinput,
 	events_count++;
 	if (events_count > events_len) {
 		events_len *= 2;
-		events = realloc(events, events_len * sizeof *events);
+		events = realloc_tag(LIBINPUT_MEMORY_TAG_EVENT,
+				     events, events_len * sizeof *events);
 		if (!events) {
 			fprintf(stderr, "Failed to reallocate event ring "
 				"buffer");
@@ -1146,12 +2429,15 @@ libinput_post_event(struct libinput *libinput,
 		libinput->events_len = events_len;
 	}
 
-	if (event->device)
-		libinput_device_ref(event->device);
+	event->epoch = libinput->epoch;
+	__atomic_add_fetch(&event->epoch->live, 1, __ATOMIC_RELAXED);
 
 	libinput->events_count = events_count;
 	events[libinput->events_in] = event;
 	libinput->events_in = (libinput->events_in + 1) % libinput->events_len;
+
+	PROBE4(event_post, event->device, event->type, event->frame_seq,
+	       events_count);
 }
 
 LIBINPUT_EXPORT struct libinput_event *
@@ -1167,9 +2453,41 @@ libinput_get_event(struct libinput *libinput)
 		(libinput->events_out + 1) % libinput->events_len;
 	libinput->events_count--;
 
+	PROBE4(event_get, event->device, event->type, event->frame_seq,
+	       libinput->events_count);
+
 	return event;
 }
 
+LIBINPUT_EXPORT size_t
+libinput_get_frame(struct libinput *libinput,
+		   struct libinput_event **events,
+		   size_t size)
+{
+	struct libinput_event *first, *event;
+	size_t count = 0;
+
+	if (size == 0 || libinput->events_count == 0)
+		return 0;
+
+	first = libinput->events[libinput->events_out];
+
+	/* A frame's events are usually next to each other in the queue but
+	 * another device's event may be in between, e.g. a touchpad's
+	 * software buttons posting trackpoint buttons. We stop there, the
+	 * rest of the frame comes with the next call. */
+	while (count < size && libinput->events_count > 0) {
+		event = libinput->events[libinput->events_out];
+		if (event->device != first->device ||
+		    event->frame_seq != first->frame_seq)
+			break;
+
+		events[count++] = libinput_get_event(libinput);
+	}
+
+	return count;
+}
+
 LIBINPUT_EXPORT enum libinput_event_type
 libinput_next_event_type(struct libinput *libinput)
 {
@@ -1204,6 +2522,7 @@ libinput_resume(struct libinput *libinput)
 LIBINPUT_EXPORT void
 libinput_suspend(struct libinput *libinput)
 {
+	libinput_open_many_cancel(libinput);
 	libinput->interface_backend->suspend(libinput);
 }
 
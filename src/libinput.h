@@ -308,6 +308,30 @@ libinput_event_get_context(struct libinput_event *event);
 struct libinput_device *
 libinput_event_get_device(struct libinput_event *event);
 
+/**
+ * @ingroup event
+ *
+ * Return the frame sequence number of this event. All events generated
+ * from the same hardware frame (i.e. up to and including one SYN_REPORT)
+ * of a device have the same sequence number. Events that are not the
+ * result of a hardware frame, e.g. those generated by internal timeouts,
+ * have a sequence number of their own.
+ *
+ * Some devices generate events for another device, e.g. the software
+ * buttons of some touchpads send trackpoint button events. Such an event
+ * is not part of the frame that caused it, it has a sequence number of
+ * its own on the other device.
+ *
+ * Sequence numbers are per-device and wrap around. Two events are only
+ * part of the same frame if they share both device and sequence number.
+ *
+ * @return The frame sequence number of this event
+ *
+ * @see libinput_get_frame
+ */
+uint32_t
+libinput_event_get_frame_sequence(struct libinput_event *event);
+
 /**
  * @ingroup event
  *
@@ -849,6 +873,35 @@ double
 libinput_event_touch_get_y_transformed(struct libinput_event_touch *event,
 				       uint32_t height);
 
+/**
+ * @ingroup event_touch
+ *
+ * Transform the coordinates of several touch events at once, usually all
+ * events preceding a @ref LIBINPUT_EVENT_TOUCH_FRAME. For each event, the
+ * result is the same as calling libinput_event_touch_get_x_transformed()
+ * and libinput_event_touch_get_y_transformed(). The per-device scaling is
+ * looked up once for each run of consecutive events from the same device,
+ * so events from several devices may be mixed but are cheapest when
+ * grouped by device.
+ *
+ * @note the events should only be of type @ref LIBINPUT_EVENT_TOUCH_DOWN
+ * or @ref LIBINPUT_EVENT_TOUCH_MOTION.
+ *
+ * @param events An array of libinput touch events
+ * @param nevents The number of events in events
+ * @param width The current output screen width
+ * @param height The current output screen height
+ * @param x Filled with nevents transformed x coordinates
+ * @param y Filled with nevents transformed y coordinates
+ */
+void
+libinput_event_touch_get_transformed_batch(struct libinput_event_touch **events,
+					   size_t nevents,
+					   uint32_t width,
+					   uint32_t height,
+					   double *x,
+					   double *y);
+
 /**
  * @ingroup event_touch
  *
@@ -895,6 +948,85 @@ struct libinput_interface {
 	void (*close_restricted)(int fd, void *user_data);
 };
 
+/**
+ * @ingroup base
+ * @struct libinput_open_request
+ *
+ * A batch of device nodes libinput wants opened, see
+ * libinput_set_open_restricted_many().
+ */
+struct libinput_open_request;
+
+/**
+ * @ingroup base
+ *
+ * Open several device nodes at once. The caller must call
+ * libinput_open_request_complete() exactly once for the request, either
+ * before this function returns or at any later point, e.g. once a session
+ * manager has replied to all requests.
+ *
+ * @param request The request to complete
+ * @param paths The device paths to open, valid until the request is
+ * completed
+ * @param count The number of paths
+ * @param flags Flags as defined by open(2), the same for all paths
+ * @param user_data The user_data provided when creating the context
+ */
+typedef void (*libinput_open_restricted_many_func)(
+				struct libinput_open_request *request,
+				const char **paths,
+				size_t count,
+				int flags,
+				void *user_data);
+
+/**
+ * @ingroup base
+ *
+ * Set an optional callback to open many devices at once. If set, libinput
+ * uses it instead of @ref libinput_interface::open_restricted whenever it
+ * adds several devices in one go, i.e. when a seat is assigned, in
+ * libinput_resume() and for devices hotplugged on a udev seat. Devices
+ * added with libinput_path_add_device() still use @ref
+ * libinput_interface::open_restricted.
+ *
+ * If the request is completed asynchronously, the devices are added
+ * during the first libinput_dispatch() after
+ * libinput_open_request_complete(); libinput's file descriptor becomes
+ * readable when the request is completed.
+ *
+ * @param libinput A previously initialized libinput context
+ * @param open_many The callback to use or NULL to open each device with
+ * @ref libinput_interface::open_restricted
+ *
+ * @return 0 on success or a negative errno on failure
+ */
+int
+libinput_set_open_restricted_many(struct libinput *libinput,
+				  libinput_open_restricted_many_func open_many);
+
+/**
+ * @ingroup base
+ *
+ * Hand the result of a libinput_open_restricted_many_func call back to
+ * libinput. After this call the request is invalid.
+ *
+ * Ownership of all file descriptors passes to libinput, those not needed
+ * anymore are closed with @ref libinput_interface::close_restricted. This
+ * is also the case if the context was suspended or destroyed while the
+ * request was pending.
+ *
+ * This function must be called from the thread that uses the libinput
+ * context.
+ *
+ * @param request The request passed to the
+ * libinput_open_restricted_many_func callback
+ * @param fds An array of one file descriptor or negative errno for each
+ * path, in the order of the paths
+ */
+void
+libinput_open_request_complete(struct libinput_open_request *request,
+			       const int *fds);
+
 /**
  * @ingroup base
  *
@@ -1006,6 +1138,154 @@ libinput_path_add_device(struct libinput *libinput,
 void
 libinput_path_remove_device(struct libinput_device *device);
 
+struct libevdev;
+struct input_event;
+
+/**
+ * @ingroup base
+ *
+ * Create a new libinput context for virtual devices that are fed from
+ * memory rather than read from the kernel. Devices are added with
+ * libinput_memory_add_device() and their events are passed in with
+ * libinput_memory_device_inject(), there are no device nodes involved.
+ *
+ * The events go through the same processing as those of physical
+ * devices, so e.g. a virtual touchpad gets tapping, software buttons and
+ * pointer acceleration. Timeouts like the tap timeout still need
+ * libinput_dispatch() to be called when the libinput fd becomes readable.
+ *
+ * The reference count of the context is initialized to 1. See @ref
+ * libinput_unref.
+ *
+ * @param interface The callback interface. open_restricted and
+ * close_restricted are never called for devices in this context.
+ * @param user_data Caller-specific data passed to the various callback
+ * interfaces.
+ *
+ * @return An initialized, empty libinput context.
+ */
+struct libinput *
+libinput_memory_create_context(const struct libinput_interface *interface,
+			       void *user_data);
+
+/**
+ * @ingroup base
+ *
+ * Add a virtual device to a libinput context initialized with
+ * libinput_memory_create_context(). The device is set up from the name,
+ * ids, properties and enabled event codes (including the axis ranges) of
+ * the description, which the caller creates with libevdev_new() and
+ * libevdev_enable_event_code(). libinput keeps a copy, the description
+ * may be freed once this function returns.
+ *
+ * The device is treated as if it was the description's physical
+ * equivalent. Like devices in a context from
+ * libinput_path_create_context(), the device is removed on
+ * libinput_suspend() and a new device is created on libinput_resume(),
+ * see the @ref LIBINPUT_EVENT_DEVICE_ADDED events for the new device.
+ *
+ * The lifetime of the returned device pointer is limited until the next
+ * libinput_dispatch(), use libinput_device_ref() to keep a permanent
+ * reference.
+ *
+ * @param libinput A previously initialized libinput context
+ * @param description A libevdev context describing the device
+ * @return The newly initiated device on success, or NULL on failure.
+ *
+ * @note It is an application bug to call this function on a libinput
+ * context not initialized with libinput_memory_create_context().
+ */
+struct libinput_device *
+libinput_memory_add_device(struct libinput *libinput,
+			   const struct libevdev *description);
+
+/**
+ * @ingroup base
+ *
+ * Process a batch of events for a device added with
+ * libinput_memory_add_device(), as if they had been read from the
+ * device's event node. Any resulting libinput events are available from
+ * libinput_get_event() when this function returns.
+ *
+ * The events must use CLOCK_MONOTONIC timestamps and be grouped into
+ * frames by SYN_REPORT just like kernel events. Events for codes not
+ * enabled in the device description are ignored. Events for a device
+ * with events disabled, see libinput_device_config_send_events_set_mode(),
+ * are discarded.
+ *
+ * @param device A device added with libinput_memory_add_device()
+ * @param events The events to process
+ * @param nevents The number of events
+ *
+ * @return 0 on success or a negative errno on failure
+ * @retval -EINVAL The batch contains a SYN_DROPPED event
+ * @retval -ENODEV The device was removed
+ */
+int
+libinput_memory_device_inject(struct libinput_device *device,
+			      const struct input_event *events,
+			      size_t nevents);
+
+/**
+ * @ingroup base
+ *
+ * Remove a device added with libinput_memory_add_device(). It will not be
+ * re-created on libinput_resume().
+ *
+ * Events already processed from this device are kept in the queue, the
+ * @ref LIBINPUT_EVENT_DEVICE_REMOVED event marks the end of events for
+ * this device.
+ *
+ * @param device A device added with libinput_memory_add_device()
+ *
+ * @note It is an application bug to call this function on a libinput
+ * context not initialized with libinput_memory_create_context().
+ */
+void
+libinput_memory_remove_device(struct libinput_device *device);
+
+/**
+ * @ingroup base
+ *
+ * Drive the context's clock from the timestamps of the events passed to
+ * libinput_memory_device_inject() instead of CLOCK_MONOTONIC. This is
+ * for replaying recorded events: timeouts like the tap timeout expire
+ * in recorded time, before the first injected event after their expiry
+ * is processed, so the result is the same as for the events as they
+ * happened live, no matter how fast they are injected.
+ *
+ * With the event clock enabled, libinput_dispatch() does not run any
+ * timers, use libinput_memory_advance_clock() to let time pass without
+ * injecting events, e.g. at the end of a recording. The event clock
+ * starts at 0, anything that happens before the first injected event
+ * happens at time 0.
+ *
+ * @param libinput A libinput context initialized with
+ * libinput_memory_create_context()
+ * @param enable Non-zero to use the event clock, zero for CLOCK_MONOTONIC
+ *
+ * @return 0 on success or a negative errno on failure
+ */
+int
+libinput_memory_set_event_clock(struct libinput *libinput, int enable);
+
+/**
+ * @ingroup base
+ *
+ * Move the event clock forward, running the timers that expire until
+ * then. Times earlier than the current event clock are ignored.
+ *
+ * @param libinput A libinput context with the event clock enabled, see
+ * libinput_memory_set_event_clock()
+ * @param time The new time in microseconds, on the clock of the injected
+ * events
+ *
+ * @return 0 on success or a negative errno on failure
+ * @retval -EINVAL The event clock is not enabled
+ */
+int
+libinput_memory_advance_clock(struct libinput *libinput, uint64_t time);
+
 /**
  * @ingroup base
  *
@@ -1033,6 +1313,154 @@ libinput_get_fd(struct libinput *libinput);
 int
 libinput_dispatch(struct libinput *libinput);
 
+/**
+ * @ingroup base
+ *
+ * Hold back wakeups until the given time. Until then, the fd returned by
+ * libinput_get_fd() does not become readable because of device events,
+ * timeouts or hotplugging. At the deadline it becomes readable once and
+ * libinput_dispatch() processes everything that accumulated in the
+ * meantime in one go. After that, or when libinput_dispatch() is called
+ * at or after the deadline, libinput goes back to waking the caller
+ * whenever there is something to do.
+ *
+ * This is intended for callers that only present input once per frame,
+ * e.g. a compositor passes the time it starts to prepare its next frame
+ * after each repaint. A high-rate device then costs one wakeup per frame
+ * rather than one per device event. A caller that is idle should not set
+ * a deadline, so it is woken up by the first event.
+ *
+ * Calling libinput_dispatch() before the deadline is fine and processes
+ * all pending events as usual, the deadline stays in place.
+ *
+ * @param libinput A previously initialized libinput context
+ * @param deadline The time in microseconds, in CLOCK_MONOTONIC, or 0 to
+ * stop holding back wakeups
+ *
+ * @return 0 on success, or a negative errno on failure
+ */
+int
+libinput_set_dispatch_deadline(struct libinput *libinput,
+			       uint64_t deadline);
+
+/**
+ * @ingroup base
+ *
+ * Restrict the events libinput generates to the given types. Events of
+ * any other type are discarded where they would be generated, and
+ * processing that only serves to generate them, e.g. pointer
+ * acceleration for motion events or the scroll threshold for axis
+ * events, is skipped where possible. Device added and removed events are
+ * always generated.
+ *
+ * This is intended for callers that only ever handle a subset of events,
+ * e.g. a keyboard-only kiosk. Device state such as the seat key and
+ * button counts is kept up to date regardless, so events can be
+ * re-enabled at any time. Events that were discarded are not generated
+ * retroactively.
+ *
+ * Event types masked off are not delivered to a sink registered with
+ * libinput_set_event_sink() either.
+ *
+ * @param libinput A previously initialized libinput context
+ * @param types The event types to generate
+ * @param ntypes The number of elements in types
+ *
+ * @return 0 on success or -EINVAL if types contains an invalid event type.
+ * Passing NULL for types enables all event types, this is the default.
+ */
+int
+libinput_set_event_mask(struct libinput *libinput,
+			const enum libinput_event_type *types,
+			size_t ntypes);
+
+/**
+ * @ingroup base
+ *
+ * Receive an event synchronously while libinput processes it, see
+ * libinput_set_event_sink().
+ *
+ * The event is only valid for the duration of the callback. It must not
+ * be passed to libinput_event_destroy() and libinput does not hold a
+ * reference to its device; libinput_event_get_device() returns a device
+ * that is valid during the callback but must be referenced with
+ * libinput_device_ref() to be kept around.
+ *
+ * @param event The event
+ * @param data The data passed to libinput_set_event_sink()
+ */
+typedef void (*libinput_event_sink_func)(struct libinput_event *event,
+					 void *data);
+
+/**
+ * @ingroup base
+ *
+ * Deliver all events of the given type directly to a callback instead of
+ * the event queue. The callback is invoked from within
+ * libinput_dispatch() (or whichever libinput call generated the event)
+ * at the point the event is generated, the event is never queued and
+ * libinput_get_event() does not return events of this type while the
+ * sink is set. Events of other types are queued as usual.
+ *
+ * This avoids allocating each event and is intended for callers that
+ * translate events right away, e.g. to forward them to another process.
+ *
+ * The callback must not call libinput_dispatch() or destroy the context.
+ *
+ * Only keyboard, pointer and touch events can be delivered this way,
+ * device added and removed events are always queued.
+ *
+ * @param libinput A previously initialized libinput context
+ * @param type The event type to deliver to the sink
+ * @param sink The callback or NULL to queue events of this type again
+ * @param data Passed to the callback as-is
+ *
+ * @return 0 on success or -EINVAL if the event type cannot be delivered
+ * to a sink
+ */
+int
+libinput_set_event_sink(struct libinput *libinput,
+			enum libinput_event_type type,
+			libinput_event_sink_func sink,
+			void *data);
+
+/**
+ * @ingroup base
+ *
+ * Allow events to be handed to other threads. By default, a libinput
+ * context and everything obtained from it must only be used from one
+ * thread at a time. With thread-safe events enabled, the following
+ * functions may additionally be called from any thread for events
+ * returned by libinput_get_event(), concurrently with the thread that
+ * uses the context:
+ * - libinput_event_destroy()
+ * - libinput_event_get_type(), libinput_event_get_context(),
+ *   libinput_event_get_device() and the libinput_event_get_*_event()
+ *   conversion functions
+ * - all libinput_event_keyboard_*, libinput_event_pointer_* and
+ *   libinput_event_touch_* getters
+ * - libinput_device_ref(), libinput_device_unref(), libinput_seat_ref()
+ *   and libinput_seat_unref()
+ *
+ * An event is not safe to use from two threads at the same time, it
+ * must be handed over. Devices and seats whose last reference is dropped
+ * are destroyed from within libinput_dispatch() rather than right away,
+ * so dropping a reference or destroying an event never touches the
+ * context.
+ *
+ * This must be enabled before the first event is passed to another
+ * thread and must not be disabled while any event is still in use on
+ * another thread. All events must be destroyed before the context is
+ * destroyed with libinput_unref().
+ *
+ * @param libinput A previously initialized libinput context
+ * @param enable Non-zero to enable thread-safe events, zero to disable
+ *
+ * @return 0 on success or a negative errno on failure
+ */
+int
+libinput_set_thread_safe_events(struct libinput *libinput, int enable);
+
 /**
  * @ingroup base
  *
@@ -1061,6 +1489,36 @@ libinput_get_event(struct libinput *libinput);
 enum libinput_event_type
 libinput_next_event_type(struct libinput *libinput);
 
+/**
+ * @ingroup base
+ *
+ * Retrieve all events of the next frame from libinput's internal event
+ * queue. The first event in the queue and all following events with the
+ * same device and frame sequence number (see
+ * libinput_event_get_frame_sequence()) are removed from the queue and
+ * stored in events, in the order libinput_get_event() would return them.
+ *
+ * If the frame has more than size events, the remainder is returned by
+ * the next call to libinput_get_frame(). The same happens if an event of
+ * another device was posted in the middle of the frame, e.g. a trackpoint
+ * button event generated by a touchpad's software buttons: the call
+ * stops before that event, the next one returns it as a frame of its
+ * own and the call after that returns the rest of the interrupted frame.
+ *
+ * After handling the retrieved events, the caller must destroy each of
+ * them using libinput_event_destroy().
+ *
+ * @param libinput A previously initialized libinput context
+ * @param events An array to be filled with the frame's events
+ * @param size The number of elements in events
+ * @return The number of events stored in events, or 0 if no event is
+ * available
+ */
+size_t
+libinput_get_frame(struct libinput *libinput,
+		   struct libinput_event **events,
+		   size_t size);
+
 /**
  * @ingroup base
  *
@@ -1206,6 +1664,68 @@ void
 libinput_log_set_handler(struct libinput *libinput,
 			 libinput_log_handler log_handler);
 
+/**
+ * @ingroup base
+ *
+ * The subsystems libinput accounts its heap allocations to, see
+ * libinput_get_memory_stats().
+ */
+enum libinput_memory_tag {
+	/** Events, the event queue and the bookkeeping for their lifetime */
+	LIBINPUT_MEMORY_TAG_EVENT = 0,
+	/** File descriptor sources and the event loop */
+	LIBINPUT_MEMORY_TAG_SOURCE,
+	/** Devices, their dispatch and pending device opens */
+	LIBINPUT_MEMORY_TAG_DEVICE,
+	/** Touchpad state */
+	LIBINPUT_MEMORY_TAG_TOUCHPAD,
+	/** Pointer acceleration filters */
+	LIBINPUT_MEMORY_TAG_FILTER,
+	/** Seats and their names */
+	LIBINPUT_MEMORY_TAG_SEAT,
+	/** The libinput contexts themselves */
+	LIBINPUT_MEMORY_TAG_CONTEXT,
+};
+
+/**
+ * @ingroup base
+ *
+ * Heap usage of one subsystem, see libinput_get_memory_stats().
+ */
+struct libinput_memory_stats {
+	/** Bytes currently allocated */
+	uint64_t live_bytes;
+	/** The highest value live_bytes has had */
+	uint64_t peak_bytes;
+	/** Number of allocations, a reallocation counts as one */
+	uint64_t allocations;
+	/** Allocations per second since the previous call to
+	 * libinput_get_memory_stats() for this tag, or since the first
+	 * allocation if there was no previous call */
+	double allocations_per_second;
+};
+
+/**
+ * @ingroup base
+ *
+ * Get the heap usage of one subsystem. The numbers cover all libinput
+ * contexts in the process and are only collected if libinput was built
+ * with --enable-memory-stats, byte counts include the allocator's
+ * rounding.
+ *
+ * This is intended for tests and profiling, e.g. to check that a code
+ * path does not allocate.
+ *
+ * @param tag The subsystem
+ * @param stats Set to the subsystem's heap usage on success
+ *
+ * @return 0 on success, -EINVAL if tag is invalid or -ENOSYS if libinput
+ * was built without memory statistics
+ */
+int
+libinput_get_memory_stats(enum libinput_memory_tag tag,
+			  struct libinput_memory_stats *stats);
+
 /**
  * @defgroup seat Initialization and manipulation of seats
  *
@@ -1311,6 +1831,82 @@ libinput_seat_get_physical_name(struct libinput_seat *seat);
 const char *
 libinput_seat_get_logical_name(struct libinput_seat *seat);
 
+/**
+ * @ingroup seat
+ *
+ * A snapshot of the pointer state of a seat, see
+ * libinput_pointer_state_page_read().
+ */
+struct libinput_pointer_state {
+	/** Sum of all relative motion of the seat, as in
+	 * libinput_event_pointer_get_dx() and libinput_event_pointer_get_dy() */
+	double x, y;
+	/** Bit n is set while BTN_LEFT + n is down on any device of the seat */
+	uint32_t buttons;
+	/** Time of the last update, as in libinput_event_pointer_get_time() */
+	uint32_t time;
+};
+
+/**
+ * @ingroup seat
+ * @struct libinput_pointer_state_page
+ *
+ * Shared memory that always holds the newest pointer state of a seat.
+ */
+struct libinput_pointer_state_page;
+
+/**
+ * @ingroup seat
+ *
+ * Have libinput keep the newest pointer state of this seat in a shared
+ * memory page. The page is updated as soon as libinput processes a
+ * relative motion or a button event, before the event is added to the
+ * event queue, and can be read with libinput_pointer_state_page_read()
+ * from any thread without locking. The state starts at zero when the page
+ * is first requested.
+ *
+ * The page stays valid until the seat is destroyed, callers that read it
+ * from another thread should keep a reference to the seat.
+ *
+ * @param seat A previously obtained seat
+ * @return the seat's pointer state page or NULL on failure
+ */
+const struct libinput_pointer_state_page *
+libinput_seat_get_pointer_state_page(struct libinput_seat *seat);
+
+/**
+ * @ingroup seat
+ *
+ * Return a file descriptor for the seat's pointer state page, for use in
+ * another process. The other process maps it with mmap(2), read-only and
+ * with the size of the file, and reads it with
+ * libinput_pointer_state_page_read(). The fd belongs to libinput and must
+ * not be closed, pass a dup(2) to the other process.
+ *
+ * This enables the pointer state page like
+ * libinput_seat_get_pointer_state_page().
+ *
+ * @param seat A previously obtained seat
+ * @return a file descriptor or a negative errno, -ENOSYS if the system
+ * can't share the page with other processes
+ */
+int
+libinput_seat_get_pointer_state_fd(struct libinput_seat *seat);
+
+/**
+ * @ingroup seat
+ *
+ * Take a consistent snapshot of a pointer state page. This function does
+ * not take any locks and may be called from any thread, but only
+ * returns once it got a snapshot that wasn't written to concurrently.
+ *
+ * @param page A pointer state page
+ * @param state Set to the current pointer state
+ */
+void
+libinput_pointer_state_page_read(const struct libinput_pointer_state_page *page,
+				 struct libinput_pointer_state *state);
+
 /**
  * @defgroup device Initialization and manipulation of input devices
  */
@@ -1337,6 +1933,12 @@ libinput_device_ref(struct libinput_device *device);
  * device was removed from the system. A caller must ensure to reference
  * the device correctly to avoid dangling pointers.
  *
+ * Events do not count towards the refcount, but libinput keeps a
+ * reference to a removed device until all events generated before the
+ * removal have been destroyed. libinput_event_get_device() is thus valid
+ * for the lifetime of the event, and the device may be referenced and
+ * unreferenced through it.
+ *
  * @param device A previously obtained device
  * @return NULL if device was destroyed, otherwise the passed device
  */
@@ -0,0 +1,418 @@
+/*
+ * Copyright © 2015 Red Hat, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "memory.h"
+#include "evdev.h"
+
+static const char default_seat[] = "seat0";
+static const char default_seat_name[] = "default";
+
+static void
+memory_seat_destroy(struct libinput_seat *seat)
+{
+	struct memory_seat *mseat = (struct memory_seat*)seat;
+	free_tag(LIBINPUT_MEMORY_TAG_SEAT, mseat);
+}
+
+static struct memory_seat*
+memory_seat_create(struct memory_input *input,
+		   const char *seat_name,
+		   const char *seat_logical_name)
+{
+	struct memory_seat *seat;
+
+	seat = zalloc_tag(LIBINPUT_MEMORY_TAG_SEAT, sizeof(*seat));
+	if (!seat)
+		return NULL;
+
+	libinput_seat_init(&seat->base, &input->base, seat_name,
+			   seat_logical_name, memory_seat_destroy);
+
+	return seat;
+}
+
+static struct memory_seat*
+memory_seat_get_named(struct memory_input *input,
+		      const char *seat_name_physical,
+		      const char *seat_name_logical)
+{
+	struct memory_seat *seat;
+
+	/* don't hand out a seat that is about to be destroyed */
+	libinput_destroy_retired(&input->base);
+
+	list_for_each(seat, &input->base.seat_list, base.link) {
+		if (strcmp(seat->base.physical_name, seat_name_physical) == 0 &&
+		    strcmp(seat->base.logical_name, seat_name_logical) == 0)
+			return seat;
+	}
+
+	return NULL;
+}
+
+/* libevdev can't duplicate a context, so copy everything the device
+ * setup looks at: name, ids, properties and the enabled codes */
+static struct libevdev *
+memory_evdev_copy(const struct libevdev *template)
+{
+	struct libevdev *evdev;
+	const void *data;
+	unsigned int type, code;
+	int max, value;
+
+	evdev = libevdev_new();
+	if (!evdev)
+		return NULL;
+
+	libevdev_set_name(evdev, libevdev_get_name(template));
+	libevdev_set_id_bustype(evdev, libevdev_get_id_bustype(template));
+	libevdev_set_id_vendor(evdev, libevdev_get_id_vendor(template));
+	libevdev_set_id_product(evdev, libevdev_get_id_product(template));
+	libevdev_set_id_version(evdev, libevdev_get_id_version(template));
+
+	for (code = 0; code <= INPUT_PROP_MAX; code++) {
+		if (libevdev_has_property(template, code) &&
+		    libevdev_enable_property(evdev, code) != 0)
+			goto err;
+	}
+
+	for (type = 0; type <= EV_MAX; type++) {
+		if (!libevdev_has_event_type(template, type))
+			continue;
+
+		if (libevdev_enable_event_type(evdev, type) != 0)
+			goto err;
+
+		max = libevdev_event_type_get_max(type);
+		for (code = 0; max != -1 && code <= (unsigned int)max; code++) {
+			if (!libevdev_has_event_code(template, type, code))
+				continue;
+
+			data = NULL;
+			if (type == EV_ABS) {
+				data = libevdev_get_abs_info(template, code);
+			} else if (type == EV_REP) {
+				value = libevdev_get_event_value(template,
+								 type,
+								 code);
+				data = &value;
+			}
+
+			if (libevdev_enable_event_code(evdev,
+						       type,
+						       code,
+						       data) != 0)
+				goto err;
+		}
+	}
+
+	return evdev;
+
+err:
+	libevdev_free(evdev);
+	return NULL;
+}
+
+static struct evdev_device *
+memory_device_enable(struct memory_input *input,
+		     struct memory_device *dev,
+		     const char *seat_logical_name)
+{
+	struct memory_seat *seat;
+	struct evdev_device *device;
+	struct libevdev *evdev;
+	char sysname[32];
+
+	snprintf(sysname, sizeof(sysname), "virtual%u", dev->id);
+
+	if (!seat_logical_name)
+		seat_logical_name = default_seat_name;
+
+	seat = memory_seat_get_named(input, default_seat, seat_logical_name);
+	if (seat) {
+		libinput_seat_ref(&seat->base);
+	} else {
+		seat = memory_seat_create(input,
+					  default_seat,
+					  seat_logical_name);
+		if (!seat) {
+			log_info(&input->base,
+				 "failed to create seat for device '%s'.\n",
+				 sysname);
+			return NULL;
+		}
+	}
+
+	evdev = memory_evdev_copy(dev->evdev);
+	if (!evdev) {
+		libinput_seat_unref(&seat->base);
+		return NULL;
+	}
+
+	device = evdev_device_create_virtual(&seat->base, sysname, evdev);
+	libinput_seat_unref(&seat->base);
+
+	if (device == EVDEV_UNHANDLED_DEVICE) {
+		log_info(&input->base,
+			 "not using input device '%s'.\n",
+			 sysname);
+		device = NULL;
+	} else if (device == NULL) {
+		log_info(&input->base,
+			 "failed to create input device '%s'.\n",
+			 sysname);
+	}
+
+	dev->device = device;
+
+	return device;
+}
+
+static void
+memory_device_disable(struct memory_device *dev)
+{
+	struct libinput_seat *seat;
+
+	if (!dev->device)
+		return;
+
+	seat = dev->device->base.seat;
+	libinput_seat_ref(seat);
+	evdev_device_remove(dev->device);
+	libinput_seat_unref(seat);
+
+	dev->device = NULL;
+}
+
+static void
+memory_device_destroy(struct memory_device *dev)
+{
+	list_remove(&dev->link);
+	libevdev_free(dev->evdev);
+	free_tag(LIBINPUT_MEMORY_TAG_DEVICE, dev);
+}
+
+static struct memory_device *
+memory_device_find(struct memory_input *input,
+		   struct libinput_device *device)
+{
+	struct memory_device *dev;
+
+	list_for_each(dev, &input->device_list, link) {
+		if (dev->device && &dev->device->base == device)
+			return dev;
+	}
+
+	return NULL;
+}
+
+static void
+memory_input_disable(struct libinput *libinput)
+{
+	struct memory_input *input = (struct memory_input*)libinput;
+	struct memory_device *dev;
+
+	list_for_each(dev, &input->device_list, link)
+		memory_device_disable(dev);
+}
+
+static int
+memory_input_enable(struct libinput *libinput)
+{
+	struct memory_input *input = (struct memory_input*)libinput;
+	struct memory_device *dev;
+
+	list_for_each(dev, &input->device_list, link) {
+		if (dev->device)
+			continue;
+
+		if (memory_device_enable(input, dev, NULL) == NULL) {
+			memory_input_disable(libinput);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void
+memory_input_destroy(struct libinput *libinput)
+{
+	struct memory_input *input = (struct memory_input*)libinput;
+	struct memory_device *dev, *tmp;
+
+	list_for_each_safe(dev, tmp, &input->device_list, link)
+		memory_device_destroy(dev);
+}
+
+static int
+memory_device_change_seat(struct libinput_device *device,
+			  const char *seat_name)
+{
+	struct memory_input *input = (struct memory_input*)device->seat->libinput;
+	struct memory_device *dev;
+
+	dev = memory_device_find(input, device);
+	if (!dev)
+		return -1;
+
+	memory_device_disable(dev);
+
+	return memory_device_enable(input, dev, seat_name) ? 0 : -1;
+}
+
+static const struct libinput_interface_backend interface_backend = {
+	.resume = memory_input_enable,
+	.suspend = memory_input_disable,
+	.destroy = memory_input_destroy,
+	.device_change_seat = memory_device_change_seat,
+};
+
+LIBINPUT_EXPORT struct libinput *
+libinput_memory_create_context(const struct libinput_interface *interface,
+			       void *user_data)
+{
+	struct memory_input *input;
+
+	if (!interface)
+		return NULL;
+
+	input = zalloc_tag(LIBINPUT_MEMORY_TAG_CONTEXT, sizeof *input);
+	if (!input ||
+	    libinput_init(&input->base, interface,
+			  &interface_backend, user_data) != 0) {
+		free_tag(LIBINPUT_MEMORY_TAG_CONTEXT, input);
+		return NULL;
+	}
+
+	list_init(&input->device_list);
+
+	return &input->base;
+}
+
+LIBINPUT_EXPORT struct libinput_device *
+libinput_memory_add_device(struct libinput *libinput,
+			   const struct libevdev *description)
+{
+	struct memory_input *input = (struct memory_input*)libinput;
+	struct memory_device *dev;
+	struct evdev_device *device;
+
+	if (libinput->interface_backend != &interface_backend) {
+		log_bug_client(libinput, "Mismatching backends.\n");
+		return NULL;
+	}
+
+	dev = zalloc_tag(LIBINPUT_MEMORY_TAG_DEVICE, sizeof *dev);
+	if (!dev)
+		return NULL;
+
+	dev->evdev = memory_evdev_copy(description);
+	if (!dev->evdev) {
+		free_tag(LIBINPUT_MEMORY_TAG_DEVICE, dev);
+		return NULL;
+	}
+
+	dev->id = input->next_id++;
+	list_insert(&input->device_list, &dev->link);
+
+	device = memory_device_enable(input, dev, NULL);
+	if (!device) {
+		memory_device_destroy(dev);
+		return NULL;
+	}
+
+	return &device->base;
+}
+
+LIBINPUT_EXPORT int
+libinput_memory_device_inject(struct libinput_device *device,
+			      const struct input_event *events,
+			      size_t nevents)
+{
+	struct libinput *libinput = device->seat->libinput;
+
+	if (libinput->interface_backend != &interface_backend) {
+		log_bug_client(libinput, "Mismatching backends.\n");
+		return -EINVAL;
+	}
+
+	return evdev_device_inject((struct evdev_device*)device,
+				   events,
+				   nevents);
+}
+
+LIBINPUT_EXPORT int
+libinput_memory_set_event_clock(struct libinput *libinput, int enable)
+{
+	if (libinput->interface_backend != &interface_backend) {
+		log_bug_client(libinput, "Mismatching backends.\n");
+		return -EINVAL;
+	}
+
+	libinput->timer.event_clock = !!enable;
+	libinput->timer.now = 0;
+
+	return 0;
+}
+
+LIBINPUT_EXPORT int
+libinput_memory_advance_clock(struct libinput *libinput, uint64_t time)
+{
+	if (libinput->interface_backend != &interface_backend) {
+		log_bug_client(libinput, "Mismatching backends.\n");
+		return -EINVAL;
+	}
+
+	if (!libinput->timer.event_clock)
+		return -EINVAL;
+
+	libinput_timer_advance(libinput, time / 1000);
+
+	return 0;
+}
+
+LIBINPUT_EXPORT void
+libinput_memory_remove_device(struct libinput_device *device)
+{
+	struct libinput *libinput = device->seat->libinput;
+	struct memory_input *input = (struct memory_input*)libinput;
+	struct memory_device *dev;
+
+	if (libinput->interface_backend != &interface_backend) {
+		log_bug_client(libinput, "Mismatching backends.\n");
+		return;
+	}
+
+	dev = memory_device_find(input, device);
+	if (!dev)
+		return;
+
+	memory_device_disable(dev);
+	memory_device_destroy(dev);
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright © 2015 Red Hat, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _MEMORY_H_
+#define _MEMORY_H_
+
+#include "config.h"
+
+#include <libevdev/libevdev.h>
+#include "libinput-private.h"
+
+struct memory_input {
+	struct libinput base;
+	struct list device_list;
+	unsigned int next_id;
+};
+
+/* Survives suspend/resume, the evdev_device is re-created from the
+ * description on resume */
+struct memory_device {
+	struct list link;
+	struct libevdev *evdev; /* the description, never read from */
+	unsigned int id;
+	struct evdev_device *device; /* NULL while suspended */
+};
+
+struct memory_seat {
+	struct libinput_seat base;
+};
+
+#endif
@@ -73,7 +73,7 @@ static void
 path_seat_destroy(struct libinput_seat *seat)
 {
 	struct path_seat *pseat = (struct path_seat*)seat;
-	free(pseat);
+	free_tag(LIBINPUT_MEMORY_TAG_SEAT, pseat);
 }
 
 static struct path_seat*
@@ -83,7 +83,7 @@ path_seat_create(struct path_input *input,
 {
 	struct path_seat *seat;
 
-	seat = zalloc(sizeof(*seat));
+	seat = zalloc_tag(LIBINPUT_MEMORY_TAG_SEAT, sizeof(*seat));
 	if (!seat)
 		return NULL;
 
@@ -100,6 +100,9 @@ path_seat_get_named(struct path_input *input,
 {
 	struct path_seat *seat;
 
+	/* don't hand out a seat that is about to be destroyed */
+	libinput_destroy_retired(&input->base);
+
 	list_for_each(seat, &input->base.seat_list, base.link) {
 		if (strcmp(seat->base.physical_name, seat_name_physical) == 0 &&
 		    strcmp(seat->base.logical_name, seat_name_logical) == 0)
@@ -109,10 +112,14 @@ path_seat_get_named(struct path_input *input,
 	return NULL;
 }
 
+/* Takes ownership of fd, which may be a negative errno if opening the
+ * device failed, and of evdev, see evdev_device_create_from_fd() */
 static struct libinput_device *
-path_device_enable(struct path_input *input,
-		   struct udev_device *udev_device,
-		   const char *seat_logical_name_override)
+path_device_enable_with_fd(struct path_input *input,
+			   struct udev_device *udev_device,
+			   const char *seat_logical_name_override,
+			   int fd,
+			   struct libevdev *evdev)
 {
 	struct path_seat *seat;
 	struct evdev_device *device = NULL;
@@ -123,19 +130,25 @@ path_device_enable(struct path_input *input,
 	devnode = udev_device_get_devnode(udev_device);
 
 	seat_prop = udev_device_get_property_value(udev_device, "ID_SEAT");
-	seat_name = strdup(seat_prop ? seat_prop : default_seat);
+	seat_name = strdup_tag(LIBINPUT_MEMORY_TAG_SEAT,
+			       seat_prop ? seat_prop : default_seat);
 
 	if (seat_logical_name_override) {
-		seat_logical_name = strdup(seat_logical_name_override);
+		seat_logical_name = strdup_tag(LIBINPUT_MEMORY_TAG_SEAT,
+					       seat_logical_name_override);
 	} else {
 		seat_prop = udev_device_get_property_value(udev_device, "WL_SEAT");
-		seat_logical_name = strdup(seat_prop ? seat_prop : default_seat_name);
+		seat_logical_name = strdup_tag(LIBINPUT_MEMORY_TAG_SEAT,
+					       seat_prop ? seat_prop : default_seat_name);
 	}
 
 	if (!seat_logical_name) {
 		log_error(&input->base,
 			  "failed to create seat name for device '%s'.\n",
 			  devnode);
+		if (fd >= 0)
+			close_restricted(&input->base, fd);
+		libevdev_free(evdev);
 		goto out;
 	}
 
@@ -149,11 +162,15 @@ path_device_enable(struct path_input *input,
 			log_info(&input->base,
 				 "failed to create seat for device '%s'.\n",
 				 devnode);
+			if (fd >= 0)
+				close_restricted(&input->base, fd);
+			libevdev_free(evdev);
 			goto out;
 		}
 	}
 
-	device = evdev_device_create(&seat->base, udev_device);
+	device = evdev_device_create_from_fd(&seat->base, udev_device,
+					     fd, evdev);
 	libinput_seat_unref(&seat->base);
 
 	if (device == EVDEV_UNHANDLED_DEVICE) {
@@ -170,26 +187,96 @@ path_device_enable(struct path_input *input,
 	}
 
 out:
-	free(seat_name);
-	free(seat_logical_name);
+	free_tag(LIBINPUT_MEMORY_TAG_SEAT, seat_name);
+	free_tag(LIBINPUT_MEMORY_TAG_SEAT, seat_logical_name);
 
 	return device ? &device->base : NULL;
 }
 
+static struct libinput_device *
+path_device_enable(struct path_input *input,
+		   struct udev_device *udev_device,
+		   const char *seat_logical_name_override)
+{
+	int fd;
+
+	fd = evdev_device_open(&input->base, udev_device);
+
+	return path_device_enable_with_fd(input,
+					  udev_device,
+					  seat_logical_name_override,
+					  fd,
+					  NULL);
+}
+
 static int
-path_input_enable(struct libinput *libinput)
+path_input_devices_opened(struct libinput *libinput,
+			  struct udev_device **udev_devices,
+			  int *fds,
+			  struct libevdev **evdevs,
+			  size_t count,
+			  void *data)
 {
 	struct path_input *input = (struct path_input*)libinput;
-	struct path_device *dev;
-
-	list_for_each(dev, &input->path_list, link) {
-		if (path_device_enable(input, dev->udev_device, NULL) == NULL) {
-			path_input_disable(libinput);
-			return -1;
+	struct libevdev *evdev;
+	size_t i;
+	int rc = 0;
+
+	for (i = 0; i < count; i++) {
+		evdev = evdevs ? evdevs[i] : NULL;
+
+		if (rc == 0) {
+			if (path_device_enable_with_fd(input, udev_devices[i],
+						       NULL, fds[i],
+						       evdev) == NULL)
+				rc = -1;
+		} else {
+			if (fds[i] >= 0)
+				close_restricted(libinput, fds[i]);
+			libevdev_free(evdev);
 		}
 	}
 
-	return 0;
+	if (rc != 0)
+		path_input_disable(libinput);
+
+	return rc;
+}
+
+static int
+path_input_enable(struct libinput *libinput)
+{
+	struct path_input *input = (struct path_input*)libinput;
+	struct path_device *dev;
+	struct udev_device **devices;
+	size_t ndevices = 0, i;
+	int rc;
+
+	list_for_each(dev, &input->path_list, link)
+		ndevices++;
+
+	if (ndevices == 0)
+		return 0;
+
+	devices = zalloc_tag(LIBINPUT_MEMORY_TAG_DEVICE,
+			     ndevices * sizeof(*devices));
+	if (!devices)
+		return -1;
+
+	i = 0;
+	list_for_each(dev, &input->path_list, link)
+		devices[i++] = dev->udev_device;
+
+	/* Open all device nodes before setting up any device, see
+	 * udev_input_add_devices() */
+	rc = evdev_device_open_many(libinput,
+				    devices,
+				    ndevices,
+				    path_input_devices_opened,
+				    NULL);
+	free_tag(LIBINPUT_MEMORY_TAG_DEVICE, devices);
+
+	return rc;
 }
 
 static void
@@ -202,7 +289,7 @@ path_input_destroy(struct libinput *input)
 
 	list_for_each_safe(dev, tmp, &path_input->path_list, link) {
 		udev_device_unref(dev->udev_device);
-		free(dev);
+		free_tag(LIBINPUT_MEMORY_TAG_DEVICE, dev);
 	}
 
 }
@@ -216,7 +303,7 @@ path_create_device(struct libinput *libinput,
 	struct path_device *dev;
 	struct libinput_device *device;
 
-	dev = zalloc(sizeof *dev);
+	dev = zalloc_tag(LIBINPUT_MEMORY_TAG_DEVICE, sizeof *dev);
 	if (!dev)
 		return NULL;
 
@@ -229,7 +316,7 @@ path_create_device(struct libinput *libinput,
 	if (!device) {
 		udev_device_unref(dev->udev_device);
 		list_remove(&dev->link);
-		free(dev);
+		free_tag(LIBINPUT_MEMORY_TAG_DEVICE, dev);
 	}
 
 	return device;
@@ -275,12 +362,12 @@ libinput_path_create_context(const struct libinput_interface *interface,
 	if (!udev)
 		return NULL;
 
-	input = zalloc(sizeof *input);
+	input = zalloc_tag(LIBINPUT_MEMORY_TAG_CONTEXT, sizeof *input);
 	if (!input ||
 	    libinput_init(&input->base, interface,
 			  &interface_backend, user_data) != 0) {
 		udev_unref(udev);
-		free(input);
+		free_tag(LIBINPUT_MEMORY_TAG_CONTEXT, input);
 		return NULL;
 	}
 
@@ -344,7 +431,7 @@ libinput_path_remove_device(struct libinput_device *device)
 		if (dev->udev_device == evdev->udev_device) {
 			list_remove(&dev->link);
 			udev_device_unref(dev->udev_device);
-			free(dev);
+			free_tag(LIBINPUT_MEMORY_TAG_DEVICE, dev);
 			break;
 		}
 	}
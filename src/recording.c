@@ -0,0 +1,782 @@
+/*
+ * Copyright © 2015 Red Hat, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "libinput-util.h"
+#include "recording.h"
+
+#define RECORDING_TAG_KEYFRAME 0xff
+#define RECORDING_TAG_SAME_TIME 0x80
+#define RECORDING_TAG_TYPE_MASK 0x3f
+
+#define RECORDING_BUFFER_SIZE 65536
+/* a varint is at most 10 bytes, plus the tag */
+#define RECORDING_MAX_EVENT_SIZE 31
+
+#define ALIGN8(x) (((x) + 7) & ~(uint64_t)7)
+
+static inline uint64_t
+zigzag_encode(int64_t v)
+{
+	return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t
+zigzag_decode(uint64_t v)
+{
+	return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static inline size_t
+varint_encode(uint8_t *buf, uint64_t v)
+{
+	size_t n = 0;
+
+	while (v >= 0x80) {
+		buf[n++] = (v & 0x7f) | 0x80;
+		v >>= 7;
+	}
+	buf[n++] = v;
+
+	return n;
+}
+
+static inline bool
+varint_decode(const uint8_t *buf, size_t size, size_t *offset, uint64_t *v)
+{
+	unsigned int shift = 0;
+	uint64_t result = 0;
+	uint8_t byte;
+
+	do {
+		if (*offset >= size || shift > 63)
+			return false;
+
+		byte = buf[(*offset)++];
+		result |= (uint64_t)(byte & 0x7f) << shift;
+		shift += 7;
+	} while (byte & 0x80);
+
+	*v = result;
+
+	return true;
+}
+
+static inline uint64_t
+input_event_time(const struct input_event *ev)
+{
+	return ev->time.tv_sec * 1000000ULL + ev->time.tv_usec;
+}
+
+/* The value EV_ABS deltas are calculated against, NULL if the value is
+ * stored as-is */
+static int32_t *
+recording_state_abs_value(struct recording_state *state, unsigned int code)
+{
+	int slot;
+
+	if (code >= ABS_CNT)
+		return NULL;
+
+	if (code <= ABS_MT_SLOT)
+		return &state->abs[code];
+
+	slot = state->abs[ABS_MT_SLOT];
+	if (slot < 0 || slot >= RECORDING_MAX_SLOTS)
+		return NULL;
+
+	return &state->mt[slot][code - ABS_MT_SLOT];
+}
+
+static void
+recording_state_update(struct recording_state *state,
+		       unsigned int type,
+		       unsigned int code,
+		       int32_t value)
+{
+	int32_t *v;
+
+	switch (type) {
+	case EV_KEY:
+		if (code < KEY_CNT)
+			state->keys[code] = value;
+		break;
+	case EV_SW:
+		if (code < SW_CNT)
+			state->sw[code] = value;
+		break;
+	case EV_ABS:
+		v = recording_state_abs_value(state, code);
+		if (v)
+			*v = value;
+		break;
+	}
+}
+
+static int
+recording_description_nslots(const struct recording_description *desc)
+{
+	if (!recording_description_has_code(desc, EV_ABS, ABS_MT_SLOT))
+		return 0;
+
+	return min(desc->abs[ABS_MT_SLOT].maximum + 1, RECORDING_MAX_SLOTS);
+}
+
+const char *
+recording_description_get_property(const struct recording_description *desc,
+				   const char *name)
+{
+	uint32_t i;
+
+	for (i = 0; i < desc->nproperties && i < RECORDING_MAX_PROPERTIES; i++) {
+		if (strcmp(desc->properties[i].name, name) == 0)
+			return desc->properties[i].value;
+	}
+
+	return NULL;
+}
+
+int
+recording_description_add_property(struct recording_description *desc,
+				   const char *name,
+				   const char *value)
+{
+	uint32_t i = desc->nproperties;
+
+	if (i >= RECORDING_MAX_PROPERTIES ||
+	    strlen(name) >= sizeof(desc->properties[i].name) ||
+	    strlen(value) >= sizeof(desc->properties[i].value))
+		return -EINVAL;
+
+	strcpy(desc->properties[i].name, name);
+	strcpy(desc->properties[i].value, value);
+	desc->nproperties++;
+
+	return 0;
+}
+
+struct recording_writer {
+	int fd;
+	int error;
+	struct recording_header header;
+	struct recording_description desc;
+	struct recording_state state;
+
+	uint64_t events_since_keyframe;
+	bool need_keyframe;
+
+	struct recording_index_entry *index;
+	size_t index_size;
+
+	uint8_t buffer[RECORDING_BUFFER_SIZE];
+	size_t buffer_used;
+
+	struct {
+		uint16_t type, code;
+		int32_t value;
+	} keyframe[KEY_CNT + SW_CNT + ABS_CNT +
+		   RECORDING_MAX_SLOTS * (ABS_CNT - ABS_MT_SLOT)];
+};
+
+static int
+write_all(int fd, const void *data, size_t size, off_t offset)
+{
+	const uint8_t *p = data;
+	ssize_t n;
+
+	while (size > 0) {
+		n = pwrite(fd, p, size, offset);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		p += n;
+		size -= n;
+		offset += n;
+	}
+
+	return 0;
+}
+
+static void
+recording_writer_flush(struct recording_writer *writer)
+{
+	int rc;
+
+	if (writer->buffer_used == 0 || writer->error)
+		return;
+
+	rc = write_all(writer->fd,
+		       writer->buffer,
+		       writer->buffer_used,
+		       writer->header.stream_offset +
+		       writer->header.stream_size);
+	if (rc < 0)
+		writer->error = rc;
+
+	writer->header.stream_size += writer->buffer_used;
+	writer->buffer_used = 0;
+}
+
+static inline uint8_t *
+recording_writer_reserve(struct recording_writer *writer)
+{
+	if (writer->buffer_used + RECORDING_MAX_EVENT_SIZE > sizeof(writer->buffer))
+		recording_writer_flush(writer);
+
+	return &writer->buffer[writer->buffer_used];
+}
+
+static inline uint64_t
+recording_writer_offset(struct recording_writer *writer)
+{
+	return writer->header.stream_size + writer->buffer_used;
+}
+
+static void
+recording_writer_put_absolute(struct recording_writer *writer,
+			      unsigned int type,
+			      unsigned int code,
+			      int32_t value)
+{
+	uint8_t *p = recording_writer_reserve(writer);
+	size_t n = 0;
+
+	p[n++] = type;
+	n += varint_encode(&p[n], code);
+	n += varint_encode(&p[n], zigzag_encode(value));
+	writer->buffer_used += n;
+}
+
+static void
+recording_writer_keyframe(struct recording_writer *writer, uint64_t time)
+{
+	struct recording_state *state = &writer->state;
+	struct recording_index_entry *entry;
+	size_t count = 0, i;
+	unsigned int code;
+	int slot, nslots;
+	uint8_t *p;
+	size_t n = 0;
+
+#define KEYFRAME_ADD(t_, c_, v_) do { \
+		writer->keyframe[count].type = (t_); \
+		writer->keyframe[count].code = (c_); \
+		writer->keyframe[count].value = (v_); \
+		count++; \
+	} while (0)
+
+	for (code = 0; code < KEY_CNT; code++) {
+		if (state->keys[code])
+			KEYFRAME_ADD(EV_KEY, code, state->keys[code]);
+	}
+	for (code = 0; code < SW_CNT; code++) {
+		if (state->sw[code])
+			KEYFRAME_ADD(EV_SW, code, state->sw[code]);
+	}
+	for (code = 0; code < ABS_MT_SLOT; code++) {
+		if (state->abs[code])
+			KEYFRAME_ADD(EV_ABS, code, state->abs[code]);
+	}
+
+	/* Tracking IDs are always written, 0 is a valid ID */
+	nslots = recording_description_nslots(&writer->desc);
+	for (slot = 0; slot < nslots; slot++) {
+		KEYFRAME_ADD(EV_ABS, ABS_MT_SLOT, slot);
+		for (code = ABS_MT_SLOT + 1; code < ABS_CNT; code++) {
+			int32_t value = state->mt[slot][code - ABS_MT_SLOT];
+
+			if (value || code == ABS_MT_TRACKING_ID)
+				KEYFRAME_ADD(EV_ABS, code, value);
+		}
+	}
+	if (nslots > 0)
+		KEYFRAME_ADD(EV_ABS, ABS_MT_SLOT, state->abs[ABS_MT_SLOT]);
+
+#undef KEYFRAME_ADD
+
+	if (writer->header.index_count == writer->index_size) {
+		size_t size = max(writer->index_size * 2, 64);
+
+		entry = realloc(writer->index, size * sizeof(*entry));
+		if (!entry) {
+			writer->error = -ENOMEM;
+			return;
+		}
+		writer->index = entry;
+		writer->index_size = size;
+	}
+
+	entry = &writer->index[writer->header.index_count++];
+	entry->time = time;
+	entry->offset = recording_writer_offset(writer);
+	entry->event = writer->header.nevents;
+
+	p = recording_writer_reserve(writer);
+	p[n++] = RECORDING_TAG_KEYFRAME;
+	n += varint_encode(&p[n], time);
+	n += varint_encode(&p[n], count);
+	writer->buffer_used += n;
+
+	/* the reader starts from a zeroed state at each keyframe, do the
+	 * same so any value not in the keyframe is 0 on both sides */
+	memset(state, 0, sizeof(*state));
+	state->time = time;
+
+	for (i = 0; i < count; i++) {
+		recording_writer_put_absolute(writer,
+					      writer->keyframe[i].type,
+					      writer->keyframe[i].code,
+					      writer->keyframe[i].value);
+		recording_state_update(state,
+				       writer->keyframe[i].type,
+				       writer->keyframe[i].code,
+				       writer->keyframe[i].value);
+	}
+
+	writer->events_since_keyframe = 0;
+	writer->need_keyframe = false;
+}
+
+struct recording_writer *
+recording_writer_new(int fd, const struct recording_description *desc)
+{
+	struct recording_writer *writer;
+	unsigned int code;
+	int slot;
+
+	writer = zalloc(sizeof(*writer));
+	if (!writer)
+		return NULL;
+
+	writer->fd = fd;
+	writer->desc = *desc;
+	writer->need_keyframe = true;
+
+	memcpy(writer->header.magic, RECORDING_MAGIC,
+	       sizeof(writer->header.magic));
+	writer->header.version = RECORDING_VERSION;
+	writer->header.byte_order = RECORDING_BYTE_ORDER;
+	writer->header.description_offset = sizeof(writer->header);
+	writer->header.stream_offset = ALIGN8(sizeof(writer->header) +
+					      sizeof(*desc));
+
+	/* Start from what the kernel reports, slots without a touch have
+	 * a tracking ID of -1 */
+	for (code = 0; code < ABS_MT_SLOT; code++)
+		writer->state.abs[code] = desc->abs[code].value;
+	for (slot = 0; slot < RECORDING_MAX_SLOTS; slot++)
+		writer->state.mt[slot][ABS_MT_TRACKING_ID - ABS_MT_SLOT] = -1;
+	if (recording_description_nslots(desc) > 0)
+		writer->state.abs[ABS_MT_SLOT] = desc->abs[ABS_MT_SLOT].value;
+
+	/* The header is rewritten with the final sizes on finish */
+	if (write_all(fd, &writer->header, sizeof(writer->header), 0) < 0 ||
+	    write_all(fd, desc, sizeof(*desc),
+		      writer->header.description_offset) < 0) {
+		free(writer);
+		return NULL;
+	}
+
+	return writer;
+}
+
+int
+recording_writer_add(struct recording_writer *writer,
+		     const struct input_event *ev)
+{
+	struct recording_state *state = &writer->state;
+	uint64_t time = input_event_time(ev);
+	int32_t value = ev->value;
+	int32_t *base;
+	uint8_t *p;
+	size_t n = 0;
+
+	if (writer->error)
+		return writer->error;
+
+	/* SYN_DROPPED can't be replayed, the events libevdev syncs up with
+	 * afterwards are recorded instead */
+	if (ev->type > EV_MAX ||
+	    (ev->type == EV_SYN && ev->code == SYN_DROPPED))
+		return -EINVAL;
+
+	if (writer->need_keyframe)
+		recording_writer_keyframe(writer, time);
+
+	if (ev->type == EV_ABS) {
+		base = recording_state_abs_value(state, ev->code);
+		/* wrap around instead of overflowing, the reader wraps
+		 * back the same way */
+		if (base)
+			value = (int32_t)((uint32_t)value - (uint32_t)*base);
+	}
+
+	p = recording_writer_reserve(writer);
+	if (time == state->time) {
+		p[n++] = ev->type | RECORDING_TAG_SAME_TIME;
+	} else {
+		p[n++] = ev->type;
+		n += varint_encode(&p[n],
+				   zigzag_encode((int64_t)(time - state->time)));
+	}
+	n += varint_encode(&p[n], ev->code);
+	n += varint_encode(&p[n], zigzag_encode(value));
+	writer->buffer_used += n;
+
+	state->time = time;
+	recording_state_update(state, ev->type, ev->code, ev->value);
+
+	writer->header.nevents++;
+	writer->events_since_keyframe++;
+
+	/* keyframes go on frame boundaries, seeking never ends up in the
+	 * middle of a frame */
+	if (ev->type == EV_SYN && ev->code == SYN_REPORT &&
+	    writer->events_since_keyframe >= RECORDING_KEYFRAME_INTERVAL)
+		writer->need_keyframe = true;
+
+	return writer->error;
+}
+
+int
+recording_writer_finish(struct recording_writer *writer)
+{
+	int rc;
+
+	recording_writer_flush(writer);
+
+	rc = writer->error;
+	if (rc == 0) {
+		writer->header.index_offset =
+			ALIGN8(writer->header.stream_offset +
+			       writer->header.stream_size);
+		rc = write_all(writer->fd,
+			       writer->index,
+			       writer->header.index_count * sizeof(*writer->index),
+			       writer->header.index_offset);
+	}
+	if (rc == 0)
+		rc = write_all(writer->fd,
+			       &writer->header,
+			       sizeof(writer->header),
+			       0);
+
+	free(writer->index);
+	free(writer);
+
+	return rc;
+}
+
+struct recording {
+	const uint8_t *data;
+	size_t size;
+	const struct recording_header *header;
+	const struct recording_description *desc;
+	const struct recording_index_entry *index;
+	const uint8_t *stream;
+};
+
+static bool
+recording_range_valid(const struct recording *recording,
+		      uint64_t offset,
+		      uint64_t size)
+{
+	return offset <= recording->size &&
+	       size <= recording->size - offset;
+}
+
+/* Every keyframe must be inside the stream */
+static bool
+recording_index_valid(const struct recording *recording)
+{
+	const struct recording_header *header = recording->header;
+	const struct recording_index_entry *index = recording->index;
+	uint64_t i;
+
+	for (i = 0; i < header->index_count; i++) {
+		if (index[i].offset >= header->stream_size)
+			return false;
+	}
+
+	return true;
+}
+
+/* The strings come straight from the file, they must be terminated
+ * inside their fields before anyone treats them as C strings */
+static bool
+recording_description_valid(const struct recording_description *desc)
+{
+	uint32_t i;
+
+	if (!memchr(desc->name, '\0', sizeof(desc->name)))
+		return false;
+
+	for (i = 0; i < desc->nproperties && i < RECORDING_MAX_PROPERTIES; i++) {
+		if (!memchr(desc->properties[i].name, '\0',
+			    sizeof(desc->properties[i].name)) ||
+		    !memchr(desc->properties[i].value, '\0',
+			    sizeof(desc->properties[i].value)))
+			return false;
+	}
+
+	return true;
+}
+
+struct recording *
+recording_open(const char *path)
+{
+	struct recording *recording;
+	const struct recording_header *header;
+	struct stat st;
+	void *data;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	if (fstat(fd, &st) < 0 ||
+	    (size_t)st.st_size < sizeof(*header)) {
+		close(fd);
+		return NULL;
+	}
+
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return NULL;
+
+	recording = zalloc(sizeof(*recording));
+	if (!recording) {
+		munmap(data, st.st_size);
+		return NULL;
+	}
+
+	recording->data = data;
+	recording->size = st.st_size;
+	recording->header = header = data;
+
+	if (memcmp(header->magic, RECORDING_MAGIC, sizeof(header->magic)) != 0 ||
+	    header->version != RECORDING_VERSION ||
+	    header->byte_order != RECORDING_BYTE_ORDER ||
+	    header->description_offset % 8 != 0 ||
+	    header->index_offset % 8 != 0 ||
+	    !recording_range_valid(recording,
+				   header->description_offset,
+				   sizeof(*recording->desc)) ||
+	    !recording_range_valid(recording,
+				   header->stream_offset,
+				   header->stream_size) ||
+	    header->index_count > recording->size / sizeof(*recording->index) ||
+	    !recording_range_valid(recording,
+				   header->index_offset,
+				   header->index_count *
+				   sizeof(*recording->index))) {
+		recording_close(recording);
+		return NULL;
+	}
+
+	recording->desc = (const void *)(recording->data +
+					 header->description_offset);
+	recording->stream = recording->data + header->stream_offset;
+	recording->index = (const void *)(recording->data +
+					  header->index_offset);
+
+	if (!recording_description_valid(recording->desc) ||
+	    !recording_index_valid(recording)) {
+		recording_close(recording);
+		return NULL;
+	}
+
+	return recording;
+}
+
+void
+recording_close(struct recording *recording)
+{
+	munmap((void *)recording->data, recording->size);
+	free(recording);
+}
+
+const struct recording_header *
+recording_get_header(const struct recording *recording)
+{
+	return recording->header;
+}
+
+const struct recording_description *
+recording_get_description(const struct recording *recording)
+{
+	return recording->desc;
+}
+
+const struct recording_index_entry *
+recording_get_index(const struct recording *recording, size_t *count)
+{
+	*count = recording->header->index_count;
+
+	return recording->index;
+}
+
+void
+recording_cursor_init(struct recording_cursor *cursor,
+		      const struct recording *recording)
+{
+	memset(cursor, 0, sizeof(*cursor));
+	cursor->recording = recording;
+}
+
+uint64_t
+recording_cursor_seek(struct recording_cursor *cursor, uint64_t time)
+{
+	const struct recording *recording = cursor->recording;
+	const struct recording_index_entry *index = recording->index;
+	size_t lo = 0, hi = recording->header->index_count, mid;
+
+	recording_cursor_init(cursor, recording);
+	if (hi == 0)
+		return 0;
+
+	/* the last keyframe at or before time, or the first one */
+	while (hi - lo > 1) {
+		mid = lo + (hi - lo) / 2;
+		if (index[mid].time <= time)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	cursor->offset = index[lo].offset;
+	cursor->seeked = true;
+
+	return index[lo].event;
+}
+
+static inline void
+set_event(struct input_event *ev,
+	  uint64_t time,
+	  unsigned int type,
+	  unsigned int code,
+	  int32_t value)
+{
+	ev->time.tv_sec = time / 1000000;
+	ev->time.tv_usec = time % 1000000;
+	ev->type = type;
+	ev->code = code;
+	ev->value = value;
+}
+
+enum recording_read_status
+recording_cursor_next(struct recording_cursor *cursor,
+		      struct input_event *ev)
+{
+	const uint8_t *stream = cursor->recording->stream;
+	size_t size = cursor->recording->header->stream_size;
+	struct recording_state *state = &cursor->state;
+	uint64_t v, code, time, count;
+	unsigned int type;
+	int32_t value, *base;
+	uint8_t tag;
+
+	while (true) {
+		if (cursor->keyframe_remaining > 0) {
+			if (cursor->offset >= size)
+				return RECORDING_READ_ERROR;
+
+			type = stream[cursor->offset++];
+			if (type > EV_MAX ||
+			    !varint_decode(stream, size, &cursor->offset, &code) ||
+			    code > KEY_MAX ||
+			    !varint_decode(stream, size, &cursor->offset, &v))
+				return RECORDING_READ_ERROR;
+
+			value = zigzag_decode(v);
+			recording_state_update(state, type, code, value);
+			cursor->keyframe_remaining--;
+
+			if (cursor->restoring) {
+				set_event(ev, state->time, type, code, value);
+				return RECORDING_READ_STATE;
+			}
+			continue;
+		}
+
+		if (cursor->restoring) {
+			cursor->restoring = false;
+			set_event(ev, state->time, EV_SYN, SYN_REPORT, 0);
+			return RECORDING_READ_STATE;
+		}
+
+		if (cursor->offset >= size)
+			return RECORDING_READ_END;
+
+		tag = stream[cursor->offset++];
+		if (tag == RECORDING_TAG_KEYFRAME) {
+			if (!varint_decode(stream, size, &cursor->offset, &time) ||
+			    !varint_decode(stream, size, &cursor->offset, &count))
+				return RECORDING_READ_ERROR;
+
+			memset(state, 0, sizeof(*state));
+			state->time = time;
+			cursor->keyframe_remaining = count;
+			cursor->restoring = cursor->seeked;
+			cursor->seeked = false;
+			continue;
+		}
+
+		if (!(tag & RECORDING_TAG_SAME_TIME)) {
+			if (!varint_decode(stream, size, &cursor->offset, &v))
+				return RECORDING_READ_ERROR;
+			state->time += zigzag_decode(v);
+		}
+
+		type = tag & RECORDING_TAG_TYPE_MASK;
+		if (type > EV_MAX ||
+		    !varint_decode(stream, size, &cursor->offset, &code) ||
+		    code > KEY_MAX ||
+		    !varint_decode(stream, size, &cursor->offset, &v))
+			return RECORDING_READ_ERROR;
+		value = zigzag_decode(v);
+		if (type == EV_ABS) {
+			base = recording_state_abs_value(state, code);
+			if (base)
+				value = (int32_t)((uint32_t)value +
+						  (uint32_t)*base);
+		}
+
+		recording_state_update(state, type, code, value);
+		set_event(ev, state->time, type, code, value);
+
+		return RECORDING_READ_EVENT;
+	}
+}
@@ -0,0 +1,214 @@
+/*
+ * Copyright © 2015 Red Hat, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* The on-disk format written by libinput-record.
+ *
+ * A recording is a fixed-size header and device description, followed
+ * by the event stream and an index of keyframes into the stream. All
+ * fixed-size parts are 8-byte aligned and in the byte order of the
+ * machine that wrote them, so a recording can be mmap'ed and used in
+ * place.
+ *
+ * Each event in the stream is a tag byte with the event type, then the
+ * time difference to the previous event (skipped when the same), the
+ * code and the value as varints. EV_ABS values are stored as the
+ * difference to the previous value of the same axis (and slot), so
+ * most events fit into four or five bytes.
+ *
+ * A keyframe is written every few thousand events on a frame boundary.
+ * It stores the absolute time and the full device state, so decoding
+ * can start at any keyframe without reading what came before.
+ */
+
+#ifndef RECORDING_H
+#define RECORDING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "linux/input.h"
+
+#define RECORDING_MAGIC "LIREC\0\0\0"
+#define RECORDING_VERSION 1
+#define RECORDING_BYTE_ORDER 0x01020304
+
+#define RECORDING_MAX_SLOTS 64
+#define RECORDING_MAX_PROPERTIES 16
+#define RECORDING_KEYFRAME_INTERVAL 4096
+
+struct recording_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint64_t description_offset;
+	uint64_t stream_offset;
+	uint64_t stream_size;
+	uint64_t index_offset;
+	uint64_t index_count;
+	uint64_t nevents;
+};
+
+/* Everything evdev_device_create() looks at: the evdev bits and axis
+ * ranges and the udev properties libinput uses, e.g. MOUSE_DPI */
+struct recording_description {
+	char name[256];
+	uint16_t bustype, vendor, product, version;
+	uint8_t props[(INPUT_PROP_CNT + 7) / 8];
+	uint8_t bits[EV_CNT][(KEY_CNT + 7) / 8];
+	struct input_absinfo abs[ABS_CNT];
+	int32_t rep[REP_CNT];
+	uint32_t nproperties;
+	struct {
+		char name[64];
+		char value[192];
+	} properties[RECORDING_MAX_PROPERTIES];
+};
+
+struct recording_index_entry {
+	uint64_t time; /* us, the keyframe's time */
+	uint64_t offset; /* of the keyframe, from the start of the stream */
+	uint64_t event; /* number of events before the keyframe */
+};
+
+/* The state the deltas are calculated against, writer and reader track
+ * it the same way. The current slot is abs[ABS_MT_SLOT]. */
+struct recording_state {
+	uint64_t time;
+	uint8_t keys[KEY_CNT];
+	uint8_t sw[SW_CNT];
+	int32_t abs[ABS_CNT];
+	int32_t mt[RECORDING_MAX_SLOTS][ABS_CNT - ABS_MT_SLOT];
+};
+
+static inline bool
+recording_description_has_code(const struct recording_description *desc,
+			       unsigned int type,
+			       unsigned int code)
+{
+	if (type >= EV_CNT || code >= KEY_CNT)
+		return false;
+
+	return desc->bits[type][code / 8] & (1 << (code % 8));
+}
+
+static inline bool
+recording_description_has_property(const struct recording_description *desc,
+				   unsigned int prop)
+{
+	if (prop >= INPUT_PROP_CNT)
+		return false;
+
+	return desc->props[prop / 8] & (1 << (prop % 8));
+}
+
+static inline void
+recording_description_enable_code(struct recording_description *desc,
+				  unsigned int type,
+				  unsigned int code)
+{
+	if (type < EV_CNT && code < KEY_CNT)
+		desc->bits[type][code / 8] |= 1 << (code % 8);
+}
+
+static inline void
+recording_description_enable_property(struct recording_description *desc,
+				      unsigned int prop)
+{
+	if (prop < INPUT_PROP_CNT)
+		desc->props[prop / 8] |= 1 << (prop % 8);
+}
+
+const char *
+recording_description_get_property(const struct recording_description *desc,
+				   const char *name);
+
+int
+recording_description_add_property(struct recording_description *desc,
+				   const char *name,
+				   const char *value);
+
+struct recording_writer;
+
+/* Writes to a seekable fd, the header is only complete after
+ * recording_writer_finish() */
+struct recording_writer *
+recording_writer_new(int fd, const struct recording_description *desc);
+
+int
+recording_writer_add(struct recording_writer *writer,
+		     const struct input_event *ev);
+
+/* Writes the index and header and frees the writer */
+int
+recording_writer_finish(struct recording_writer *writer);
+
+struct recording;
+
+struct recording *
+recording_open(const char *path);
+
+void
+recording_close(struct recording *recording);
+
+const struct recording_header *
+recording_get_header(const struct recording *recording);
+
+const struct recording_description *
+recording_get_description(const struct recording *recording);
+
+const struct recording_index_entry *
+recording_get_index(const struct recording *recording, size_t *count);
+
+enum recording_read_status {
+	RECORDING_READ_ERROR = -1,
+	RECORDING_READ_END = 0,
+	RECORDING_READ_EVENT,
+	/* Restores the device state after a seek, ends with a SYN_REPORT.
+	 * Only returned for the keyframe the cursor was seeked to. */
+	RECORDING_READ_STATE,
+};
+
+struct recording_cursor {
+	const struct recording *recording;
+	size_t offset;
+	struct recording_state state;
+
+	size_t keyframe_remaining;
+	bool seeked; /* the next keyframe restores the state */
+	bool restoring;
+};
+
+void
+recording_cursor_init(struct recording_cursor *cursor,
+		      const struct recording *recording);
+
+/* Positions the cursor on the last keyframe at or before time. Returns
+ * the number of events before the keyframe. */
+uint64_t
+recording_cursor_seek(struct recording_cursor *cursor, uint64_t time);
+
+enum recording_read_status
+recording_cursor_next(struct recording_cursor *cursor,
+		      struct input_event *ev);
+
+#endif
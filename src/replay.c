@@ -0,0 +1,322 @@
+/*
+ * Copyright © 2015 Red Hat, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <libevdev/libevdev.h>
+
+#include "libinput-util.h"
+#include "replay.h"
+
+static struct libevdev *
+replay_create_description(const struct recording_description *desc)
+{
+	struct libevdev *evdev;
+	unsigned int type, code;
+	const void *data;
+	int max;
+
+	evdev = libevdev_new();
+	if (!evdev)
+		return NULL;
+
+	libevdev_set_name(evdev, desc->name);
+	libevdev_set_id_bustype(evdev, desc->bustype);
+	libevdev_set_id_vendor(evdev, desc->vendor);
+	libevdev_set_id_product(evdev, desc->product);
+	libevdev_set_id_version(evdev, desc->version);
+
+	for (code = 0; code < INPUT_PROP_CNT; code++) {
+		if (recording_description_has_property(desc, code))
+			libevdev_enable_property(evdev, code);
+	}
+
+	for (type = 0; type < EV_CNT; type++) {
+		max = libevdev_event_type_get_max(type);
+		for (code = 0; max != -1 && code <= (unsigned int)max; code++) {
+			if (!recording_description_has_code(desc, type, code))
+				continue;
+
+			data = NULL;
+			if (type == EV_ABS)
+				data = &desc->abs[code];
+			else if (type == EV_REP)
+				data = &desc->rep[code];
+
+			if (libevdev_enable_event_code(evdev,
+						       type,
+						       code,
+						       data) != 0) {
+				libevdev_free(evdev);
+				return NULL;
+			}
+		}
+	}
+
+	return evdev;
+}
+
+/* What udev-seat.c does with the property, through the public API */
+static void
+replay_apply_calibration(struct replay *replay)
+{
+	const struct recording_description *desc;
+	const char *prop;
+	float matrix[6];
+
+	desc = recording_get_description(replay->recording);
+	prop = recording_description_get_property(desc,
+						  "LIBINPUT_CALIBRATION_MATRIX");
+	if (!prop ||
+	    !libinput_device_config_calibration_has_matrix(replay->device))
+		return;
+
+	if (sscanf(prop, "%f %f %f %f %f %f",
+		   &matrix[0], &matrix[1], &matrix[2],
+		   &matrix[3], &matrix[4], &matrix[5]) == 6)
+		libinput_device_config_calibration_set_matrix(replay->device,
+							      matrix);
+}
+
+struct replay *
+replay_new(const char *path,
+	   const struct libinput_interface *interface,
+	   void *user_data)
+{
+	struct replay *replay;
+	struct libevdev *evdev;
+
+	replay = zalloc(sizeof(*replay));
+	if (!replay)
+		return NULL;
+
+	replay->recording = recording_open(path);
+	if (!replay->recording)
+		goto err;
+
+	replay->libinput = libinput_memory_create_context(interface,
+							  user_data);
+	if (!replay->libinput ||
+	    libinput_memory_set_event_clock(replay->libinput, 1) != 0)
+		goto err;
+
+	evdev = replay_create_description(
+			recording_get_description(replay->recording));
+	if (!evdev)
+		goto err;
+
+	replay->device = libinput_memory_add_device(replay->libinput, evdev);
+	libevdev_free(evdev);
+	if (!replay->device)
+		goto err;
+
+	libinput_device_ref(replay->device);
+	replay_apply_calibration(replay);
+
+	recording_cursor_init(&replay->cursor, replay->recording);
+
+	return replay;
+
+err:
+	replay_destroy(replay);
+	return NULL;
+}
+
+void
+replay_destroy(struct replay *replay)
+{
+	if (replay->device)
+		libinput_device_unref(replay->device);
+	if (replay->libinput)
+		libinput_unref(replay->libinput);
+	if (replay->recording)
+		recording_close(replay->recording);
+	free(replay->frame);
+	free(replay);
+}
+
+int
+replay_seek(struct replay *replay, uint64_t time)
+{
+	const struct recording_index_entry *index;
+	size_t count;
+
+	index = recording_get_index(replay->recording, &count);
+	if (count == 0)
+		return -EINVAL;
+
+	recording_cursor_seek(&replay->cursor, index[0].time + time);
+
+	return 0;
+}
+
+static int
+replay_frame_append(struct replay *replay,
+		    size_t n,
+		    const struct input_event *ev)
+{
+	struct input_event *frame;
+	size_t size;
+
+	if (n == replay->frame_size) {
+		size = max(replay->frame_size * 2, 64);
+		frame = realloc(replay->frame, size * sizeof(*frame));
+		if (!frame)
+			return -ENOMEM;
+
+		replay->frame = frame;
+		replay->frame_size = size;
+	}
+
+	replay->frame[n] = *ev;
+
+	return 0;
+}
+
+int
+replay_next_frame(struct replay *replay)
+{
+	enum recording_read_status status;
+	struct input_event ev;
+	size_t n = 0;
+	int rc;
+
+	while ((status = recording_cursor_next(&replay->cursor, &ev)) > 0) {
+		rc = replay_frame_append(replay, n++, &ev);
+		if (rc < 0)
+			return rc;
+
+		/* the state restored after a seek isn't a recorded event */
+		if (status == RECORDING_READ_EVENT)
+			replay->nevents++;
+
+		if (ev.type == EV_SYN && ev.code == SYN_REPORT)
+			break;
+	}
+
+	if (status == RECORDING_READ_ERROR)
+		return -EINVAL;
+
+	if (n == 0)
+		return 0;
+
+	rc = libinput_memory_device_inject(replay->device, replay->frame, n);
+	if (rc < 0)
+		return rc;
+
+	replay->nframes++;
+
+	return 1;
+}
+
+int
+replay_finish(struct replay *replay, unsigned int timeout)
+{
+	return libinput_memory_advance_clock(replay->libinput,
+					     replay->cursor.state.time +
+					     timeout * 1000ULL);
+}
+
+int
+replay_format_event(struct libinput_event *event, char *buf, size_t len)
+{
+	struct libinput_device *device = libinput_event_get_device(event);
+	struct libinput_event_keyboard *k;
+	struct libinput_event_pointer *p;
+	struct libinput_event_touch *t;
+
+	switch (libinput_event_get_type(event)) {
+	case LIBINPUT_EVENT_NONE:
+		break;
+	case LIBINPUT_EVENT_DEVICE_ADDED:
+		return snprintf(buf, len, "DEVICE_ADDED %s",
+				libinput_device_get_name(device));
+	case LIBINPUT_EVENT_DEVICE_REMOVED:
+		return snprintf(buf, len, "DEVICE_REMOVED %s",
+				libinput_device_get_name(device));
+	case LIBINPUT_EVENT_KEYBOARD_KEY:
+		k = libinput_event_get_keyboard_event(event);
+		return snprintf(buf, len, "%u KEYBOARD_KEY %u %d",
+				libinput_event_keyboard_get_time(k),
+				libinput_event_keyboard_get_key(k),
+				libinput_event_keyboard_get_key_state(k));
+	case LIBINPUT_EVENT_POINTER_MOTION:
+		p = libinput_event_get_pointer_event(event);
+		return snprintf(buf, len, "%u POINTER_MOTION %.6f %.6f %.6f %.6f",
+				libinput_event_pointer_get_time(p),
+				libinput_event_pointer_get_dx(p),
+				libinput_event_pointer_get_dy(p),
+				libinput_event_pointer_get_dx_unaccelerated(p),
+				libinput_event_pointer_get_dy_unaccelerated(p));
+	case LIBINPUT_EVENT_POINTER_MOTION_ABSOLUTE:
+		p = libinput_event_get_pointer_event(event);
+		return snprintf(buf, len, "%u POINTER_MOTION_ABSOLUTE %.6f %.6f",
+				libinput_event_pointer_get_time(p),
+				libinput_event_pointer_get_absolute_x(p),
+				libinput_event_pointer_get_absolute_y(p));
+	case LIBINPUT_EVENT_POINTER_BUTTON:
+		p = libinput_event_get_pointer_event(event);
+		return snprintf(buf, len, "%u POINTER_BUTTON %u %d %u",
+				libinput_event_pointer_get_time(p),
+				libinput_event_pointer_get_button(p),
+				libinput_event_pointer_get_button_state(p),
+				libinput_event_pointer_get_seat_button_count(p));
+	case LIBINPUT_EVENT_POINTER_AXIS:
+		p = libinput_event_get_pointer_event(event);
+		return snprintf(buf, len, "%u POINTER_AXIS %d %.6f %d",
+				libinput_event_pointer_get_time(p),
+				libinput_event_pointer_get_axis(p),
+				libinput_event_pointer_get_axis_value(p),
+				libinput_event_pointer_get_axis_source(p));
+	case LIBINPUT_EVENT_TOUCH_DOWN:
+	case LIBINPUT_EVENT_TOUCH_MOTION:
+		t = libinput_event_get_touch_event(event);
+		return snprintf(buf, len, "%u %s %d %d %.6f %.6f",
+				libinput_event_touch_get_time(t),
+				libinput_event_get_type(event) ==
+					LIBINPUT_EVENT_TOUCH_DOWN ?
+					"TOUCH_DOWN" : "TOUCH_MOTION",
+				libinput_event_touch_get_slot(t),
+				libinput_event_touch_get_seat_slot(t),
+				libinput_event_touch_get_x(t),
+				libinput_event_touch_get_y(t));
+	case LIBINPUT_EVENT_TOUCH_UP:
+	case LIBINPUT_EVENT_TOUCH_CANCEL:
+		t = libinput_event_get_touch_event(event);
+		return snprintf(buf, len, "%u %s %d %d",
+				libinput_event_touch_get_time(t),
+				libinput_event_get_type(event) ==
+					LIBINPUT_EVENT_TOUCH_UP ?
+					"TOUCH_UP" : "TOUCH_CANCEL",
+				libinput_event_touch_get_slot(t),
+				libinput_event_touch_get_seat_slot(t));
+	case LIBINPUT_EVENT_TOUCH_FRAME:
+		t = libinput_event_get_touch_event(event);
+		return snprintf(buf, len, "%u TOUCH_FRAME",
+				libinput_event_touch_get_time(t));
+	}
+
+	return snprintf(buf, len, "UNKNOWN %d", libinput_event_get_type(event));
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright © 2015 Red Hat, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* Feeds a recording from libinput-record through a memory context, with
+ * the context's clock following the recorded timestamps. Used by
+ * libinput-replay and the tests, not part of the library. */
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libinput.h"
+#include "recording.h"
+
+struct replay {
+	struct libinput *libinput;
+	struct libinput_device *device;
+	struct recording *recording;
+	struct recording_cursor cursor;
+
+	struct input_event *frame;
+	size_t frame_size;
+
+	uint64_t nevents;
+	uint64_t nframes;
+};
+
+struct replay *
+replay_new(const char *path,
+	   const struct libinput_interface *interface,
+	   void *user_data);
+
+void
+replay_destroy(struct replay *replay);
+
+/* Continues from the last keyframe at or before time (in us since the
+ * start of the recording). The first frame after that restores the
+ * device state at the keyframe. */
+int
+replay_seek(struct replay *replay, uint64_t time);
+
+/* Injects the next frame, returns 1 for a frame, 0 at the end of the
+ * recording or a negative errno */
+int
+replay_next_frame(struct replay *replay);
+
+/* Lets the recorded clock run on for timeout ms after the last event so
+ * pending timeouts expire */
+int
+replay_finish(struct replay *replay, unsigned int timeout);
+
+/* A single line describing the event, the same for the same event on
+ * any machine. Returns the number of characters like snprintf. */
+int
+replay_format_event(struct libinput_event *event, char *buf, size_t len);
+
+#endif
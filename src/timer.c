@@ -48,6 +48,10 @@ libinput_timer_arm_timer_fd(struct libinput *libinput)
 	struct itimerspec its = { { 0, 0 }, { 0, 0 } };
 	uint64_t earliest_expire = UINT64_MAX;
 
+	/* expired timers are run by libinput_timer_advance() */
+	if (libinput->timer.event_clock)
+		return;
+
 	list_for_each(timer, &libinput->timer.list, link) {
 		if (timer->expire < earliest_expire)
 			earliest_expire = timer->expire;
@@ -81,6 +85,7 @@ libinput_timer_set(struct libinput_timer *timer, uint64_t expire)
 		list_insert(&timer->libinput->timer.list, &timer->link);
 
 	timer->expire = expire;
+	PROBE2(timer_arm, timer, expire);
 	libinput_timer_arm_timer_fd(timer->libinput);
 }
 
@@ -108,6 +113,7 @@ libinput_timer_handler(void *data)
 
 	list_for_each_safe(timer, tmp, &libinput->timer.list, link) {
 		if (timer->expire <= now) {
+			PROBE3(timer_fire, timer, timer->expire, now);
 			/* Clear the timer before calling timer_func,
 			   as timer_func may re-arm it */
 			libinput_timer_cancel(timer);
@@ -116,6 +122,38 @@ libinput_timer_handler(void *data)
 	}
 }
 
+void
+libinput_timer_advance(struct libinput *libinput, uint64_t now)
+{
+	struct libinput_timer *timer, *earliest;
+
+	/* Run the timers in the order they would have expired, each one
+	 * with its own expiry time as now */
+	while (true) {
+		earliest = NULL;
+		list_for_each(timer, &libinput->timer.list, link) {
+			if (timer->expire <= now &&
+			    (!earliest || timer->expire < earliest->expire))
+				earliest = timer;
+		}
+
+		if (!earliest)
+			break;
+
+		if (earliest->expire > libinput->timer.now)
+			libinput->timer.now = earliest->expire;
+
+		PROBE3(timer_fire, earliest, earliest->expire,
+		       libinput->timer.now);
+		libinput_timer_cancel(earliest);
+		earliest->timer_func(libinput->timer.now,
+				     earliest->timer_func_data);
+	}
+
+	if (now > libinput->timer.now)
+		libinput->timer.now = now;
+}
+
 int
 libinput_timer_subsys_init(struct libinput *libinput)
 {
@@ -49,6 +49,11 @@ libinput_timer_set(struct libinput_timer *timer, uint64_t expire);
 void
 libinput_timer_cancel(struct libinput_timer *timer);
 
+/* Moves the event clock forward to now (in ms), running the timers that
+ * expire on the way */
+void
+libinput_timer_advance(struct libinput *libinput, uint64_t now);
+
 int
 libinput_timer_subsys_init(struct libinput *libinput);
 
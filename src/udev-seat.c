@@ -41,10 +41,34 @@ udev_seat_create(struct udev_input *input,
 static struct udev_seat *
 udev_seat_get_named(struct udev_input *input, const char *seat_name);
 
+static inline const char *
+udev_device_get_seat_id(struct udev_device *udev_device)
+{
+	const char *device_seat;
+
+	device_seat = udev_device_get_property_value(udev_device, "ID_SEAT");
+	if (!device_seat)
+		device_seat = default_seat;
+
+	return device_seat;
+}
+
+static inline bool
+device_is_on_seat(struct udev_device *udev_device,
+		  struct udev_input *input)
+{
+	return strcmp(udev_device_get_seat_id(udev_device),
+		      input->seat_id) == 0;
+}
+
+/* Takes ownership of fd, which may be a negative errno if opening the
+ * device failed, and of evdev, see evdev_device_create_from_fd() */
 static int
-device_added(struct udev_device *udev_device,
-	     struct udev_input *input,
-	     const char *seat_name)
+device_added_with_fd(struct udev_device *udev_device,
+		     struct udev_input *input,
+		     const char *seat_name,
+		     int fd,
+		     struct libevdev *evdev)
 {
 	struct evdev_device *device;
 	const char *devnode;
@@ -53,13 +77,7 @@ device_added(struct udev_device *udev_device,
 	float calibration[6];
 	struct udev_seat *seat;
 
-	device_seat = udev_device_get_property_value(udev_device, "ID_SEAT");
-	if (!device_seat)
-		device_seat = default_seat;
-
-	if (strcmp(device_seat, input->seat_id))
-		return 0;
-
+	device_seat = udev_device_get_seat_id(udev_device);
 	devnode = udev_device_get_devnode(udev_device);
 
 	/* Search for matching logical seat */
@@ -74,11 +92,16 @@ device_added(struct udev_device *udev_device,
 		libinput_seat_ref(&seat->base);
 	else {
 		seat = udev_seat_create(input, device_seat, seat_name);
-		if (!seat)
+		if (!seat) {
+			if (fd >= 0)
+				close_restricted(&input->base, fd);
+			libevdev_free(evdev);
 			return -1;
+		}
 	}
 
-	device = evdev_device_create(&seat->base, udev_device);
+	device = evdev_device_create_from_fd(&seat->base, udev_device,
+					     fd, evdev);
 	libinput_seat_unref(&seat->base);
 
 	if (device == EVDEV_UNHANDLED_DEVICE) {
@@ -115,11 +138,27 @@ device_added(struct udev_device *udev_device,
 
 	output_name = udev_device_get_property_value(udev_device, "WL_OUTPUT");
 	if (output_name)
-		device->output_name = strdup(output_name);
+		device->output_name = strdup_tag(LIBINPUT_MEMORY_TAG_DEVICE,
+						 output_name);
 
 	return 0;
 }
 
+static int
+device_added(struct udev_device *udev_device,
+	     struct udev_input *input,
+	     const char *seat_name)
+{
+	int fd;
+
+	if (!device_is_on_seat(udev_device, input))
+		return 0;
+
+	fd = evdev_device_open(&input->base, udev_device);
+
+	return device_added_with_fd(udev_device, input, seat_name, fd, NULL);
+}
+
 static void
 device_removed(struct udev_device *udev_device, struct udev_input *input)
 {
@@ -144,13 +183,70 @@ device_removed(struct udev_device *udev_device, struct udev_input *input)
 	}
 }
 
+static int
+udev_device_array_append(struct udev_device ***devices,
+			 size_t *ndevices,
+			 size_t *size,
+			 struct udev_device *udev_device)
+{
+	struct udev_device **tmp;
+	size_t new_size;
+
+	if (*ndevices == *size) {
+		new_size = *size ? *size * 2 : 16;
+		tmp = realloc_tag(LIBINPUT_MEMORY_TAG_DEVICE,
+				  *devices, new_size * sizeof(**devices));
+		if (!tmp)
+			return -1;
+		*devices = tmp;
+		*size = new_size;
+	}
+
+	(*devices)[(*ndevices)++] = udev_device;
+
+	return 0;
+}
+
+static int
+udev_input_devices_opened(struct libinput *libinput,
+			  struct udev_device **udev_devices,
+			  int *fds,
+			  struct libevdev **evdevs,
+			  size_t count,
+			  void *data)
+{
+	struct udev_input *input = (struct udev_input*)libinput;
+	struct libevdev *evdev;
+	size_t i;
+	int rc = 0;
+
+	for (i = 0; i < count; i++) {
+		evdev = evdevs ? evdevs[i] : NULL;
+
+		if (rc == 0) {
+			if (device_added_with_fd(udev_devices[i], input,
+						 NULL, fds[i], evdev) < 0)
+				rc = -1;
+		} else {
+			if (fds[i] >= 0)
+				close_restricted(libinput, fds[i]);
+			libevdev_free(evdev);
+		}
+	}
+
+	return rc;
+}
+
 static int
 udev_input_add_devices(struct udev_input *input, struct udev *udev)
 {
 	struct udev_enumerate *e;
 	struct udev_list_entry *entry;
 	struct udev_device *device;
+	struct udev_device **devices = NULL;
+	size_t ndevices = 0, size = 0, i;
 	const char *path, *sysname;
+	int rc = 0;
 
 	e = udev_enumerate_new(udev);
 	udev_enumerate_add_match_subsystem(e, "input");
@@ -160,22 +256,72 @@ udev_input_add_devices(struct udev_input *input, struct udev *udev)
 		device = udev_device_new_from_syspath(udev, path);
 
 		sysname = udev_device_get_sysname(device);
-		if (strncmp("event", sysname, 5) != 0) {
+		if (strncmp("event", sysname, 5) != 0 ||
+		    !device_is_on_seat(device, input)) {
 			udev_device_unref(device);
 			continue;
 		}
 
-		if (device_added(device, input, NULL) < 0) {
+		if (udev_device_array_append(&devices, &ndevices,
+					     &size, device) < 0) {
 			udev_device_unref(device);
-			udev_enumerate_unref(e);
-			return -1;
+			rc = -1;
+			goto out;
 		}
-
-		udev_device_unref(device);
 	}
+
+	if (ndevices == 0)
+		goto out;
+
+	/* Open all device nodes before setting up any device. Each open
+	 * may be a round-trip to the session manager, this way they are
+	 * not interleaved with the device setup. With an
+	 * open_restricted_many callback the devices may only be added
+	 * in a later libinput_dispatch(). */
+	rc = evdev_device_open_many(&input->base,
+				    devices,
+				    ndevices,
+				    udev_input_devices_opened,
+				    NULL);
+
+out:
+	for (i = 0; i < ndevices; i++)
+		udev_device_unref(devices[i]);
+	free_tag(LIBINPUT_MEMORY_TAG_DEVICE, devices);
 	udev_enumerate_unref(e);
 
-	return 0;
+	return rc;
+}
+
+static inline bool
+udev_device_is_added(struct udev_device *udev_device)
+{
+	return strcmp(udev_device_get_action(udev_device), "add") == 0;
+}
+
+/* Drops the pending add for the device if there is one. A device that
+ * is added and removed again before we get to it is never set up. */
+static bool
+udev_input_cancel_pending_add(struct udev_device **pending,
+			      size_t *npending,
+			      struct udev_device *removed)
+{
+	const char *syspath = udev_device_get_syspath(removed);
+	size_t i;
+
+	for (i = 0; i < *npending; i++) {
+		if (!udev_device_is_added(pending[i]) ||
+		    strcmp(syspath, udev_device_get_syspath(pending[i])) != 0)
+			continue;
+
+		udev_device_unref(pending[i]);
+		memmove(&pending[i], &pending[i + 1],
+			(*npending - i - 1) * sizeof(*pending));
+		(*npending)--;
+		return true;
+	}
+
+	return false;
 }
 
 static void
@@ -183,26 +329,68 @@ evdev_udev_handler(void *data)
 {
 	struct udev_input *input = data;
 	struct udev_device *udev_device;
+	struct udev_device **pending = NULL;
+	size_t npending = 0, size = 0, nadded = 0, i;
 	const char *action;
 
-	udev_device = udev_monitor_receive_device(input->udev_monitor);
-	if (!udev_device)
-		return;
+	/* Drain the monitor, a dock or a test suite adds dozens of devices
+	 * in one go and we want to open and add them as one batch */
+	while ((udev_device = udev_monitor_receive_device(input->udev_monitor))) {
+		action = udev_device_get_action(udev_device);
 
-	action = udev_device_get_action(udev_device);
-	if (!action)
-		goto out;
+		if (!action ||
+		    strncmp("event", udev_device_get_sysname(udev_device), 5) != 0 ||
+		    (strcmp(action, "add") != 0 && strcmp(action, "remove") != 0)) {
+			udev_device_unref(udev_device);
+			continue;
+		}
 
-	if (strncmp("event", udev_device_get_sysname(udev_device), 5) != 0)
-		goto out;
+		if (!strcmp(action, "remove") &&
+		    udev_input_cancel_pending_add(pending, &npending, udev_device)) {
+			udev_device_unref(udev_device);
+			continue;
+		}
 
-	if (!strcmp(action, "add"))
-		device_added(udev_device, input, NULL);
-	else if (!strcmp(action, "remove"))
-		device_removed(udev_device, input);
+		if (udev_device_array_append(&pending, &npending,
+					     &size, udev_device) < 0) {
+			/* can't batch it, handle it right away */
+			if (!strcmp(action, "add"))
+				device_added(udev_device, input, NULL);
+			else
+				device_removed(udev_device, input);
+			udev_device_unref(udev_device);
+		}
+	}
 
-out:
-	udev_device_unref(udev_device);
+	/* Any add left for a syspath comes after its remove, so removing
+	 * first keeps a replugged device working. The adds are compacted
+	 * to the front of the array on the way. */
+	for (i = 0; i < npending; i++) {
+		udev_device = pending[i];
+
+		if (!udev_device_is_added(udev_device)) {
+			device_removed(udev_device, input);
+			udev_device_unref(udev_device);
+		} else if (!device_is_on_seat(udev_device, input)) {
+			udev_device_unref(udev_device);
+		} else {
+			pending[nadded++] = udev_device;
+		}
+	}
+
+	if (nadded > 0 &&
+	    evdev_device_open_many(&input->base,
+				   pending,
+				   nadded,
+				   udev_input_devices_opened,
+				   NULL) < 0)
+		log_error(&input->base,
+			  "udev: failed to add %zu new devices\n",
+			  nadded);
+
+	for (i = 0; i < nadded; i++)
+		udev_device_unref(pending[i]);
+	free_tag(LIBINPUT_MEMORY_TAG_DEVICE, pending);
 }
 
 static void
@@ -292,14 +480,14 @@ udev_input_destroy(struct libinput *input)
 		return;
 
 	udev_unref(udev_input->udev);
-	free(udev_input->seat_id);
+	free_tag(LIBINPUT_MEMORY_TAG_SEAT, udev_input->seat_id);
 }
 
 static void
 udev_seat_destroy(struct libinput_seat *seat)
 {
 	struct udev_seat *useat = (struct udev_seat*)seat;
-	free(useat);
+	free_tag(LIBINPUT_MEMORY_TAG_SEAT, useat);
 }
 
 static struct udev_seat *
@@ -309,7 +497,7 @@ udev_seat_create(struct udev_input *input,
 {
 	struct udev_seat *seat;
 
-	seat = zalloc(sizeof *seat);
+	seat = zalloc_tag(LIBINPUT_MEMORY_TAG_SEAT, sizeof *seat);
 	if (!seat)
 		return NULL;
 
@@ -325,6 +513,9 @@ udev_seat_get_named(struct udev_input *input, const char *seat_name)
 {
 	struct udev_seat *seat;
 
+	/* don't hand out a seat that is about to be destroyed */
+	libinput_destroy_retired(&input->base);
+
 	list_for_each(seat, &input->base.seat_list, base.link) {
 		if (strcmp(seat->base.logical_name, seat_name) == 0)
 			return seat;
@@ -368,14 +559,14 @@ libinput_udev_create_context(const struct libinput_interface *interface,
 	if (!interface || !udev)
 		return NULL;
 
-	input = zalloc(sizeof *input);
+	input = zalloc_tag(LIBINPUT_MEMORY_TAG_CONTEXT, sizeof *input);
 	if (!input)
 		return NULL;
 
 	if (libinput_init(&input->base, interface,
 			  &interface_backend, user_data) != 0) {
 		libinput_unref(&input->base);
-		free(input);
+		free_tag(LIBINPUT_MEMORY_TAG_CONTEXT, input);
 		return NULL;
 	}
 
@@ -400,7 +591,7 @@ libinput_udev_assign_seat(struct libinput *libinput,
 		return -1;
 	}
 
-	input->seat_id = strdup(seat_id);
+	input->seat_id = strdup_tag(LIBINPUT_MEMORY_TAG_SEAT, seat_id);
 
 	if (udev_input_enable(&input->base) < 0)
 		return -1;
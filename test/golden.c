@@ -0,0 +1,561 @@
+/*
+ * Copyright © 2015 Red Hat, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* Replays the evemu recordings in golden/ through a memory context with
+ * the event clock and compares the libinput events against the
+ * .golden file next to each recording. Any change to the event output
+ * fails here, so this is the test to run before and after refactoring
+ * the event processing.
+ *
+ * When the output changes on purpose, run the test with
+ * LITEST_GOLDEN_UPDATE=1 to rewrite the .golden files and review the
+ * diff.
+ */
+
+#include <config.h>
+
+#include <check.h>
+#include <errno.h>
+#include <libevdev/libevdev.h>
+#include <libinput.h>
+#include <libinput-util.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "litest.h"
+#include "replay.h"
+
+/* Float tolerance, relative to the value for values above 1. Enough for
+ * different libm or compiler output, not enough to hide any actual
+ * change to the acceleration or scaling. */
+#define GOLDEN_TOLERANCE 1e-5
+
+/* How long the clock runs on after the last event, so any pending
+ * timeouts expire */
+#define GOLDEN_TIMEOUT_MS 5000
+
+struct golden_recording {
+	struct libevdev *evdev;
+	struct input_event *events;
+	int *lines; /* line in the .evemu file of each event */
+	size_t nevents;
+	size_t size;
+};
+
+struct output {
+	char **lines;
+	int *source; /* the .evemu line of the last event processed */
+	size_t nlines;
+	size_t size;
+};
+
+static int open_restricted(const char *path, int flags, void *data)
+{
+	ck_abort_msg("memory backend opened %s", path);
+	return -ENODEV;
+}
+
+static void close_restricted(int fd, void *data)
+{
+}
+
+static const struct libinput_interface interface = {
+	.open_restricted = open_restricted,
+	.close_restricted = close_restricted,
+};
+
+static void
+golden_recording_add_event(struct golden_recording *rec,
+			   const struct input_event *ev,
+			   int line)
+{
+	if (rec->nevents == rec->size) {
+		rec->size = rec->size ? rec->size * 2 : 1024;
+		rec->events = realloc(rec->events,
+				      rec->size * sizeof(*rec->events));
+		rec->lines = realloc(rec->lines,
+				     rec->size * sizeof(*rec->lines));
+		ck_assert_notnull(rec->events);
+		ck_assert_notnull(rec->lines);
+	}
+
+	rec->events[rec->nevents] = *ev;
+	rec->lines[rec->nevents] = line;
+	rec->nevents++;
+}
+
+/* Sets the bits from a B: or P: line, offset is the byte offset of the
+ * line within the bitmask */
+static void
+parse_bits(const char *str,
+	   unsigned int offset,
+	   unsigned char *bits,
+	   size_t nbytes)
+{
+	unsigned int byte;
+	int consumed;
+
+	while (sscanf(str, " %x%n", &byte, &consumed) == 1) {
+		if (offset < nbytes)
+			bits[offset] = byte;
+		offset++;
+		str += consumed;
+	}
+}
+
+static void
+golden_recording_parse(struct golden_recording *rec, const char *path)
+{
+	unsigned char props[(INPUT_PROP_MAX + 8) / 8] = {0};
+	unsigned char bits[EV_CNT][(KEY_MAX + 8) / 8];
+	unsigned int offset[EV_CNT] = {0}, prop_offset = 0;
+	struct input_absinfo abs[ABS_CNT];
+	char buf[1024];
+	FILE *fp;
+	int line = 0;
+	unsigned int type, code;
+
+	memset(bits, 0, sizeof(bits));
+	memset(abs, 0, sizeof(abs));
+	memset(rec, 0, sizeof(*rec));
+
+	rec->evdev = libevdev_new();
+	ck_assert_notnull(rec->evdev);
+
+	fp = fopen(path, "r");
+	ck_assert_msg(fp != NULL, "Failed to open %s: %s", path, strerror(errno));
+
+	while (fgets(buf, sizeof(buf), fp)) {
+		struct input_event ev;
+		unsigned int bus, vendor, product, version;
+		unsigned long sec, usec;
+		int minimum, maximum, fuzz, flat, resolution;
+		int value;
+		int n = 0;
+
+		line++;
+		buf[strcspn(buf, "\n")] = '\0';
+
+		if (buf[0] == '#' || buf[0] == '\0') {
+			continue;
+		} else if (strncmp(buf, "N: ", 3) == 0) {
+			libevdev_set_name(rec->evdev, buf + 3);
+		} else if (sscanf(buf, "I: %x %x %x %x",
+				  &bus, &vendor, &product, &version) == 4) {
+			libevdev_set_id_bustype(rec->evdev, bus);
+			libevdev_set_id_vendor(rec->evdev, vendor);
+			libevdev_set_id_product(rec->evdev, product);
+			libevdev_set_id_version(rec->evdev, version);
+		} else if (strncmp(buf, "P:", 2) == 0) {
+			parse_bits(buf + 2, prop_offset, props, sizeof(props));
+			prop_offset += 8;
+		} else if (sscanf(buf, "B: %x%n", &type, &n) == 1 &&
+			   type < EV_CNT) {
+			parse_bits(buf + n, offset[type], bits[type],
+				   sizeof(bits[type]));
+			offset[type] += 8;
+		} else if (sscanf(buf, "A: %x %d %d %d %d %d",
+				  &code, &minimum, &maximum,
+				  &fuzz, &flat, &resolution) >= 5 &&
+			   code < ABS_CNT) {
+			abs[code].minimum = minimum;
+			abs[code].maximum = maximum;
+			abs[code].fuzz = fuzz;
+			abs[code].flat = flat;
+			abs[code].resolution = resolution;
+		} else if (sscanf(buf, "E: %lu.%lu %x %x %d",
+				  &sec, &usec, &type, &code, &value) == 5) {
+			ev.time.tv_sec = sec;
+			ev.time.tv_usec = usec;
+			ev.type = type;
+			ev.code = code;
+			ev.value = value;
+			golden_recording_add_event(rec, &ev, line);
+		} else {
+			ck_abort_msg("%s:%d: unknown line '%s'", path, line, buf);
+		}
+	}
+
+	fclose(fp);
+
+	for (code = 0; code <= INPUT_PROP_MAX; code++) {
+		if (props[code / 8] & (1 << (code % 8)))
+			libevdev_enable_property(rec->evdev, code);
+	}
+
+	for (type = EV_KEY; type < EV_CNT; type++) {
+		int max = libevdev_event_type_get_max(type);
+		int rep = 0;
+		const void *data;
+
+		for (code = 0; max != -1 && code <= (unsigned int)max; code++) {
+			if (!(bits[type][code / 8] & (1 << (code % 8))))
+				continue;
+
+			switch (type) {
+			case EV_ABS:
+				data = &abs[code];
+				break;
+			case EV_REP:
+				data = &rep;
+				break;
+			default:
+				data = NULL;
+				break;
+			}
+			ck_assert_int_eq(libevdev_enable_event_code(rec->evdev,
+								    type,
+								    code,
+								    data),
+					 0);
+		}
+	}
+
+	ck_assert_int_gt(rec->nevents, 0);
+}
+
+static void
+golden_recording_destroy(struct golden_recording *rec)
+{
+	libevdev_free(rec->evdev);
+	free(rec->events);
+	free(rec->lines);
+}
+
+static void
+output_collect(struct output *out, struct libinput *li, int source)
+{
+	struct libinput_event *event;
+	char buf[256];
+
+	libinput_dispatch(li);
+	while ((event = libinput_get_event(li))) {
+		replay_format_event(event, buf, sizeof(buf));
+		libinput_event_destroy(event);
+
+		if (out->nlines == out->size) {
+			out->size = out->size ? out->size * 2 : 1024;
+			out->lines = realloc(out->lines,
+					     out->size * sizeof(*out->lines));
+			out->source = realloc(out->source,
+					      out->size * sizeof(*out->source));
+			ck_assert_notnull(out->lines);
+			ck_assert_notnull(out->source);
+		}
+
+		out->lines[out->nlines] = strdup(buf);
+		out->source[out->nlines] = source;
+		out->nlines++;
+	}
+}
+
+static void
+output_destroy(struct output *out)
+{
+	size_t i;
+
+	for (i = 0; i < out->nlines; i++)
+		free(out->lines[i]);
+	free(out->lines);
+	free(out->source);
+}
+
+static void
+replay(struct golden_recording *rec, struct output *out)
+{
+	struct libinput *li;
+	struct libinput_device *device;
+	const struct input_event *last;
+	size_t i, start = 0;
+
+	memset(out, 0, sizeof(*out));
+
+	li = libinput_memory_create_context(&interface, NULL);
+	ck_assert_notnull(li);
+	ck_assert_int_eq(libinput_memory_set_event_clock(li, 1), 0);
+
+	device = libinput_memory_add_device(li, rec->evdev);
+	ck_assert_notnull(device);
+
+	/* tapping is off by default but is the largest part of the
+	 * touchpad code, so the recordings are replayed with it on */
+	if (libinput_device_config_tap_get_finger_count(device) > 0)
+		libinput_device_config_tap_set_enabled(device,
+						       LIBINPUT_CONFIG_TAP_ENABLED);
+
+	output_collect(out, li, 0);
+
+	/* frame by frame, so each output line is matched with the frame
+	 * that caused it */
+	for (i = 0; i < rec->nevents; i++) {
+		const struct input_event *ev = &rec->events[i];
+
+		if (ev->type != EV_SYN || ev->code != SYN_REPORT)
+			continue;
+
+		ck_assert_int_eq(libinput_memory_device_inject(device,
+							       &rec->events[start],
+							       i - start + 1),
+				 0);
+		output_collect(out, li, rec->lines[i]);
+		start = i + 1;
+	}
+
+	last = &rec->events[rec->nevents - 1];
+	ck_assert_int_eq(libinput_memory_advance_clock(li,
+			last->time.tv_sec * 1000000ULL +
+			last->time.tv_usec +
+			GOLDEN_TIMEOUT_MS * 1000ULL),
+			 0);
+	output_collect(out, li, rec->lines[rec->nevents - 1]);
+
+	libinput_unref(li);
+}
+
+static bool
+parse_float(const char *token, double *value)
+{
+	char *end;
+
+	if (!strchr(token, '.'))
+		return false;
+
+	*value = strtod(token, &end);
+
+	return end != token && *end == '\0';
+}
+
+/* Same tokens, except for floats that only need to be close enough */
+static bool
+lines_match(const char *expected, const char *line)
+{
+	char *a, *b, *sa, *sb, *ta, *tb;
+	bool match = true;
+	double da, db;
+
+	a = strdup(expected);
+	b = strdup(line);
+	ck_assert_notnull(a);
+	ck_assert_notnull(b);
+
+	ta = strtok_r(a, " ", &sa);
+	tb = strtok_r(b, " ", &sb);
+	while (match && (ta || tb)) {
+		if (!ta || !tb)
+			match = false;
+		else if (parse_float(ta, &da) && parse_float(tb, &db))
+			match = fabs(da - db) <=
+				GOLDEN_TOLERANCE * max(1.0, fabs(da));
+		else
+			match = strcmp(ta, tb) == 0;
+
+		ta = strtok_r(NULL, " ", &sa);
+		tb = strtok_r(NULL, " ", &sb);
+	}
+
+	free(a);
+	free(b);
+
+	return match;
+}
+
+static void
+golden_write(const char *path, const struct output *out)
+{
+	FILE *fp;
+	size_t i;
+
+	fp = fopen(path, "w");
+	ck_assert_msg(fp != NULL, "Failed to open %s: %s", path, strerror(errno));
+	for (i = 0; i < out->nlines; i++)
+		fprintf(fp, "%s\n", out->lines[i]);
+	fclose(fp);
+}
+
+static void
+golden_compare(const char *name, const char *path, const struct output *out)
+{
+	char buf[1024];
+	FILE *fp;
+	size_t line = 0;
+
+	fp = fopen(path, "r");
+	ck_assert_msg(fp != NULL, "Failed to open %s: %s", path, strerror(errno));
+
+	while (fgets(buf, sizeof(buf), fp)) {
+		buf[strcspn(buf, "\n")] = '\0';
+
+		ck_assert_msg(line < out->nlines,
+			      "%s.golden:%zu: expected '%s', got end of output",
+			      name, line + 1, buf);
+		ck_assert_msg(lines_match(buf, out->lines[line]),
+			      "%s.golden:%zu: expected '%s', got '%s' "
+			      "(after %s.evemu:%d)",
+			      name, line + 1, buf, out->lines[line],
+			      name, out->source[line]);
+		line++;
+	}
+
+	fclose(fp);
+
+	ck_assert_msg(line == out->nlines,
+		      "%s.golden:%zu: expected end of output, got '%s' "
+		      "(after %s.evemu:%d)",
+		      name, line + 1, out->lines[line],
+		      name, out->source[line]);
+}
+
+static void
+golden_run(const char *name)
+{
+	struct golden_recording rec;
+	struct output out;
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s/%s.evemu", GOLDEN_DIR, name);
+	golden_recording_parse(&rec, path);
+	replay(&rec, &out);
+
+	snprintf(path, sizeof(path), "%s/%s.golden", GOLDEN_DIR, name);
+	if (getenv("LITEST_GOLDEN_UPDATE"))
+		golden_write(path, &out);
+	else
+		golden_compare(name, path, &out);
+
+	output_destroy(&out);
+	golden_recording_destroy(&rec);
+}
+
+START_TEST(golden_synaptics)
+{
+	golden_run("synaptics");
+}
+END_TEST
+
+START_TEST(golden_synaptics_st)
+{
+	golden_run("synaptics-st");
+}
+END_TEST
+
+START_TEST(golden_synaptics_t440)
+{
+	golden_run("synaptics-t440");
+}
+END_TEST
+
+START_TEST(golden_bcm5974)
+{
+	golden_run("bcm5974");
+}
+END_TEST
+
+START_TEST(golden_alps_semi_mt)
+{
+	golden_run("alps-semi-mt");
+}
+END_TEST
+
+START_TEST(golden_wacom_touch)
+{
+	golden_run("wacom-touch");
+}
+END_TEST
+
+START_TEST(golden_protocol_a_screen)
+{
+	golden_run("protocol-a-screen");
+}
+END_TEST
+
+START_TEST(golden_generic_singletouch)
+{
+	golden_run("generic-singletouch");
+}
+END_TEST
+
+START_TEST(golden_trackpoint)
+{
+	golden_run("trackpoint");
+}
+END_TEST
+
+START_TEST(golden_mouse)
+{
+	golden_run("mouse");
+}
+END_TEST
+
+START_TEST(golden_ms_surface_cover)
+{
+	golden_run("ms-surface-cover");
+}
+END_TEST
+
+START_TEST(golden_keyboard)
+{
+	golden_run("keyboard");
+}
+END_TEST
+
+START_TEST(golden_qemu_tablet)
+{
+	golden_run("qemu-tablet");
+}
+END_TEST
+
+START_TEST(golden_xen_virtual_pointer)
+{
+	golden_run("xen-virtual-pointer");
+}
+END_TEST
+
+START_TEST(golden_vmware_virtmouse)
+{
+	golden_run("vmware-virtmouse");
+}
+END_TEST
+
+int
+main(int argc, char **argv)
+{
+	litest_add_no_device("golden:touchpad", golden_synaptics);
+	litest_add_no_device("golden:touchpad", golden_synaptics_st);
+	litest_add_no_device("golden:touchpad", golden_synaptics_t440);
+	litest_add_no_device("golden:touchpad", golden_bcm5974);
+	litest_add_no_device("golden:touchpad", golden_alps_semi_mt);
+	litest_add_no_device("golden:touch", golden_wacom_touch);
+	litest_add_no_device("golden:touch", golden_protocol_a_screen);
+	litest_add_no_device("golden:touch", golden_generic_singletouch);
+	litest_add_no_device("golden:pointer", golden_trackpoint);
+	litest_add_no_device("golden:pointer", golden_mouse);
+	litest_add_no_device("golden:pointer", golden_qemu_tablet);
+	litest_add_no_device("golden:pointer", golden_xen_virtual_pointer);
+	litest_add_no_device("golden:pointer", golden_vmware_virtmouse);
+	litest_add_no_device("golden:keyboard", golden_keyboard);
+	litest_add_no_device("golden:keyboard", golden_ms_surface_cover);
+
+	return litest_run(argc, argv);
+}
@@ -290,12 +290,77 @@ START_TEST(keyboard_key_auto_release)
 }
 END_TEST
 
+START_TEST(keyboard_ignore_key_repeat)
+{
+	struct litest_device *dev = litest_current_device();
+	struct libinput *li = dev->libinput;
+
+	litest_drain_events(li);
+
+	test_key_event(dev, KEY_A, 1);
+
+	litest_event(dev, EV_KEY, KEY_A, 2);
+	litest_event(dev, EV_SYN, SYN_REPORT, 0);
+	litest_event(dev, EV_KEY, KEY_A, 2);
+	litest_event(dev, EV_SYN, SYN_REPORT, 0);
+	libinput_dispatch(li);
+	litest_assert_empty_queue(li);
+
+	test_key_event(dev, KEY_A, 0);
+	litest_assert_empty_queue(li);
+}
+END_TEST
+
+START_TEST(keyboard_with_wheel)
+{
+	struct libinput *libinput;
+	struct litest_device *dev;
+	struct libinput_event *event;
+	struct libinput_event_pointer *ptrev;
+	int events[] = {
+		EV_REL, REL_WHEEL,
+		-1, -1,
+	};
+
+	/* Multimedia keyboards with a wheel must still send axis events */
+	libinput = litest_create_context();
+	dev = litest_add_device_with_overrides(libinput,
+					       LITEST_KEYBOARD,
+					       "Generic keyboard with wheel",
+					       NULL, NULL, events);
+	litest_drain_events(libinput);
+
+	test_key_event(dev, KEY_A, 1);
+	test_key_event(dev, KEY_A, 0);
+
+	litest_event(dev, EV_REL, REL_WHEEL, -1);
+	litest_event(dev, EV_SYN, SYN_REPORT, 0);
+	libinput_dispatch(libinput);
+
+	event = libinput_get_event(libinput);
+	ck_assert_notnull(event);
+	ck_assert_int_eq(libinput_event_get_type(event),
+			 LIBINPUT_EVENT_POINTER_AXIS);
+	ptrev = libinput_event_get_pointer_event(event);
+	ck_assert_int_eq(libinput_event_pointer_get_axis(ptrev),
+			 LIBINPUT_POINTER_AXIS_SCROLL_VERTICAL);
+	ck_assert_int_gt(libinput_event_pointer_get_axis_value(ptrev), 0);
+	libinput_event_destroy(event);
+
+	litest_assert_empty_queue(libinput);
+	litest_delete_device(dev);
+	libinput_unref(libinput);
+}
+END_TEST
+
 int
 main(int argc, char **argv)
 {
 	litest_add_no_device("keyboard:seat key count", keyboard_seat_key_count);
 	litest_add_no_device("keyboard:key counting", keyboard_ignore_no_pressed_release);
 	litest_add_no_device("keyboard:key counting", keyboard_key_auto_release);
+	litest_add_for_device("keyboard:key repeat", keyboard_ignore_key_repeat, LITEST_KEYBOARD);
+	litest_add_no_device("keyboard:wheel", keyboard_with_wheel);
 
 	return litest_run(argc, argv);
 }
@@ -0,0 +1,201 @@
+/*
+ * Copyright © 2015 Red Hat, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <assert.h>
+
+#include "libinput-util.h"
+
+#include "litest.h"
+#include "litest-int.h"
+
+#define PROTOCOL_A_MAX_TOUCHES 10
+
+/* A Protocol A device has no slots and sends all current contacts in
+ * every frame, each one terminated by a SYN_MT_REPORT. We keep track of
+ * the touches the tests set so we can resend them with every frame. */
+struct protocol_a {
+	struct {
+		bool active;
+		double x, y;
+	} touches[PROTOCOL_A_MAX_TOUCHES];
+};
+
+static void protocol_a_create(struct litest_device *d);
+
+static void
+litest_protocol_a_setup(void)
+{
+	struct litest_device *d = litest_create_device(LITEST_PROTOCOL_A_SCREEN);
+	litest_set_current_device(d);
+}
+
+static void
+send_frame(struct litest_device *d)
+{
+	struct protocol_a *pa = d->private;
+	struct input_event e = {
+		.type = EV_ABS,
+		.value = LITEST_AUTO_ASSIGN,
+	};
+	bool first = true;
+	unsigned int i;
+	double x, y;
+
+	for (i = 0; i < ARRAY_LENGTH(pa->touches); i++) {
+		if (!pa->touches[i].active)
+			continue;
+
+		x = pa->touches[i].x;
+		y = pa->touches[i].y;
+
+		/* the single-touch axes follow the first contact */
+		if (first) {
+			e.code = ABS_X;
+			litest_event(d, EV_ABS, ABS_X,
+				     litest_auto_assign_value(d, &e, 0, x, y));
+			e.code = ABS_Y;
+			litest_event(d, EV_ABS, ABS_Y,
+				     litest_auto_assign_value(d, &e, 0, x, y));
+			first = false;
+		}
+
+		e.code = ABS_MT_POSITION_X;
+		litest_event(d, EV_ABS, ABS_MT_POSITION_X,
+			     litest_auto_assign_value(d, &e, 0, x, y));
+		e.code = ABS_MT_POSITION_Y;
+		litest_event(d, EV_ABS, ABS_MT_POSITION_Y,
+			     litest_auto_assign_value(d, &e, 0, x, y));
+		litest_event(d, EV_SYN, SYN_MT_REPORT, 0);
+	}
+
+	/* an empty frame still has its SYN_MT_REPORT */
+	if (first)
+		litest_event(d, EV_SYN, SYN_MT_REPORT, 0);
+
+	litest_event(d, EV_SYN, SYN_REPORT, 0);
+}
+
+static void
+protocol_a_touch_down(struct litest_device *d,
+		      unsigned int slot,
+		      double x,
+		      double y)
+{
+	struct protocol_a *pa = d->private;
+
+	assert(slot < ARRAY_LENGTH(pa->touches));
+
+	pa->touches[slot].active = true;
+	pa->touches[slot].x = x;
+	pa->touches[slot].y = y;
+
+	send_frame(d);
+}
+
+static void
+protocol_a_touch_move(struct litest_device *d,
+		      unsigned int slot,
+		      double x,
+		      double y)
+{
+	struct protocol_a *pa = d->private;
+
+	assert(slot < ARRAY_LENGTH(pa->touches));
+
+	pa->touches[slot].x = x;
+	pa->touches[slot].y = y;
+
+	send_frame(d);
+}
+
+static void
+protocol_a_touch_up(struct litest_device *d, unsigned int slot)
+{
+	struct protocol_a *pa = d->private;
+
+	assert(slot < ARRAY_LENGTH(pa->touches));
+
+	pa->touches[slot].active = false;
+
+	send_frame(d);
+}
+
+static struct litest_device_interface interface = {
+	.touch_down = protocol_a_touch_down,
+	.touch_move = protocol_a_touch_move,
+	.touch_up = protocol_a_touch_up,
+};
+
+static struct input_absinfo absinfo[] = {
+	{ ABS_X, 0, 32767, 0, 0, 0 },
+	{ ABS_Y, 0, 32767, 0, 0, 0 },
+	{ ABS_MT_POSITION_X, 0, 32767, 0, 0, 0 },
+	{ ABS_MT_POSITION_Y, 0, 32767, 0, 0, 0 },
+	{ ABS_MT_TRACKING_ID, 0, 65535, 0, 0, 0 },
+	{ .value = -1 },
+};
+
+static struct input_id input_id = {
+	.bustype = 0x18,
+	.vendor = 0xeef,
+	.product = 0x20,
+};
+
+static int events[] = {
+	EV_KEY, BTN_TOUCH,
+	INPUT_PROP_MAX, INPUT_PROP_DIRECT,
+	-1, -1,
+};
+
+struct litest_test_device litest_protocol_a_screen_device = {
+	.type = LITEST_PROTOCOL_A_SCREEN,
+	.features = LITEST_TOUCH,
+	.shortname = "protocol-a",
+	.setup = litest_protocol_a_setup,
+	.interface = &interface,
+	.create = protocol_a_create,
+
+	.name = "Protocol A touch screen",
+	.id = &input_id,
+	.events = events,
+	.absinfo = absinfo,
+};
+
+static void
+protocol_a_create(struct litest_device *d)
+{
+	struct protocol_a *pa = zalloc(sizeof(*pa));
+	assert(pa);
+
+	d->private = pa;
+
+	d->uinput = litest_create_uinput_device_from_description(
+				litest_protocol_a_screen_device.name,
+				litest_protocol_a_screen_device.id,
+				absinfo,
+				events);
+	d->interface = &interface;
+}
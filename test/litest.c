@@ -29,6 +29,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <limits.h>
 #include <poll.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -37,6 +38,7 @@
 #include <unistd.h>
 #include "linux/input.h"
 #include <sys/ptrace.h>
+#include <sys/stat.h>
 #include <sys/timerfd.h>
 #include <sys/wait.h>
 
@@ -46,6 +48,23 @@
 
 static int in_debugger = -1;
 static int verbose = 0;
+static int jobs = 0;
+
+#define UDEV_RULES_D "/run/udev/rules.d"
+#define UDEV_SEAT_PREFIX "litest-seat-"
+
+/* Every uinput device litest creates has its phys set to
+ * "litest-seat-<pid>" and this rule copies that into ID_SEAT. Each test
+ * process thus gets a seat of its own and neither the udev contexts in
+ * other tests nor the session on seat0 ever see our devices. */
+static const char udev_seat_rule[] =
+	"ACTION==\"remove\", GOTO=\"litest_seat_end\"\n"
+	"KERNEL!=\"event[0-9]*\", GOTO=\"litest_seat_end\"\n"
+	"ATTRS{phys}==\"" UDEV_SEAT_PREFIX "*\", ENV{ID_SEAT}=\"$attr{phys}\"\n"
+	"LABEL=\"litest_seat_end\"\n";
+
+static char udev_rules_file[PATH_MAX];
+static pid_t udev_rules_owner;
 
 struct test {
 	struct list node;
@@ -90,6 +109,7 @@ extern struct litest_test_device litest_generic_singletouch_device;
 extern struct litest_test_device litest_qemu_tablet_device;
 extern struct litest_test_device litest_xen_virtual_pointer_device;
 extern struct litest_test_device litest_vmware_virtmouse_device;
+extern struct litest_test_device litest_protocol_a_screen_device;
 
 struct litest_test_device* devices[] = {
 	&litest_synaptics_clickpad_device,
@@ -105,6 +125,7 @@ struct litest_test_device* devices[] = {
 	&litest_qemu_tablet_device,
 	&litest_xen_virtual_pointer_device,
 	&litest_vmware_virtmouse_device,
+	&litest_protocol_a_screen_device,
 	NULL,
 };
 
@@ -324,9 +345,163 @@ struct libinput_interface interface = {
 	.close_restricted = close_restricted,
 };
 
+static int
+reload_udev_rules(void)
+{
+	int rc;
+
+	rc = system("udevadm control --reload-rules");
+	if (rc == -1 || !WIFEXITED(rc) || WEXITSTATUS(rc) != 0)
+		return -1;
+
+	return 0;
+}
+
+static bool
+install_udev_rules(void)
+{
+	FILE *f;
+	int rc;
+
+	if (mkdir(UDEV_RULES_D, 0755) == -1 && errno != EEXIST)
+		return false;
+
+	snprintf(udev_rules_file, sizeof(udev_rules_file),
+		 "%s/91-%s%d.rules", UDEV_RULES_D, UDEV_SEAT_PREFIX, getpid());
+
+	f = fopen(udev_rules_file, "w");
+	if (!f)
+		return false;
+
+	rc = fputs(udev_seat_rule, f);
+	if (fclose(f) != 0 || rc == EOF || reload_udev_rules() != 0) {
+		unlink(udev_rules_file);
+		return false;
+	}
+
+	udev_rules_owner = getpid();
+
+	return true;
+}
+
+static void
+remove_udev_rules(void)
+{
+	/* forked test cases inherit the state but don't own the file */
+	if (udev_rules_owner == 0 || udev_rules_owner != getpid())
+		return;
+
+	unlink(udev_rules_file);
+	reload_udev_rules();
+	udev_rules_owner = 0;
+}
+
+const char *
+litest_udev_seat(void)
+{
+	static char seat[64];
+
+	if (udev_rules_owner == 0)
+		return "seat0";
+
+	snprintf(seat, sizeof(seat), "%s%d", UDEV_SEAT_PREFIX, getpid());
+
+	return seat;
+}
+
+/* Runs every max_jobs'th suite, starting at suite index job */
+static int
+litest_run_suites(struct list *tests, int job, int max_jobs)
+{
+	struct suite *s;
+	SRunner *sr = NULL;
+	int idx = 0;
+	int failed;
+
+	list_for_each(s, tests, node) {
+		if (idx++ % max_jobs != job)
+			continue;
+
+		if (!sr)
+			sr = srunner_create(s->suite);
+		else
+			srunner_add_suite(sr, s->suite);
+	}
+
+	if (!sr)
+		return 0;
+
+	srunner_run_all(sr, CK_ENV);
+	failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	return failed;
+}
+
+static int
+litest_fork_suites(struct list *tests, int max_jobs)
+{
+	int failed = 0;
+	int status;
+	pid_t pid;
+	int job;
+
+	for (job = 0; job < max_jobs; job++) {
+		pid = fork();
+		if (pid == 0) {
+			failed = litest_run_suites(tests, job, max_jobs);
+			exit(min(failed, 255));
+		} else if (pid == -1) {
+			failed += litest_run_suites(tests, job, max_jobs);
+		}
+	}
+
+	while ((pid = wait(&status)) != -1 || errno == EINTR) {
+		if (pid == -1)
+			continue;
+
+		if (WIFEXITED(status))
+			failed += WEXITSTATUS(status);
+		else
+			failed++;
+	}
+
+	return failed;
+}
+
+static int
+litest_get_jobs(struct list *tests)
+{
+	struct suite *s;
+	const char *env;
+	int nsuites = 0;
+	int n = jobs;
+
+	env = getenv("CK_FORK");
+	if (env && strcmp(env, "no") == 0)
+		return 1;
+
+	/* without a seat of our own the udev tests see each other's
+	 * devices */
+	if (udev_rules_owner == 0)
+		return 1;
+
+	env = getenv("LITEST_JOBS");
+	if (n == 0 && env)
+		n = atoi(env);
+	if (n <= 0)
+		n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	list_for_each(s, tests, node)
+		nsuites++;
+
+	return max(1, min(n, nsuites));
+}
+
 static const struct option opts[] = {
 	{ "list", 0, 0, 'l' },
 	{ "verbose", 0, 0, 'v' },
+	{ "jobs", 1, 0, 'j' },
 	{ 0, 0, 0, 0}
 };
 
@@ -334,7 +509,7 @@ int
 litest_run(int argc, char **argv) {
 	struct suite *s, *snext;
 	int failed;
-	SRunner *sr = NULL;
+	int max_jobs;
 
 	if (in_debugger == -1) {
 		in_debugger = is_debugger_attached();
@@ -342,18 +517,11 @@ litest_run(int argc, char **argv) {
 			setenv("CK_FORK", "no", 0);
 	}
 
-	list_for_each(s, &all_tests, node) {
-		if (!sr)
-			sr = srunner_create(s->suite);
-		else
-			srunner_add_suite(sr, s->suite);
-	}
-
 	while(1) {
 		int c;
 		int option_index = 0;
 
-		c = getopt_long(argc, argv, "", opts, &option_index);
+		c = getopt_long(argc, argv, "j:", opts, &option_index);
 		if (c == -1)
 			break;
 		switch(c) {
@@ -363,16 +531,28 @@ litest_run(int argc, char **argv) {
 			case 'v':
 				verbose = 1;
 				break;
+			case 'j':
+				jobs = atoi(optarg);
+				break;
 			default:
-				fprintf(stderr, "usage: %s [--list]\n", argv[0]);
+				fprintf(stderr, "usage: %s [--list] [--jobs N]\n", argv[0]);
 				return 1;
 
 		}
 	}
 
-	srunner_run_all(sr, CK_ENV);
-	failed = srunner_ntests_failed(sr);
-	srunner_free(sr);
+	if (!install_udev_rules())
+		fprintf(stderr,
+			"litest: failed to install %s, test devices are on seat0\n",
+			udev_rules_file[0] ? udev_rules_file : UDEV_RULES_D);
+
+	max_jobs = litest_get_jobs(&all_tests);
+	if (max_jobs > 1)
+		failed = litest_fork_suites(&all_tests, max_jobs);
+	else
+		failed = litest_run_suites(&all_tests, 0, 1);
+
+	remove_udev_rules();
 
 	list_for_each_safe(s, snext, &all_tests, node) {
 		struct test *t, *tnext;
@@ -1042,6 +1222,8 @@ litest_create_uinput_device_from_description(const char *name,
 
 	snprintf(buf, sizeof(buf), "litest %s", name);
 	libevdev_set_name(dev, buf);
+	if (udev_rules_owner != 0)
+		libevdev_set_phys(dev, litest_udev_seat());
 	if (id) {
 		libevdev_set_id_bustype(dev, id->bustype);
 		libevdev_set_id_vendor(dev, id->vendor);
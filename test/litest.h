@@ -49,6 +49,7 @@ enum litest_device_type {
 	LITEST_QEMU_TABLET = -13,
 	LITEST_XEN_VIRTUAL_POINTER = -14,
 	LITEST_VMWARE_VIRTMOUSE = -15,
+	LITEST_PROTOCOL_A_SCREEN = -16,
 };
 
 enum litest_device_feature {
@@ -85,6 +86,7 @@ struct litest_device {
 };
 
 struct libinput *litest_create_context(void);
+const char *litest_udev_seat(void);
 
 void litest_add(const char *name, void *func,
 		enum litest_device_feature required_feature,
@@ -0,0 +1,152 @@
+/*
+ * Copyright © 2015 Red Hat, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <check.h>
+#include <errno.h>
+#include <libevdev/libevdev.h>
+#include <libinput.h>
+#include <libinput-util.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "litest.h"
+
+static int open_restricted(const char *path, int flags, void *data)
+{
+	ck_abort_msg("open_restricted called for %s", path);
+	return -ENODEV;
+}
+static void close_restricted(int fd, void *data)
+{
+	ck_abort_msg("close_restricted called for %d", fd);
+}
+
+static const struct libinput_interface simple_interface = {
+	.open_restricted = open_restricted,
+	.close_restricted = close_restricted,
+};
+
+static struct libevdev *
+mouse_description(void)
+{
+	struct libevdev *evdev;
+
+	evdev = libevdev_new();
+	ck_assert(evdev != NULL);
+
+	libevdev_set_name(evdev, "memory test mouse");
+	libevdev_set_id_bustype(evdev, BUS_USB);
+	libevdev_enable_event_code(evdev, EV_REL, REL_X, NULL);
+	libevdev_enable_event_code(evdev, EV_REL, REL_Y, NULL);
+	libevdev_enable_event_code(evdev, EV_KEY, BTN_LEFT, NULL);
+	libevdev_enable_event_code(evdev, EV_KEY, BTN_RIGHT, NULL);
+
+	return evdev;
+}
+
+static void
+set_event(struct input_event *ev,
+	  unsigned int type,
+	  unsigned int code,
+	  int value)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	ev->time.tv_sec = ts.tv_sec;
+	ev->time.tv_usec = ts.tv_nsec / 1000;
+	ev->type = type;
+	ev->code = code;
+	ev->value = value;
+}
+
+START_TEST(memory_stats)
+{
+	struct libinput *li;
+	struct libinput_device *device;
+	struct libinput_event *event;
+	struct libevdev *evdev;
+	struct input_event events[2];
+	struct libinput_memory_stats before, ev_before, stats;
+
+	ck_assert_int_eq(libinput_get_memory_stats(LIBINPUT_MEMORY_TAG_DEVICE,
+						   &before), 0);
+	ck_assert_int_eq(libinput_get_memory_stats(LIBINPUT_MEMORY_TAG_CONTEXT + 1,
+						   &stats),
+			 -EINVAL);
+
+	li = libinput_memory_create_context(&simple_interface, NULL);
+	evdev = mouse_description();
+	device = libinput_memory_add_device(li, evdev);
+	libevdev_free(evdev);
+	ck_assert(device != NULL);
+	litest_drain_events(li);
+
+	ck_assert_int_eq(libinput_get_memory_stats(LIBINPUT_MEMORY_TAG_DEVICE,
+						   &stats), 0);
+	ck_assert_int_gt(stats.live_bytes, before.live_bytes);
+	ck_assert_int_gt(stats.allocations, before.allocations);
+	ck_assert_int_ge(stats.peak_bytes, stats.live_bytes);
+
+	/* one allocation per queued event, gone once the event is */
+	libinput_get_memory_stats(LIBINPUT_MEMORY_TAG_EVENT, &ev_before);
+	set_event(&events[0], EV_REL, REL_X, 5);
+	set_event(&events[1], EV_SYN, SYN_REPORT, 0);
+	ck_assert_int_eq(libinput_memory_device_inject(device, events, 2), 0);
+
+	libinput_get_memory_stats(LIBINPUT_MEMORY_TAG_EVENT, &stats);
+	ck_assert_int_eq(stats.allocations, ev_before.allocations + 1);
+	ck_assert_int_gt(stats.live_bytes, ev_before.live_bytes);
+
+	event = libinput_get_event(li);
+	ck_assert(event != NULL);
+	libinput_event_destroy(event);
+	libinput_get_memory_stats(LIBINPUT_MEMORY_TAG_EVENT, &stats);
+	ck_assert_int_eq(stats.live_bytes, ev_before.live_bytes);
+
+	libinput_unref(li);
+
+	ck_assert_int_eq(libinput_get_memory_stats(LIBINPUT_MEMORY_TAG_DEVICE,
+						   &stats), 0);
+	ck_assert_int_eq(stats.live_bytes, before.live_bytes);
+}
+END_TEST
+
+int
+main(int argc, char **argv)
+{
+	struct libinput_memory_stats stats;
+
+	/* 77 tells automake the test was skipped */
+	if (libinput_get_memory_stats(LIBINPUT_MEMORY_TAG_CONTEXT,
+				      &stats) == -ENOSYS) {
+		fprintf(stderr,
+			"libinput built without --enable-memory-stats\n");
+		return 77;
+	}
+
+	litest_add_no_device("memory:stats", memory_stats);
+
+	return litest_run(argc, argv);
+}
@@ -0,0 +1,486 @@
+/*
+ * Copyright © 2015 Red Hat, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <check.h>
+#include <errno.h>
+#include <libevdev/libevdev.h>
+#include <libinput.h>
+#include <libinput-util.h>
+#include <time.h>
+
+#include "litest.h"
+
+static int open_restricted(const char *path, int flags, void *data)
+{
+	ck_abort_msg("open_restricted called for %s", path);
+	return -ENODEV;
+}
+static void close_restricted(int fd, void *data)
+{
+	ck_abort_msg("close_restricted called for %d", fd);
+}
+
+const struct libinput_interface simple_interface = {
+	.open_restricted = open_restricted,
+	.close_restricted = close_restricted,
+};
+
+static struct libevdev *
+mouse_description(void)
+{
+	struct libevdev *evdev;
+
+	evdev = libevdev_new();
+	ck_assert(evdev != NULL);
+
+	libevdev_set_name(evdev, "memory test mouse");
+	libevdev_set_id_bustype(evdev, BUS_USB);
+	libevdev_enable_event_code(evdev, EV_REL, REL_X, NULL);
+	libevdev_enable_event_code(evdev, EV_REL, REL_Y, NULL);
+	libevdev_enable_event_code(evdev, EV_KEY, BTN_LEFT, NULL);
+	libevdev_enable_event_code(evdev, EV_KEY, BTN_RIGHT, NULL);
+
+	return evdev;
+}
+
+static struct libevdev *
+touchpad_description(void)
+{
+	struct libevdev *evdev;
+	struct input_absinfo abs[] = {
+		{ ABS_X, 1024, 5112, 0, 0, 42 },
+		{ ABS_Y, 2024, 4832, 0, 0, 42 },
+		{ ABS_MT_SLOT, 0, 1, 0, 0, 0 },
+		{ ABS_MT_POSITION_X, 1024, 5112, 0, 0, 42 },
+		{ ABS_MT_POSITION_Y, 2024, 4832, 0, 0, 42 },
+		{ ABS_MT_TRACKING_ID, 0, 65535, 0, 0, 0 },
+	};
+	struct input_absinfo *a;
+
+	evdev = libevdev_new();
+	ck_assert(evdev != NULL);
+
+	libevdev_set_name(evdev, "memory test touchpad");
+	libevdev_set_id_bustype(evdev, BUS_I8042);
+	ARRAY_FOR_EACH(abs, a) {
+		struct input_absinfo info = *a;
+
+		/* the code is in .value, see litest */
+		info.value = 0;
+		libevdev_enable_event_code(evdev, EV_ABS, a->value, &info);
+	}
+	libevdev_enable_event_code(evdev, EV_KEY, BTN_LEFT, NULL);
+	libevdev_enable_event_code(evdev, EV_KEY, BTN_RIGHT, NULL);
+	libevdev_enable_event_code(evdev, EV_KEY, BTN_TOOL_FINGER, NULL);
+	libevdev_enable_event_code(evdev, EV_KEY, BTN_TOOL_DOUBLETAP, NULL);
+	libevdev_enable_event_code(evdev, EV_KEY, BTN_TOUCH, NULL);
+	libevdev_enable_property(evdev, INPUT_PROP_POINTER);
+
+	return evdev;
+}
+
+static void
+set_event(struct input_event *ev,
+	  unsigned int type,
+	  unsigned int code,
+	  int value)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	ev->time.tv_sec = ts.tv_sec;
+	ev->time.tv_usec = ts.tv_nsec / 1000;
+	ev->type = type;
+	ev->code = code;
+	ev->value = value;
+}
+
+START_TEST(memory_create_NULL)
+{
+	struct libinput *li;
+
+	li = libinput_memory_create_context(NULL, NULL);
+	ck_assert(li == NULL);
+	li = libinput_memory_create_context(&simple_interface, NULL);
+	ck_assert(li != NULL);
+	libinput_unref(li);
+}
+END_TEST
+
+START_TEST(memory_add_device)
+{
+	struct libinput *li;
+	struct libinput_device *device;
+	struct libinput_event *event;
+	struct libevdev *evdev;
+
+	li = libinput_memory_create_context(&simple_interface, NULL);
+	ck_assert(li != NULL);
+
+	evdev = mouse_description();
+	device = libinput_memory_add_device(li, evdev);
+	/* the context keeps its own copy */
+	libevdev_free(evdev);
+	ck_assert(device != NULL);
+
+	ck_assert_str_eq(libinput_device_get_name(device),
+			 "memory test mouse");
+	ck_assert_str_eq(libinput_device_get_sysname(device), "virtual0");
+	ck_assert(libinput_device_get_udev_device(device) == NULL);
+	ck_assert(libinput_device_has_capability(device,
+						 LIBINPUT_DEVICE_CAP_POINTER));
+
+	libinput_dispatch(li);
+	event = libinput_get_event(li);
+	ck_assert_int_eq(libinput_event_get_type(event),
+			 LIBINPUT_EVENT_DEVICE_ADDED);
+	ck_assert(libinput_event_get_device(event) == device);
+	libinput_event_destroy(event);
+
+	libinput_memory_remove_device(device);
+	libinput_dispatch(li);
+	event = libinput_get_event(li);
+	ck_assert_int_eq(libinput_event_get_type(event),
+			 LIBINPUT_EVENT_DEVICE_REMOVED);
+	libinput_event_destroy(event);
+
+	litest_assert_empty_queue(li);
+	libinput_unref(li);
+}
+END_TEST
+
+START_TEST(memory_inject_motion)
+{
+	struct libinput *li;
+	struct libinput_device *device;
+	struct libinput_event *event;
+	struct libinput_event_pointer *ptrev;
+	struct libevdev *evdev;
+	struct input_event events[3];
+
+	li = libinput_memory_create_context(&simple_interface, NULL);
+	evdev = mouse_description();
+	device = libinput_memory_add_device(li, evdev);
+	libevdev_free(evdev);
+	ck_assert(device != NULL);
+	libinput_device_ref(device);
+	litest_drain_events(li);
+
+	set_event(&events[0], EV_REL, REL_X, 5);
+	set_event(&events[1], EV_REL, REL_Y, -3);
+	set_event(&events[2], EV_SYN, SYN_REPORT, 0);
+	ck_assert_int_eq(libinput_memory_device_inject(device, events, 3), 0);
+
+	/* processed without a dispatch */
+	event = libinput_get_event(li);
+	ck_assert(event != NULL);
+	ck_assert_int_eq(libinput_event_get_type(event),
+			 LIBINPUT_EVENT_POINTER_MOTION);
+	ptrev = libinput_event_get_pointer_event(event);
+	/* the first motion event has no velocity and is accelerated to 0 */
+	ck_assert(libinput_event_pointer_get_dx_unaccelerated(ptrev) > 0);
+	ck_assert(libinput_event_pointer_get_dy_unaccelerated(ptrev) < 0);
+	libinput_event_destroy(event);
+	litest_assert_empty_queue(li);
+
+	set_event(&events[0], EV_SYN, SYN_DROPPED, 0);
+	ck_assert_int_eq(libinput_memory_device_inject(device, events, 1),
+			 -EINVAL);
+
+	set_event(&events[0], EV_KEY, BTN_LEFT, 1);
+	set_event(&events[1], EV_SYN, SYN_REPORT, 0);
+	ck_assert_int_eq(libinput_memory_device_inject(device, events, 2), 0);
+	litest_assert_button_event(li, BTN_LEFT,
+				   LIBINPUT_BUTTON_STATE_PRESSED);
+
+	/* removing the device releases the button */
+	libinput_memory_remove_device(device);
+	litest_assert_button_event(li, BTN_LEFT,
+				   LIBINPUT_BUTTON_STATE_RELEASED);
+	litest_drain_events(li);
+
+	set_event(&events[0], EV_REL, REL_X, 5);
+	set_event(&events[1], EV_SYN, SYN_REPORT, 0);
+	ck_assert_int_eq(libinput_memory_device_inject(device, events, 2),
+			 -ENODEV);
+	litest_assert_empty_queue(li);
+
+	libinput_device_unref(device);
+	libinput_unref(li);
+}
+END_TEST
+
+START_TEST(memory_inject_tap)
+{
+	struct libinput *li;
+	struct libinput_device *device;
+	struct libevdev *evdev;
+	struct input_event events[16];
+	size_t n = 0;
+
+	li = libinput_memory_create_context(&simple_interface, NULL);
+	evdev = touchpad_description();
+	device = libinput_memory_add_device(li, evdev);
+	libevdev_free(evdev);
+	ck_assert(device != NULL);
+	ck_assert(libinput_device_config_tap_get_finger_count(device) > 0);
+	libinput_device_config_tap_set_enabled(device,
+					       LIBINPUT_CONFIG_TAP_ENABLED);
+	litest_drain_events(li);
+
+	set_event(&events[n++], EV_ABS, ABS_MT_SLOT, 0);
+	set_event(&events[n++], EV_ABS, ABS_MT_TRACKING_ID, 1);
+	set_event(&events[n++], EV_ABS, ABS_MT_POSITION_X, 3000);
+	set_event(&events[n++], EV_ABS, ABS_MT_POSITION_Y, 3000);
+	set_event(&events[n++], EV_ABS, ABS_X, 3000);
+	set_event(&events[n++], EV_ABS, ABS_Y, 3000);
+	set_event(&events[n++], EV_KEY, BTN_TOOL_FINGER, 1);
+	set_event(&events[n++], EV_KEY, BTN_TOUCH, 1);
+	set_event(&events[n++], EV_SYN, SYN_REPORT, 0);
+	set_event(&events[n++], EV_ABS, ABS_MT_TRACKING_ID, -1);
+	set_event(&events[n++], EV_KEY, BTN_TOOL_FINGER, 0);
+	set_event(&events[n++], EV_KEY, BTN_TOUCH, 0);
+	set_event(&events[n++], EV_SYN, SYN_REPORT, 0);
+	ck_assert_int_eq(libinput_memory_device_inject(device, events, n), 0);
+
+	libinput_dispatch(li);
+	litest_assert_button_event(li, BTN_LEFT,
+				   LIBINPUT_BUTTON_STATE_PRESSED);
+	litest_timeout_tap();
+	litest_assert_button_event(li, BTN_LEFT,
+				   LIBINPUT_BUTTON_STATE_RELEASED);
+	litest_assert_empty_queue(li);
+
+	libinput_unref(li);
+}
+END_TEST
+
+static void
+set_event_at(struct input_event *ev,
+	     uint64_t time,
+	     unsigned int type,
+	     unsigned int code,
+	     int value)
+{
+	ev->time.tv_sec = time / 1000000;
+	ev->time.tv_usec = time % 1000000;
+	ev->type = type;
+	ev->code = code;
+	ev->value = value;
+}
+
+START_TEST(memory_event_clock_tap)
+{
+	struct libinput *li;
+	struct libinput_device *device;
+	struct libevdev *evdev;
+	struct input_event events[16];
+	uint64_t t = 5000000; /* nowhere near the real clock */
+	size_t n = 0;
+
+	li = libinput_memory_create_context(&simple_interface, NULL);
+	ck_assert_int_eq(libinput_memory_advance_clock(li, t), -EINVAL);
+	ck_assert_int_eq(libinput_memory_set_event_clock(li, 1), 0);
+
+	evdev = touchpad_description();
+	device = libinput_memory_add_device(li, evdev);
+	libevdev_free(evdev);
+	ck_assert(device != NULL);
+	libinput_device_config_tap_set_enabled(device,
+					       LIBINPUT_CONFIG_TAP_ENABLED);
+	litest_drain_events(li);
+
+	set_event_at(&events[n++], t, EV_ABS, ABS_MT_SLOT, 0);
+	set_event_at(&events[n++], t, EV_ABS, ABS_MT_TRACKING_ID, 1);
+	set_event_at(&events[n++], t, EV_ABS, ABS_MT_POSITION_X, 3000);
+	set_event_at(&events[n++], t, EV_ABS, ABS_MT_POSITION_Y, 3000);
+	set_event_at(&events[n++], t, EV_ABS, ABS_X, 3000);
+	set_event_at(&events[n++], t, EV_ABS, ABS_Y, 3000);
+	set_event_at(&events[n++], t, EV_KEY, BTN_TOOL_FINGER, 1);
+	set_event_at(&events[n++], t, EV_KEY, BTN_TOUCH, 1);
+	set_event_at(&events[n++], t, EV_SYN, SYN_REPORT, 0);
+	t += 50000;
+	set_event_at(&events[n++], t, EV_ABS, ABS_MT_TRACKING_ID, -1);
+	set_event_at(&events[n++], t, EV_KEY, BTN_TOOL_FINGER, 0);
+	set_event_at(&events[n++], t, EV_KEY, BTN_TOUCH, 0);
+	set_event_at(&events[n++], t, EV_SYN, SYN_REPORT, 0);
+	ck_assert_int_eq(libinput_memory_device_inject(device, events, n), 0);
+
+	libinput_dispatch(li);
+	litest_assert_button_event(li, BTN_LEFT,
+				   LIBINPUT_BUTTON_STATE_PRESSED);
+	litest_assert_empty_queue(li);
+
+	/* the tap timeout only expires when the event clock says so */
+	ck_assert_int_eq(libinput_memory_advance_clock(li, t + 1000), 0);
+	libinput_dispatch(li);
+	litest_assert_empty_queue(li);
+
+	ck_assert_int_eq(libinput_memory_advance_clock(li, t + 1000000), 0);
+	libinput_dispatch(li);
+	litest_assert_button_event(li, BTN_LEFT,
+				   LIBINPUT_BUTTON_STATE_RELEASED);
+	litest_assert_empty_queue(li);
+
+	libinput_unref(li);
+}
+END_TEST
+
+START_TEST(memory_event_clock_frame_sequence)
+{
+	struct libinput *li;
+	struct libinput_device *device;
+	struct libinput_event *event;
+	struct libinput_event *frame[4];
+	struct libevdev *evdev;
+	struct input_event events[16];
+	uint64_t t = 5000000;
+	uint32_t tap_seq;
+	size_t n = 0;
+
+	li = libinput_memory_create_context(&simple_interface, NULL);
+	ck_assert_int_eq(libinput_memory_set_event_clock(li, 1), 0);
+
+	evdev = touchpad_description();
+	device = libinput_memory_add_device(li, evdev);
+	libevdev_free(evdev);
+	ck_assert(device != NULL);
+	libinput_device_config_tap_set_enabled(device,
+					       LIBINPUT_CONFIG_TAP_ENABLED);
+	litest_drain_events(li);
+
+	set_event_at(&events[n++], t, EV_ABS, ABS_MT_SLOT, 0);
+	set_event_at(&events[n++], t, EV_ABS, ABS_MT_TRACKING_ID, 1);
+	set_event_at(&events[n++], t, EV_ABS, ABS_MT_POSITION_X, 3000);
+	set_event_at(&events[n++], t, EV_ABS, ABS_MT_POSITION_Y, 3000);
+	set_event_at(&events[n++], t, EV_ABS, ABS_X, 3000);
+	set_event_at(&events[n++], t, EV_ABS, ABS_Y, 3000);
+	set_event_at(&events[n++], t, EV_KEY, BTN_TOOL_FINGER, 1);
+	set_event_at(&events[n++], t, EV_KEY, BTN_TOUCH, 1);
+	set_event_at(&events[n++], t, EV_SYN, SYN_REPORT, 0);
+	t += 50000;
+	set_event_at(&events[n++], t, EV_ABS, ABS_MT_TRACKING_ID, -1);
+	set_event_at(&events[n++], t, EV_KEY, BTN_TOOL_FINGER, 0);
+	set_event_at(&events[n++], t, EV_KEY, BTN_TOUCH, 0);
+	set_event_at(&events[n++], t, EV_SYN, SYN_REPORT, 0);
+	ck_assert_int_eq(libinput_memory_device_inject(device, events, n), 0);
+	libinput_dispatch(li);
+
+	ck_assert_int_eq(libinput_get_frame(li, frame, 4), 1);
+	tap_seq = libinput_event_get_frame_sequence(frame[0]);
+	libinput_event_destroy(frame[0]);
+
+	/* The tap timeout expires in the middle of the next frame, as if
+	 * the frame was split across two reads. The button release is not
+	 * part of that frame. */
+	t += 20000;
+	n = 0;
+	set_event_at(&events[n++], t, EV_KEY, BTN_RIGHT, 1);
+	ck_assert_int_eq(libinput_memory_device_inject(device, events, n), 0);
+	libinput_dispatch(li);
+	litest_assert_empty_queue(li);
+	ck_assert_int_eq(libinput_memory_advance_clock(li, t + 1000000), 0);
+	n = 0;
+	set_event_at(&events[n++], t, EV_SYN, SYN_REPORT, 0);
+	ck_assert_int_eq(libinput_memory_device_inject(device, events, n), 0);
+	libinput_dispatch(li);
+
+	ck_assert_int_eq(libinput_get_frame(li, frame, 4), 1);
+	event = frame[0];
+	ck_assert_int_eq(libinput_event_get_type(event),
+			 LIBINPUT_EVENT_POINTER_BUTTON);
+	ck_assert_int_eq(libinput_event_pointer_get_button(
+				libinput_event_get_pointer_event(event)),
+			 BTN_LEFT);
+	ck_assert_int_ne(libinput_event_get_frame_sequence(event), tap_seq);
+	libinput_event_destroy(event);
+
+	ck_assert_int_eq(libinput_get_frame(li, frame, 4), 1);
+	event = frame[0];
+	ck_assert_int_eq(libinput_event_pointer_get_button(
+				libinput_event_get_pointer_event(event)),
+			 BTN_RIGHT);
+	libinput_event_destroy(event);
+
+	litest_assert_empty_queue(li);
+
+	libinput_unref(li);
+}
+END_TEST
+
+START_TEST(memory_suspend_resume)
+{
+	struct libinput *li;
+	struct libinput_device *device;
+	struct libinput_event *event;
+	struct libevdev *evdev;
+	struct input_event events[2];
+
+	li = libinput_memory_create_context(&simple_interface, NULL);
+	evdev = mouse_description();
+	device = libinput_memory_add_device(li, evdev);
+	libevdev_free(evdev);
+	ck_assert(device != NULL);
+	litest_drain_events(li);
+
+	libinput_suspend(li);
+	libinput_dispatch(li);
+	event = libinput_get_event(li);
+	ck_assert_int_eq(libinput_event_get_type(event),
+			 LIBINPUT_EVENT_DEVICE_REMOVED);
+	libinput_event_destroy(event);
+	litest_assert_empty_queue(li);
+
+	ck_assert_int_eq(libinput_resume(li), 0);
+	libinput_dispatch(li);
+	event = libinput_get_event(li);
+	ck_assert_int_eq(libinput_event_get_type(event),
+			 LIBINPUT_EVENT_DEVICE_ADDED);
+	device = libinput_event_get_device(event);
+	ck_assert_str_eq(libinput_device_get_sysname(device), "virtual0");
+	libinput_event_destroy(event);
+
+	/* the new device takes events */
+	set_event(&events[0], EV_REL, REL_X, 5);
+	set_event(&events[1], EV_SYN, SYN_REPORT, 0);
+	ck_assert_int_eq(libinput_memory_device_inject(device, events, 2), 0);
+	litest_assert_only_typed_events(li, LIBINPUT_EVENT_POINTER_MOTION);
+
+	libinput_unref(li);
+}
+END_TEST
+
+int
+main(int argc, char **argv)
+{
+	litest_add_no_device("memory:create", memory_create_NULL);
+	litest_add_no_device("memory:create", memory_add_device);
+	litest_add_no_device("memory:inject", memory_inject_motion);
+	litest_add_no_device("memory:inject", memory_inject_tap);
+	litest_add_no_device("memory:inject", memory_event_clock_tap);
+	litest_add_no_device("memory:inject", memory_event_clock_frame_sequence);
+	litest_add_no_device("memory:suspend", memory_suspend_resume);
+
+	return litest_run(argc, argv);
+}
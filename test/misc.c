@@ -312,6 +312,88 @@ START_TEST(event_conversion_key)
 }
 END_TEST
 
+static void
+count_key_event(struct libinput_event *event, void *data)
+{
+	struct libinput_event_keyboard *k;
+	int *count = data;
+
+	ck_assert_int_eq(libinput_event_get_type(event),
+			 LIBINPUT_EVENT_KEYBOARD_KEY);
+	ck_assert_notnull(libinput_event_get_device(event));
+
+	k = libinput_event_get_keyboard_event(event);
+	ck_assert_int_eq(libinput_event_keyboard_get_key(k), KEY_A);
+
+	(*count)++;
+}
+
+START_TEST(event_sink_key)
+{
+	struct libevdev_uinput *uinput;
+	struct libinput *li;
+	struct libinput_event *event;
+	int sunk = 0, queued = 0;
+
+	uinput = create_simple_test_device("litest test device",
+					   EV_KEY, KEY_A,
+					   EV_KEY, KEY_B,
+					   -1, -1);
+	li = libinput_path_create_context(&simple_interface, NULL);
+	libinput_path_add_device(li, libevdev_uinput_get_devnode(uinput));
+	libinput_dispatch(li);
+
+	ck_assert_int_eq(libinput_set_event_sink(li,
+						 LIBINPUT_EVENT_DEVICE_ADDED,
+						 count_key_event,
+						 &sunk),
+			 -EINVAL);
+	ck_assert_int_eq(libinput_set_event_sink(li,
+						 LIBINPUT_EVENT_KEYBOARD_KEY,
+						 count_key_event,
+						 &sunk),
+			 0);
+
+	libevdev_uinput_write_event(uinput, EV_KEY, KEY_A, 1);
+	libevdev_uinput_write_event(uinput, EV_SYN, SYN_REPORT, 0);
+	libevdev_uinput_write_event(uinput, EV_KEY, KEY_A, 0);
+	libevdev_uinput_write_event(uinput, EV_SYN, SYN_REPORT, 0);
+
+	libinput_dispatch(li);
+	ck_assert_int_eq(sunk, 2);
+
+	while ((event = libinput_get_event(li))) {
+		if (libinput_event_get_type(event) ==
+		    LIBINPUT_EVENT_KEYBOARD_KEY)
+			queued++;
+		libinput_event_destroy(event);
+	}
+	ck_assert_int_eq(queued, 0);
+
+	/* without a sink they go back to the queue */
+	libinput_set_event_sink(li, LIBINPUT_EVENT_KEYBOARD_KEY, NULL, NULL);
+
+	libevdev_uinput_write_event(uinput, EV_KEY, KEY_A, 1);
+	libevdev_uinput_write_event(uinput, EV_SYN, SYN_REPORT, 0);
+	libevdev_uinput_write_event(uinput, EV_KEY, KEY_A, 0);
+	libevdev_uinput_write_event(uinput, EV_SYN, SYN_REPORT, 0);
+
+	libinput_dispatch(li);
+
+	while ((event = libinput_get_event(li))) {
+		if (libinput_event_get_type(event) ==
+		    LIBINPUT_EVENT_KEYBOARD_KEY)
+			queued++;
+		libinput_event_destroy(event);
+	}
+	ck_assert_int_eq(queued, 2);
+	ck_assert_int_eq(sunk, 2);
+
+	libinput_unref(li);
+	libevdev_uinput_destroy(uinput);
+}
+END_TEST
+
 START_TEST(event_conversion_touch)
 {
 	struct libevdev_uinput *uinput;
@@ -576,6 +658,7 @@ int main (int argc, char **argv) {
 	litest_add_no_device("events:conversion", event_conversion_pointer_abs);
 	litest_add_no_device("events:conversion", event_conversion_key);
 	litest_add_no_device("events:conversion", event_conversion_touch);
+	litest_add_no_device("events:sink", event_sink_key);
 	litest_add_no_device("context:refcount", context_ref_counting);
 	litest_add_no_device("config:status string", config_status_string);
 
@@ -27,6 +27,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <libinput.h>
+#include <libinput-util.h>
 #include <libudev.h>
 #include <unistd.h>
 
@@ -398,6 +399,89 @@ START_TEST(path_remove_device)
 }
 END_TEST
 
+START_TEST(path_remove_device_event_lifetime)
+{
+	struct litest_device *dev = litest_current_device();
+	struct libinput *li = dev->libinput;
+	struct libinput_event *event, *motion = NULL, *removed = NULL;
+	struct libinput_device *device;
+
+	device = libinput_path_add_device(li,
+					  libevdev_uinput_get_devnode(dev->uinput));
+	ck_assert(device != NULL);
+	litest_drain_events(li);
+
+	litest_event(dev, EV_REL, REL_X, 1);
+	litest_event(dev, EV_SYN, SYN_REPORT, 0);
+	libinput_dispatch(li);
+
+	libinput_path_remove_device(device);
+	libinput_dispatch(li);
+
+	while ((event = libinput_get_event(li))) {
+		if (libinput_event_get_device(event) == device &&
+		    libinput_event_get_type(event) ==
+		    LIBINPUT_EVENT_POINTER_MOTION && !motion)
+			motion = event;
+		else if (libinput_event_get_type(event) ==
+			 LIBINPUT_EVENT_DEVICE_REMOVED && !removed)
+			removed = event;
+		else
+			libinput_event_destroy(event);
+	}
+
+	ck_assert_notnull(motion);
+	ck_assert_notnull(removed);
+
+	/* events queued before the removal keep the device alive, in
+	 * whichever order they are destroyed */
+	libinput_event_destroy(removed);
+	libinput_dispatch(li);
+
+	ck_assert(libinput_event_get_device(motion) == device);
+	ck_assert_notnull(libinput_device_get_sysname(device));
+
+	libinput_event_destroy(motion);
+	libinput_dispatch(li);
+}
+END_TEST
+
+START_TEST(path_remove_device_ref_from_event)
+{
+	struct litest_device *dev = litest_current_device();
+	struct libinput *li = dev->libinput;
+	struct libinput_event *event;
+	struct libinput_device *device;
+	int nevents = 0;
+
+	device = libinput_path_add_device(li,
+					  libevdev_uinput_get_devnode(dev->uinput));
+	ck_assert(device != NULL);
+	litest_drain_events(li);
+
+	litest_event(dev, EV_REL, REL_X, 1);
+	litest_event(dev, EV_SYN, SYN_REPORT, 0);
+	libinput_dispatch(li);
+
+	libinput_path_remove_device(device);
+	libinput_dispatch(li);
+
+	/* the caller's reference is gone, taking and dropping one through
+	 * a queued event must not release the device again */
+	while ((event = libinput_get_event(li))) {
+		if (libinput_event_get_device(event) == device) {
+			libinput_device_ref(device);
+			ck_assert(libinput_device_unref(device) == device);
+			nevents++;
+		}
+		libinput_event_destroy(event);
+		libinput_dispatch(li);
+	}
+
+	ck_assert_int_ge(nevents, 2);
+}
+END_TEST
+
 START_TEST(path_double_remove_device)
 {
 	struct litest_device *dev = litest_current_device();
@@ -702,6 +786,138 @@ START_TEST(path_add_device_suspend_resume_fail)
 }
 END_TEST
 
+static struct libinput_open_request *pending_request;
+static const char *pending_paths[4];
+static size_t pending_count;
+static int pending_flags;
+
+static void
+open_restricted_many(struct libinput_open_request *request,
+		     const char **paths,
+		     size_t count,
+		     int flags,
+		     void *data)
+{
+	size_t i;
+
+	ck_assert(pending_request == NULL);
+	ck_assert_int_le(count, ARRAY_LENGTH(pending_paths));
+
+	pending_request = request;
+	pending_count = count;
+	pending_flags = flags;
+	for (i = 0; i < count; i++)
+		pending_paths[i] = paths[i];
+}
+
+static void
+complete_pending_request(void)
+{
+	int fds[ARRAY_LENGTH(pending_paths)];
+	size_t i;
+
+	ck_assert(pending_request != NULL);
+
+	for (i = 0; i < pending_count; i++)
+		fds[i] = open_restricted(pending_paths[i], pending_flags, NULL);
+
+	libinput_open_request_complete(pending_request, fds);
+	pending_request = NULL;
+}
+
+START_TEST(path_add_device_suspend_resume_open_many)
+{
+	struct libinput *li;
+	struct libinput_device *device;
+	struct libinput_event *event;
+	struct libevdev_uinput *uinput1, *uinput2;
+	int rc;
+	int nevents;
+	void *userdata = &rc;
+
+	uinput1 = litest_create_uinput_device("test device", NULL,
+					      EV_KEY, BTN_LEFT,
+					      EV_KEY, BTN_RIGHT,
+					      EV_REL, REL_X,
+					      EV_REL, REL_Y,
+					      -1);
+	uinput2 = litest_create_uinput_device("test device 2", NULL,
+					      EV_KEY, BTN_LEFT,
+					      EV_KEY, BTN_RIGHT,
+					      EV_REL, REL_X,
+					      EV_REL, REL_Y,
+					      -1);
+
+	li = libinput_path_create_context(&simple_interface, userdata);
+	ck_assert(li != NULL);
+
+	device = libinput_path_add_device(li,
+					  libevdev_uinput_get_devnode(uinput1));
+	ck_assert(device != NULL);
+	device = libinput_path_add_device(li,
+					  libevdev_uinput_get_devnode(uinput2));
+	ck_assert(device != NULL);
+
+	rc = libinput_set_open_restricted_many(li, open_restricted_many);
+	ck_assert_int_eq(rc, 0);
+
+	litest_drain_events(li);
+
+	libinput_suspend(li);
+	litest_drain_events(li);
+
+	/* both devices are requested at once, nothing happens until the
+	 * caller completes the request */
+	pending_request = NULL;
+	rc = libinput_resume(li);
+	ck_assert_int_eq(rc, 0);
+	ck_assert(pending_request != NULL);
+	ck_assert_int_eq(pending_count, 2);
+
+	libinput_dispatch(li);
+	ck_assert(libinput_get_event(li) == NULL);
+
+	complete_pending_request();
+	libinput_dispatch(li);
+
+	nevents = 0;
+	while ((event = libinput_get_event(li))) {
+		enum libinput_event_type type;
+		type = libinput_event_get_type(event);
+		ck_assert_int_eq(type, LIBINPUT_EVENT_DEVICE_ADDED);
+		libinput_event_destroy(event);
+		nevents++;
+	}
+
+	ck_assert_int_eq(nevents, 2);
+
+	/* suspending again before the request completes cancels it, the
+	 * fds handed to us afterwards are closed again */
+	libinput_suspend(li);
+	litest_drain_events(li);
+
+	rc = libinput_resume(li);
+	ck_assert_int_eq(rc, 0);
+	ck_assert(pending_request != NULL);
+
+	libinput_suspend(li);
+
+	close_func_count = 0;
+	complete_pending_request();
+	ck_assert_int_eq(close_func_count, 2);
+
+	libinput_dispatch(li);
+	ck_assert(libinput_get_event(li) == NULL);
+
+	libevdev_uinput_destroy(uinput1);
+	libevdev_uinput_destroy(uinput2);
+	libinput_unref(li);
+
+	open_func_count = 0;
+	close_func_count = 0;
+}
+END_TEST
+
 START_TEST(path_add_device_suspend_resume_remove_device)
 {
 	struct libinput *li;
@@ -888,6 +1104,7 @@ main(int argc, char **argv)
 	litest_add_no_device("path:suspend", path_double_resume);
 	litest_add_no_device("path:suspend", path_add_device_suspend_resume);
 	litest_add_no_device("path:suspend", path_add_device_suspend_resume_fail);
+	litest_add_no_device("path:suspend", path_add_device_suspend_resume_open_many);
 	litest_add_no_device("path:suspend", path_add_device_suspend_resume_remove_device);
 	litest_add_for_device("path:seat", path_added_seat, LITEST_SYNAPTICS_CLICKPAD);
 	litest_add_for_device("path:seat", path_seat_change, LITEST_SYNAPTICS_CLICKPAD);
@@ -897,6 +1114,8 @@ main(int argc, char **argv)
 	litest_add_no_device("path:device events", path_add_invalid_path);
 	litest_add_for_device("path:device events", path_remove_device, LITEST_SYNAPTICS_CLICKPAD);
 	litest_add_for_device("path:device events", path_double_remove_device, LITEST_SYNAPTICS_CLICKPAD);
+	litest_add_for_device("path:device events", path_remove_device_event_lifetime, LITEST_MOUSE);
+	litest_add_for_device("path:device events", path_remove_device_ref_from_event, LITEST_MOUSE);
 	litest_add_no_device("path:seat", path_seat_recycle);
 
 	return litest_run(argc, argv);
@@ -0,0 +1,698 @@
+/*
+ * Copyright © 2015 Red Hat, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* Pushes large synthetic workloads through a memory context with the
+ * event clock and fails if the cost per frame, the allocations per
+ * event or the peak heap growth while events are queued exceed the
+ * budgets in perf-budgets (or the file in LITEST_PERF_BUDGETS).
+ *
+ * Not part of make check, the timing only means something on an
+ * optimized build outside of valgrind. Run it with make perf.
+ */
+
+#include <config.h>
+
+#include <check.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <libevdev/libevdev.h>
+#include <libinput.h>
+#include <libinput-util.h>
+#include <malloc.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "litest.h"
+
+/* A compositor reads the events once per output frame */
+#define PERF_READ_INTERVAL_US 16667
+
+/* Frames processed before measuring, so one-time allocations like
+ * the event queue growing to its working size don't count */
+#define PERF_WARMUP_FRAMES 2000
+
+#define PERF_MAX_EVENTS_PER_FRAME 64
+
+/* glibc's allocator, wrapped below to count what libinput allocates */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static struct {
+	bool enabled;
+	uint64_t nallocs;
+	int64_t live;
+	int64_t peak;
+} heap;
+
+static inline void
+heap_add(void *ptr)
+{
+	if (!heap.enabled || !ptr)
+		return;
+
+	heap.nallocs++;
+	heap.live += malloc_usable_size(ptr);
+	if (heap.live > heap.peak)
+		heap.peak = heap.live;
+}
+
+static inline void
+heap_remove(void *ptr)
+{
+	if (!heap.enabled || !ptr)
+		return;
+
+	heap.live -= malloc_usable_size(ptr);
+}
+
+void *
+malloc(size_t size)
+{
+	void *ptr = __libc_malloc(size);
+
+	heap_add(ptr);
+
+	return ptr;
+}
+
+void *
+calloc(size_t nmemb, size_t size)
+{
+	void *ptr = __libc_calloc(nmemb, size);
+
+	heap_add(ptr);
+
+	return ptr;
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+	heap_remove(ptr);
+	ptr = __libc_realloc(ptr, size);
+	heap_add(ptr);
+
+	return ptr;
+}
+
+void
+free(void *ptr)
+{
+	heap_remove(ptr);
+	__libc_free(ptr);
+}
+
+struct perf_budget {
+	double ns_per_frame;
+	double allocs_per_event;
+	double peak_bytes;
+};
+
+struct perf_result {
+	uint64_t nframes;
+	uint64_t nevents;
+	uint64_t nout;
+	uint64_t ns;
+	uint64_t nallocs;
+	int64_t peak_bytes;
+};
+
+struct perf_workload {
+	const char *name;
+	struct libevdev *(*description)(void);
+	void (*configure)(struct libinput_device *device);
+
+	/* Fills in the events for frame n, including the SYN_REPORT, and
+	 * returns the number of events */
+	size_t (*frame)(unsigned int n, struct input_event *events);
+
+	unsigned int nframes;
+	unsigned int interval; /* us between frames */
+};
+
+static int open_restricted(const char *path, int flags, void *data)
+{
+	ck_abort_msg("memory backend opened %s", path);
+	return -ENODEV;
+}
+
+static void close_restricted(int fd, void *data)
+{
+}
+
+static const struct libinput_interface interface = {
+	.open_restricted = open_restricted,
+	.close_restricted = close_restricted,
+};
+
+static inline uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline void
+set_event(struct input_event *ev,
+	  unsigned int type,
+	  unsigned int code,
+	  int value)
+{
+	ev->type = type;
+	ev->code = code;
+	ev->value = value;
+}
+
+static void
+enable_abs(struct libevdev *evdev,
+	   unsigned int code,
+	   int minimum,
+	   int maximum,
+	   int resolution)
+{
+	struct input_absinfo abs = {
+		.minimum = minimum,
+		.maximum = maximum,
+		.resolution = resolution,
+	};
+
+	libevdev_enable_event_code(evdev, EV_ABS, code, &abs);
+}
+
+static struct libevdev *
+mouse_description(void)
+{
+	struct libevdev *evdev = libevdev_new();
+
+	libevdev_set_name(evdev, "perf 8kHz mouse");
+	libevdev_set_id_bustype(evdev, BUS_USB);
+	libevdev_enable_event_code(evdev, EV_REL, REL_X, NULL);
+	libevdev_enable_event_code(evdev, EV_REL, REL_Y, NULL);
+	libevdev_enable_event_code(evdev, EV_REL, REL_WHEEL, NULL);
+	libevdev_enable_event_code(evdev, EV_KEY, BTN_LEFT, NULL);
+	libevdev_enable_event_code(evdev, EV_KEY, BTN_RIGHT, NULL);
+	libevdev_enable_event_code(evdev, EV_KEY, BTN_MIDDLE, NULL);
+
+	return evdev;
+}
+
+/* Small circles, with a click every second */
+static size_t
+mouse_frame(unsigned int n, struct input_event *events)
+{
+	size_t nevents = 0;
+
+	set_event(&events[nevents++], EV_REL, REL_X,
+		  (int)(8 * cos(n / 100.0)));
+	set_event(&events[nevents++], EV_REL, REL_Y,
+		  (int)(8 * sin(n / 100.0)));
+	if (n % 8000 == 0)
+		set_event(&events[nevents++], EV_KEY, BTN_LEFT, 1);
+	else if (n % 8000 == 800)
+		set_event(&events[nevents++], EV_KEY, BTN_LEFT, 0);
+	set_event(&events[nevents++], EV_SYN, SYN_REPORT, 0);
+
+	return nevents;
+}
+
+static struct libevdev *
+touchscreen_description(void)
+{
+	struct libevdev *evdev = libevdev_new();
+
+	libevdev_set_name(evdev, "perf 10-finger touchscreen");
+	libevdev_set_id_bustype(evdev, BUS_USB);
+	enable_abs(evdev, ABS_X, 0, 4095, 16);
+	enable_abs(evdev, ABS_Y, 0, 4095, 16);
+	enable_abs(evdev, ABS_MT_SLOT, 0, 9, 0);
+	enable_abs(evdev, ABS_MT_TRACKING_ID, 0, 65535, 0);
+	enable_abs(evdev, ABS_MT_POSITION_X, 0, 4095, 16);
+	enable_abs(evdev, ABS_MT_POSITION_Y, 0, 4095, 16);
+	libevdev_enable_event_code(evdev, EV_KEY, BTN_TOUCH, NULL);
+	libevdev_enable_property(evdev, INPUT_PROP_DIRECT);
+
+	return evdev;
+}
+
+/* All ten fingers move in every frame, every 500 frames they lift and
+ * come back down */
+static size_t
+touchscreen_frame(unsigned int n, struct input_event *events)
+{
+	size_t nevents = 0;
+	unsigned int phase = n % 500;
+	int slot;
+
+	for (slot = 0; slot < 10; slot++) {
+		set_event(&events[nevents++], EV_ABS, ABS_MT_SLOT, slot);
+
+		if (phase == 499) {
+			set_event(&events[nevents++],
+				  EV_ABS, ABS_MT_TRACKING_ID, -1);
+			continue;
+		}
+
+		if (phase == 0)
+			set_event(&events[nevents++],
+				  EV_ABS, ABS_MT_TRACKING_ID,
+				  (n / 500) * 10 + slot);
+		set_event(&events[nevents++], EV_ABS, ABS_MT_POSITION_X,
+			  300 + slot * 350 + phase);
+		set_event(&events[nevents++], EV_ABS, ABS_MT_POSITION_Y,
+			  500 + slot * 100 + phase * 2);
+	}
+
+	if (phase == 0)
+		set_event(&events[nevents++], EV_KEY, BTN_TOUCH, 1);
+	else if (phase == 499)
+		set_event(&events[nevents++], EV_KEY, BTN_TOUCH, 0);
+
+	set_event(&events[nevents++], EV_SYN, SYN_REPORT, 0);
+
+	return nevents;
+}
+
+static struct libevdev *
+touchpad_description(void)
+{
+	struct libevdev *evdev = libevdev_new();
+
+	libevdev_set_name(evdev, "perf touchpad");
+	libevdev_set_id_bustype(evdev, BUS_I8042);
+	enable_abs(evdev, ABS_X, 1472, 5472, 75);
+	enable_abs(evdev, ABS_Y, 1408, 4448, 129);
+	enable_abs(evdev, ABS_MT_SLOT, 0, 4, 0);
+	enable_abs(evdev, ABS_MT_TRACKING_ID, 0, 65535, 0);
+	enable_abs(evdev, ABS_MT_POSITION_X, 1472, 5472, 75);
+	enable_abs(evdev, ABS_MT_POSITION_Y, 1408, 4448, 129);
+	libevdev_enable_event_code(evdev, EV_KEY, BTN_LEFT, NULL);
+	libevdev_enable_event_code(evdev, EV_KEY, BTN_TOOL_FINGER, NULL);
+	libevdev_enable_event_code(evdev, EV_KEY, BTN_TOOL_DOUBLETAP, NULL);
+	libevdev_enable_event_code(evdev, EV_KEY, BTN_TOOL_TRIPLETAP, NULL);
+	libevdev_enable_event_code(evdev, EV_KEY, BTN_TOUCH, NULL);
+	libevdev_enable_property(evdev, INPUT_PROP_POINTER);
+	libevdev_enable_property(evdev, INPUT_PROP_BUTTONPAD);
+
+	return evdev;
+}
+
+/* Two fingers scrolling up and down, lifting every 200 frames so
+ * scrolling starts and stops over and over */
+static size_t
+touchpad_frame(unsigned int n, struct input_event *events)
+{
+	size_t nevents = 0;
+	unsigned int phase = n % 200;
+	int y = 2000 + (phase < 100 ? phase : 200 - phase) * 20;
+	int slot;
+
+	for (slot = 0; slot < 2; slot++) {
+		set_event(&events[nevents++], EV_ABS, ABS_MT_SLOT, slot);
+
+		if (phase == 199) {
+			set_event(&events[nevents++],
+				  EV_ABS, ABS_MT_TRACKING_ID, -1);
+			continue;
+		}
+
+		if (phase == 0) {
+			set_event(&events[nevents++],
+				  EV_ABS, ABS_MT_TRACKING_ID,
+				  (n / 200) * 2 + slot);
+			set_event(&events[nevents++],
+				  EV_ABS, ABS_MT_POSITION_X, 3000 + slot * 800);
+		}
+		set_event(&events[nevents++], EV_ABS, ABS_MT_POSITION_Y, y);
+	}
+
+	if (phase == 0) {
+		set_event(&events[nevents++], EV_ABS, ABS_X, 3000);
+		set_event(&events[nevents++], EV_KEY, BTN_TOUCH, 1);
+		set_event(&events[nevents++], EV_KEY, BTN_TOOL_DOUBLETAP, 1);
+	} else if (phase == 199) {
+		set_event(&events[nevents++], EV_KEY, BTN_TOUCH, 0);
+		set_event(&events[nevents++], EV_KEY, BTN_TOOL_DOUBLETAP, 0);
+	}
+	if (phase != 199)
+		set_event(&events[nevents++], EV_ABS, ABS_Y, y);
+
+	set_event(&events[nevents++], EV_SYN, SYN_REPORT, 0);
+
+	return nevents;
+}
+
+static void
+touchpad_configure(struct libinput_device *device)
+{
+	libinput_device_config_tap_set_enabled(device,
+					       LIBINPUT_CONFIG_TAP_ENABLED);
+}
+
+static struct libevdev *
+keyboard_description(void)
+{
+	struct libevdev *evdev = libevdev_new();
+	unsigned int key;
+	int rep[2] = { 500, 30 };
+
+	libevdev_set_name(evdev, "perf keyboard");
+	libevdev_set_id_bustype(evdev, BUS_USB);
+	for (key = KEY_ESC; key <= KEY_MICMUTE; key++)
+		libevdev_enable_event_code(evdev, EV_KEY, key, NULL);
+	libevdev_enable_event_code(evdev, EV_REP, REP_DELAY, &rep[0]);
+	libevdev_enable_event_code(evdev, EV_REP, REP_PERIOD, &rep[1]);
+
+	return evdev;
+}
+
+/* Eight keys held down, repeating in every frame, with one of them
+ * released and pressed again every 100 frames */
+static size_t
+keyboard_frame(unsigned int n, struct input_event *events)
+{
+	static const unsigned int keys[] = {
+		KEY_A, KEY_S, KEY_D, KEY_F, KEY_J, KEY_K, KEY_L, KEY_SEMICOLON,
+	};
+	size_t nevents = 0;
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_LENGTH(keys); i++) {
+		int value = 2;
+
+		if (n == 0)
+			value = 1;
+		else if (n % 100 == i * 10 + 5)
+			value = 0;
+		else if (n % 100 == i * 10 + 6)
+			value = 1;
+
+		set_event(&events[nevents++], EV_KEY, keys[i], value);
+	}
+	set_event(&events[nevents++], EV_SYN, SYN_REPORT, 0);
+
+	return nevents;
+}
+
+static const struct perf_workload workloads[] = {
+	{
+		.name = "mouse-8khz",
+		.description = mouse_description,
+		.frame = mouse_frame,
+		.nframes = 8000 * 20,
+		.interval = 125,
+	},
+	{
+		.name = "touchscreen-10-fingers",
+		.description = touchscreen_description,
+		.frame = touchscreen_frame,
+		.nframes = 50000,
+		.interval = 8000,
+	},
+	{
+		.name = "touchpad-scroll",
+		.description = touchpad_description,
+		.configure = touchpad_configure,
+		.frame = touchpad_frame,
+		.nframes = 50000,
+		.interval = 12000,
+	},
+	{
+		.name = "keyboard-repeat",
+		.description = keyboard_description,
+		.frame = keyboard_frame,
+		.nframes = 100000,
+		.interval = 1000,
+	},
+};
+
+static const struct perf_workload *
+perf_workload_find(const char *name)
+{
+	const struct perf_workload *w;
+
+	ARRAY_FOR_EACH(workloads, w) {
+		if (strcmp(w->name, name) == 0)
+			return w;
+	}
+
+	return NULL;
+}
+
+/* Lines of "<workload> <ns/frame> <allocs/event> <peak bytes>", a - for
+ * no budget */
+static void
+perf_budget_load(const char *name, struct perf_budget *budget)
+{
+	const char *path = getenv("LITEST_PERF_BUDGETS");
+	char line[256], workload[64], ns[32], allocs[32], peak[32];
+	FILE *fp;
+	bool found = false;
+
+	if (!path)
+		path = PERF_BUDGETS;
+
+	fp = fopen(path, "r");
+	ck_assert_msg(fp != NULL, "Failed to open %s: %s", path, strerror(errno));
+
+	while (fgets(line, sizeof(line), fp)) {
+		if (line[0] == '#' ||
+		    sscanf(line, "%63s %31s %31s %31s",
+			   workload, ns, allocs, peak) != 4)
+			continue;
+
+		ck_assert_msg(perf_workload_find(workload) != NULL,
+			      "%s: unknown workload %s", path, workload);
+		if (strcmp(workload, name) != 0)
+			continue;
+
+		budget->ns_per_frame = strcmp(ns, "-") ? atof(ns) : INFINITY;
+		budget->allocs_per_event = strcmp(allocs, "-") ?
+					   atof(allocs) : INFINITY;
+		budget->peak_bytes = strcmp(peak, "-") ? atof(peak) : INFINITY;
+		found = true;
+	}
+
+	fclose(fp);
+
+	ck_assert_msg(found, "%s: no budget for %s", path, name);
+}
+
+static struct input_event *
+perf_generate(const struct perf_workload *w, size_t *nevents_out)
+{
+	struct input_event *events, *ev;
+	uint64_t time = 1000000; /* us */
+	size_t nevents = 0, i, n;
+	unsigned int frame;
+
+	events = zalloc((size_t)w->nframes * PERF_MAX_EVENTS_PER_FRAME *
+			sizeof(*events));
+	ck_assert_notnull(events);
+
+	for (frame = 0; frame < w->nframes; frame++) {
+		ev = &events[nevents];
+		n = w->frame(frame, ev);
+		ck_assert_int_le(n, PERF_MAX_EVENTS_PER_FRAME);
+
+		for (i = 0; i < n; i++) {
+			ev[i].time.tv_sec = time / 1000000;
+			ev[i].time.tv_usec = time % 1000000;
+		}
+
+		nevents += n;
+		time += w->interval;
+	}
+
+	*nevents_out = nevents;
+
+	return events;
+}
+
+/* Injects everything that happens within one read interval, then
+ * dispatches and drains the queue like a compositor would */
+static uint64_t
+perf_inject(struct libinput *li,
+	    struct libinput_device *device,
+	    const struct input_event *events,
+	    size_t *pos,
+	    size_t nevents,
+	    unsigned int *frames_left)
+{
+	struct libinput_event *event;
+	const struct input_event *start = &events[*pos];
+	uint64_t end = start->time.tv_sec * 1000000ULL + start->time.tv_usec +
+		       PERF_READ_INTERVAL_US;
+	uint64_t nout = 0;
+	size_t n = 0;
+
+	while (*pos + n < nevents && *frames_left > 0) {
+		const struct input_event *ev = &events[*pos + n];
+
+		if (ev->time.tv_sec * 1000000ULL + ev->time.tv_usec >= end)
+			break;
+
+		n++;
+		if (ev->type == EV_SYN && ev->code == SYN_REPORT)
+			(*frames_left)--;
+	}
+
+	ck_assert_int_eq(libinput_memory_device_inject(device, start, n), 0);
+	*pos += n;
+
+	libinput_dispatch(li);
+	while ((event = libinput_get_event(li))) {
+		libinput_event_destroy(event);
+		nout++;
+	}
+
+	return nout;
+}
+
+static void
+perf_run(const struct perf_workload *w, struct perf_result *result)
+{
+	struct libinput *li;
+	struct libinput_device *device;
+	struct libevdev *evdev;
+	struct input_event *events;
+	size_t nevents, pos = 0, measured_start;
+	unsigned int frames_left;
+	uint64_t start;
+
+	events = perf_generate(w, &nevents);
+
+	li = libinput_memory_create_context(&interface, NULL);
+	ck_assert_notnull(li);
+	ck_assert_int_eq(libinput_memory_set_event_clock(li, 1), 0);
+
+	evdev = w->description();
+	device = libinput_memory_add_device(li, evdev);
+	libevdev_free(evdev);
+	ck_assert_notnull(device);
+	if (w->configure)
+		w->configure(device);
+	litest_drain_events(li);
+
+	frames_left = PERF_WARMUP_FRAMES;
+	while (frames_left > 0)
+		perf_inject(li, device, events, &pos, nevents, &frames_left);
+
+	memset(result, 0, sizeof(*result));
+	measured_start = pos;
+	frames_left = w->nframes - PERF_WARMUP_FRAMES;
+
+	heap.nallocs = 0;
+	heap.live = 0;
+	heap.peak = 0;
+	heap.enabled = true;
+	start = now_ns();
+
+	while (pos < nevents)
+		result->nout += perf_inject(li, device, events, &pos, nevents,
+					    &frames_left);
+
+	result->ns = now_ns() - start;
+	heap.enabled = false;
+
+	result->nframes = w->nframes - PERF_WARMUP_FRAMES;
+	result->nevents = pos - measured_start;
+	result->nallocs = heap.nallocs;
+	result->peak_bytes = heap.peak;
+
+	libinput_unref(li);
+	free(events);
+}
+
+static void
+perf_check(const char *name)
+{
+	const struct perf_workload *w = perf_workload_find(name);
+	struct perf_budget budget;
+	struct perf_result result;
+	double ns_per_frame, allocs_per_event;
+
+	ck_assert_notnull(w);
+	perf_budget_load(name, &budget);
+	perf_run(w, &result);
+
+	ns_per_frame = (double)result.ns / result.nframes;
+	allocs_per_event = (double)result.nallocs / result.nevents;
+
+	printf("%-24s %8.1f ns/frame %8.3f allocs/event %8" PRIi64 " bytes peak "
+	       "(%" PRIu64 " frames, %" PRIu64 " events in, %" PRIu64 " out)\n",
+	       name, ns_per_frame, allocs_per_event, result.peak_bytes,
+	       result.nframes, result.nevents, result.nout);
+	fflush(stdout);
+
+	ck_assert_msg(ns_per_frame <= budget.ns_per_frame,
+		      "%s: %.1f ns/frame, budget is %.1f",
+		      name, ns_per_frame, budget.ns_per_frame);
+	ck_assert_msg(allocs_per_event <= budget.allocs_per_event,
+		      "%s: %.3f allocations per event, budget is %.3f",
+		      name, allocs_per_event, budget.allocs_per_event);
+	ck_assert_msg(result.peak_bytes <= budget.peak_bytes,
+		      "%s: %" PRIi64 " bytes peak, budget is %.0f",
+		      name, result.peak_bytes, budget.peak_bytes);
+}
+
+START_TEST(perf_mouse_8khz)
+{
+	perf_check("mouse-8khz");
+}
+END_TEST
+
+START_TEST(perf_touchscreen_10_fingers)
+{
+	perf_check("touchscreen-10-fingers");
+}
+END_TEST
+
+START_TEST(perf_touchpad_scroll)
+{
+	perf_check("touchpad-scroll");
+}
+END_TEST
+
+START_TEST(perf_keyboard_repeat)
+{
+	perf_check("keyboard-repeat");
+}
+END_TEST
+
+int
+main(int argc, char **argv)
+{
+	litest_add_no_device("perf:pointer", perf_mouse_8khz);
+	litest_add_no_device("perf:touch", perf_touchscreen_10_fingers);
+	litest_add_no_device("perf:touchpad", perf_touchpad_scroll);
+	litest_add_no_device("perf:keyboard", perf_keyboard_repeat);
+
+	return litest_run(argc, argv);
+}
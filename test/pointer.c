@@ -28,6 +28,10 @@
 #include <fcntl.h>
 #include <libinput.h>
 #include <math.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 #include <values.h>
 
@@ -150,6 +154,156 @@ test_absolute_event(struct litest_device *dev, double x, double y)
 	libinput_event_destroy(event);
 }
 
+START_TEST(pointer_motion_after_syn_dropped)
+{
+	struct litest_device *dev = litest_current_device();
+	struct libinput *li = dev->libinput;
+	struct libinput_event *event;
+	struct libinput_event_pointer *ptrev;
+	int i, nbuttons = 0;
+
+	litest_event(dev, EV_KEY, BTN_LEFT, 1);
+	litest_event(dev, EV_SYN, SYN_REPORT, 0);
+	litest_drain_events(li);
+
+	/* way more than the kernel buffers for us, forces a SYN_DROPPED.
+	 * The release is early enough to be lost with the rest, only the
+	 * resync can tell us about it. */
+	for (i = 0; i < 1000; i++) {
+		if (i == 10)
+			litest_event(dev, EV_KEY, BTN_LEFT, 0);
+		litest_event(dev, EV_REL, REL_X, 1);
+		litest_event(dev, EV_SYN, SYN_REPORT, 0);
+	}
+
+	libinput_dispatch(li);
+	while ((event = libinput_get_event(li))) {
+		if (libinput_event_get_type(event) ==
+		    LIBINPUT_EVENT_POINTER_BUTTON) {
+			ptrev = libinput_event_get_pointer_event(event);
+			ck_assert_int_eq(libinput_event_pointer_get_button(ptrev),
+					 BTN_LEFT);
+			ck_assert_int_eq(libinput_event_pointer_get_button_state(ptrev),
+					 LIBINPUT_BUTTON_STATE_RELEASED);
+			nbuttons++;
+		}
+		libinput_event_destroy(event);
+		libinput_dispatch(li);
+	}
+
+	ck_assert_int_eq(nbuttons, 1);
+
+	test_relative_event(dev, 1, 0);
+	test_relative_event(dev, 0, -1);
+}
+END_TEST
+
+START_TEST(pointer_event_mask)
+{
+	struct litest_device *dev = litest_current_device();
+	struct libinput *li = dev->libinput;
+	enum libinput_event_type types[] = {
+		LIBINPUT_EVENT_KEYBOARD_KEY,
+		LIBINPUT_EVENT_POINTER_BUTTON,
+	};
+	enum libinput_event_type invalid = LIBINPUT_EVENT_NONE;
+	struct libinput_event_pointer *ptrev;
+	int i;
+
+	/* fast motion for the accel filter to remember */
+	for (i = 0; i < 5; i++) {
+		litest_event(dev, EV_REL, REL_X, 10);
+		litest_event(dev, EV_SYN, SYN_REPORT, 0);
+	}
+	litest_drain_events(li);
+
+	ck_assert_int_eq(libinput_set_event_mask(li, &invalid, 1), -EINVAL);
+	ck_assert_int_eq(libinput_set_event_mask(li, types,
+						 ARRAY_LENGTH(types)),
+			 0);
+
+	litest_drain_events(li);
+
+	for (i = 0; i < 5; i++) {
+		litest_event(dev, EV_REL, REL_X, 5);
+		litest_event(dev, EV_REL, REL_Y, 5);
+		litest_event(dev, EV_SYN, SYN_REPORT, 0);
+	}
+	libinput_dispatch(li);
+	litest_assert_empty_queue(li);
+
+	litest_button_click(dev, BTN_LEFT, 1);
+	litest_button_click(dev, BTN_LEFT, 0);
+	litest_assert_only_typed_events(li, LIBINPUT_EVENT_POINTER_BUTTON);
+
+	ck_assert_int_eq(libinput_set_event_mask(li, NULL, 0), 0);
+
+	/* The filter missed the masked motion, it must start from rest
+	 * rather than from the fast motion before. At rest the first
+	 * delta is eaten up. */
+	litest_event(dev, EV_REL, REL_X, 1);
+	litest_event(dev, EV_SYN, SYN_REPORT, 0);
+	libinput_dispatch(li);
+
+	litest_wait_for_event_of_type(li, LIBINPUT_EVENT_POINTER_MOTION, -1);
+	ptrev = libinput_event_get_pointer_event(libinput_get_event(li));
+	ck_assert(libinput_event_pointer_get_dx(ptrev) == 0.0);
+	ck_assert(libinput_event_pointer_get_dx_unaccelerated(ptrev) > 0.0);
+	libinput_event_destroy(libinput_event_pointer_get_base_event(ptrev));
+
+	test_relative_event(dev, 1, 0);
+}
+END_TEST
+
+static inline uint64_t
+now_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+START_TEST(pointer_dispatch_deadline)
+{
+	struct litest_device *dev = litest_current_device();
+	struct libinput *li = dev->libinput;
+	struct pollfd fds;
+	uint64_t deadline;
+	int i;
+
+	fds.fd = libinput_get_fd(li);
+	fds.events = POLLIN;
+	fds.revents = 0;
+
+	litest_drain_events(li);
+
+	deadline = now_usec() + 200000;
+	ck_assert_int_eq(libinput_set_dispatch_deadline(li, deadline), 0);
+
+	for (i = 0; i < 5; i++) {
+		litest_event(dev, EV_REL, REL_X, 1);
+		litest_event(dev, EV_SYN, SYN_REPORT, 0);
+	}
+
+	/* held back until the deadline, then one wakeup for all of it */
+	ck_assert_int_eq(poll(&fds, 1, 50), 0);
+	ck_assert_int_eq(poll(&fds, 1, 1000), 1);
+	ck_assert(now_usec() >= deadline);
+
+	litest_assert_only_typed_events(li, LIBINPUT_EVENT_POINTER_MOTION);
+
+	/* and back to waking up right away */
+	ck_assert_int_eq(poll(&fds, 1, 0), 0);
+	litest_event(dev, EV_REL, REL_X, 1);
+	litest_event(dev, EV_SYN, SYN_REPORT, 0);
+	ck_assert_int_eq(poll(&fds, 1, 1000), 1);
+
+	litest_drain_events(li);
+}
+END_TEST
+
 START_TEST(pointer_motion_absolute)
 {
 	struct litest_device *dev = litest_current_device();
@@ -253,6 +407,110 @@ START_TEST(pointer_button)
 }
 END_TEST
 
+START_TEST(pointer_frame_grouping)
+{
+	struct litest_device *dev = litest_current_device();
+	struct libinput *li = dev->libinput;
+	struct libinput_event *events[8];
+	uint32_t seq;
+	size_t count, i;
+
+	litest_drain_events(li);
+
+	litest_event(dev, EV_REL, REL_X, 1);
+	litest_event(dev, EV_REL, REL_Y, 1);
+	litest_event(dev, EV_KEY, BTN_LEFT, 1);
+	litest_event(dev, EV_SYN, SYN_REPORT, 0);
+	litest_event(dev, EV_KEY, BTN_LEFT, 0);
+	litest_event(dev, EV_SYN, SYN_REPORT, 0);
+	libinput_dispatch(li);
+
+	count = libinput_get_frame(li, events, ARRAY_LENGTH(events));
+	ck_assert_int_eq(count, 2);
+	ck_assert_int_eq(libinput_event_get_type(events[0]),
+			 LIBINPUT_EVENT_POINTER_MOTION);
+	ck_assert_int_eq(libinput_event_get_type(events[1]),
+			 LIBINPUT_EVENT_POINTER_BUTTON);
+	seq = libinput_event_get_frame_sequence(events[0]);
+	ck_assert_int_eq(libinput_event_get_frame_sequence(events[1]), seq);
+	for (i = 0; i < count; i++)
+		libinput_event_destroy(events[i]);
+
+	count = libinput_get_frame(li, events, ARRAY_LENGTH(events));
+	ck_assert_int_eq(count, 1);
+	ck_assert_int_eq(libinput_event_get_type(events[0]),
+			 LIBINPUT_EVENT_POINTER_BUTTON);
+	ck_assert_int_ne(libinput_event_get_frame_sequence(events[0]), seq);
+	libinput_event_destroy(events[0]);
+
+	ck_assert_int_eq(libinput_get_frame(li, events, 1), 0);
+}
+END_TEST
+
+START_TEST(pointer_state_page)
+{
+	struct litest_device *dev = litest_current_device();
+	struct libinput *li = dev->libinput;
+	struct libinput_seat *seat;
+	const struct libinput_pointer_state_page *page, *mapped;
+	struct libinput_pointer_state state;
+	struct stat st;
+	int fd, i;
+
+	seat = libinput_device_get_seat(dev->libinput_device);
+	page = libinput_seat_get_pointer_state_page(seat);
+	ck_assert_notnull(page);
+
+	libinput_pointer_state_page_read(page, &state);
+	ck_assert(state.x == 0.0);
+	ck_assert(state.y == 0.0);
+	ck_assert_int_eq(state.buttons, 0);
+
+	litest_drain_events(li);
+
+	for (i = 0; i < 5; i++) {
+		litest_event(dev, EV_REL, REL_X, 5);
+		litest_event(dev, EV_SYN, SYN_REPORT, 0);
+	}
+	libinput_dispatch(li);
+
+	/* up to date without looking at the event queue */
+	libinput_pointer_state_page_read(page, &state);
+	ck_assert(state.x > 0.0);
+	ck_assert(state.y == 0.0);
+
+	litest_event(dev, EV_KEY, BTN_LEFT, 1);
+	litest_event(dev, EV_SYN, SYN_REPORT, 0);
+	libinput_dispatch(li);
+
+	libinput_pointer_state_page_read(page, &state);
+	ck_assert_int_eq(state.buttons, 1);
+
+	fd = libinput_seat_get_pointer_state_fd(seat);
+	if (fd >= 0) {
+		ck_assert_int_eq(fstat(fd, &st), 0);
+		mapped = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		ck_assert(mapped != MAP_FAILED);
+
+		libinput_pointer_state_page_read(mapped, &state);
+		ck_assert_int_eq(state.buttons, 1);
+
+		munmap((void*)mapped, st.st_size);
+	} else {
+		ck_assert_int_eq(fd, -ENOSYS);
+	}
+
+	litest_event(dev, EV_KEY, BTN_LEFT, 0);
+	litest_event(dev, EV_SYN, SYN_REPORT, 0);
+	libinput_dispatch(li);
+
+	libinput_pointer_state_page_read(page, &state);
+	ck_assert_int_eq(state.buttons, 0);
+
+	litest_drain_events(li);
+}
+END_TEST
+
 START_TEST(pointer_button_auto_release)
 {
 	struct libinput *libinput;
@@ -729,8 +987,13 @@ int main (int argc, char **argv) {
 	litest_add("pointer:motion", pointer_motion_relative, LITEST_RELATIVE, LITEST_ANY);
 	litest_add("pointer:motion", pointer_motion_absolute, LITEST_ABSOLUTE, LITEST_ANY);
 	litest_add("pointer:motion", pointer_motion_unaccel, LITEST_RELATIVE, LITEST_ANY);
+	litest_add("pointer:motion", pointer_motion_after_syn_dropped, LITEST_RELATIVE|LITEST_BUTTON, LITEST_ANY);
+	litest_add("pointer:motion", pointer_dispatch_deadline, LITEST_RELATIVE, LITEST_ANY);
 	litest_add("pointer:button", pointer_button, LITEST_BUTTON, LITEST_CLICKPAD);
 	litest_add_no_device("pointer:button_auto_release", pointer_button_auto_release);
+	litest_add("pointer:frame", pointer_frame_grouping, LITEST_RELATIVE|LITEST_BUTTON, LITEST_ANY);
+	litest_add("pointer:state", pointer_state_page, LITEST_RELATIVE|LITEST_BUTTON, LITEST_ANY);
+	litest_add("pointer:event mask", pointer_event_mask, LITEST_RELATIVE|LITEST_BUTTON, LITEST_ANY);
 	litest_add("pointer:scroll", pointer_scroll_wheel, LITEST_WHEEL, LITEST_ANY);
 	litest_add("pointer:scroll", pointer_scroll_button, LITEST_RELATIVE|LITEST_BUTTON, LITEST_ANY);
 	litest_add("pointer:scroll", pointer_scroll_natural_defaults, LITEST_WHEEL, LITEST_ANY);
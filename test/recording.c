@@ -0,0 +1,443 @@
+/*
+ * Copyright © 2015 Red Hat, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <check.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libinput-util.h"
+#include "recording.h"
+
+#include "litest.h"
+
+/* a bit more than three keyframe intervals */
+#define NFRAMES (RECORDING_KEYFRAME_INTERVAL * 3 / 5 + 100)
+
+struct test_recording {
+	char path[64];
+	struct input_event *events;
+	size_t nevents;
+};
+
+static void
+add_event(struct test_recording *rec,
+	  uint64_t time,
+	  unsigned int type,
+	  unsigned int code,
+	  int32_t value)
+{
+	struct input_event *ev = &rec->events[rec->nevents++];
+
+	ev->time.tv_sec = time / 1000000;
+	ev->time.tv_usec = time % 1000000;
+	ev->type = type;
+	ev->code = code;
+	ev->value = value;
+}
+
+/* A single touch going back and forth, the ABS deltas go both ways and
+ * the events of a frame share their time */
+static void
+test_recording_write(struct test_recording *rec)
+{
+	struct recording_description desc;
+	struct recording_writer *writer;
+	uint64_t time = 1000000;
+	int32_t x, y;
+	size_t i;
+	int fd;
+
+	memset(&desc, 0, sizeof(desc));
+	strcpy(desc.name, "recording test touchpad");
+	recording_description_enable_code(&desc, EV_ABS, ABS_X);
+	recording_description_enable_code(&desc, EV_ABS, ABS_Y);
+	recording_description_enable_code(&desc, EV_ABS, ABS_MT_SLOT);
+	recording_description_enable_code(&desc, EV_ABS, ABS_MT_POSITION_X);
+	recording_description_enable_code(&desc, EV_ABS, ABS_MT_POSITION_Y);
+	recording_description_enable_code(&desc, EV_ABS, ABS_MT_TRACKING_ID);
+	recording_description_enable_code(&desc, EV_KEY, BTN_TOUCH);
+	desc.abs[ABS_X].maximum = 4000;
+	desc.abs[ABS_Y].maximum = 3000;
+	desc.abs[ABS_MT_SLOT].maximum = 1;
+	desc.abs[ABS_MT_POSITION_X].maximum = 4000;
+	desc.abs[ABS_MT_POSITION_Y].maximum = 3000;
+	desc.abs[ABS_MT_TRACKING_ID].maximum = 65535;
+
+	strcpy(rec->path, "/tmp/litest-recording-XXXXXX");
+	fd = mkstemp(rec->path);
+	ck_assert_int_ge(fd, 0);
+
+	writer = recording_writer_new(fd, &desc);
+	ck_assert_notnull(writer);
+
+	rec->events = zalloc(NFRAMES * 6 * sizeof(*rec->events));
+	ck_assert_notnull(rec->events);
+	rec->nevents = 0;
+
+	add_event(rec, time, EV_ABS, ABS_MT_TRACKING_ID, 1);
+	add_event(rec, time, EV_KEY, BTN_TOUCH, 1);
+
+	for (i = 0; i < NFRAMES; i++) {
+		x = 100 + (i % 200) * 10;
+		y = 2900 - (i % 150) * 15;
+
+		add_event(rec, time, EV_ABS, ABS_MT_POSITION_X, x);
+		add_event(rec, time, EV_ABS, ABS_MT_POSITION_Y, y);
+		add_event(rec, time, EV_ABS, ABS_X, x);
+		add_event(rec, time, EV_ABS, ABS_Y, y);
+		add_event(rec, time, EV_SYN, SYN_REPORT, 0);
+
+		time += 7000 + i % 3;
+	}
+
+	for (i = 0; i < rec->nevents; i++)
+		ck_assert_int_eq(recording_writer_add(writer,
+						      &rec->events[i]), 0);
+
+	ck_assert_int_eq(recording_writer_finish(writer), 0);
+	close(fd);
+}
+
+static void
+test_recording_destroy(struct test_recording *rec)
+{
+	unlink(rec->path);
+	free(rec->events);
+}
+
+static void
+assert_event_eq(const struct input_event *ev,
+		const struct input_event *expected)
+{
+	ck_assert_int_eq(ev->time.tv_sec, expected->time.tv_sec);
+	ck_assert_int_eq(ev->time.tv_usec, expected->time.tv_usec);
+	ck_assert_int_eq(ev->type, expected->type);
+	ck_assert_int_eq(ev->code, expected->code);
+	ck_assert_int_eq(ev->value, expected->value);
+}
+
+START_TEST(recording_round_trip)
+{
+	struct test_recording rec;
+	struct recording *recording;
+	const struct recording_header *header;
+	const struct recording_index_entry *index;
+	struct recording_cursor cursor;
+	struct input_event ev;
+	enum recording_read_status status;
+	size_t i, count;
+
+	test_recording_write(&rec);
+
+	recording = recording_open(rec.path);
+	ck_assert_notnull(recording);
+
+	header = recording_get_header(recording);
+	ck_assert_int_eq(header->nevents, rec.nevents);
+	ck_assert_str_eq(recording_get_description(recording)->name,
+			 "recording test touchpad");
+
+	/* the deltas are what makes it small */
+	ck_assert_int_lt(header->stream_size,
+			 rec.nevents * sizeof(struct input_event) / 3);
+
+	/* one keyframe at the start, then one per interval, each on a
+	 * frame boundary */
+	index = recording_get_index(recording, &count);
+	ck_assert_int_eq(count, 1 + rec.nevents / RECORDING_KEYFRAME_INTERVAL);
+	ck_assert_int_eq(index[0].event, 0);
+	for (i = 1; i < count; i++) {
+		ck_assert_int_ge(index[i].event - index[i - 1].event,
+				 RECORDING_KEYFRAME_INTERVAL);
+		ck_assert_int_lt(index[i].event - index[i - 1].event,
+				 RECORDING_KEYFRAME_INTERVAL + 5);
+		ck_assert_int_gt(index[i].time, index[i - 1].time);
+		ck_assert_int_eq(rec.events[index[i].event - 1].type, EV_SYN);
+	}
+
+	/* reading from the start passes over the keyframes */
+	recording_cursor_init(&cursor, recording);
+	for (i = 0; i < rec.nevents; i++) {
+		status = recording_cursor_next(&cursor, &ev);
+		ck_assert_int_eq(status, RECORDING_READ_EVENT);
+		assert_event_eq(&ev, &rec.events[i]);
+	}
+	ck_assert_int_eq(recording_cursor_next(&cursor, &ev),
+			 RECORDING_READ_END);
+	ck_assert_int_eq(recording_cursor_next(&cursor, &ev),
+			 RECORDING_READ_END);
+
+	recording_close(recording);
+	test_recording_destroy(&rec);
+}
+END_TEST
+
+START_TEST(recording_seek)
+{
+	struct test_recording rec;
+	struct recording *recording;
+	const struct recording_index_entry *index;
+	struct recording_cursor cursor;
+	struct input_event ev;
+	enum recording_read_status status;
+	size_t i, count, k;
+	uint64_t first;
+	int32_t x = 0;
+	bool have_x = false;
+
+	test_recording_write(&rec);
+
+	recording = recording_open(rec.path);
+	ck_assert_notnull(recording);
+	index = recording_get_index(recording, &count);
+	ck_assert_int_ge(count, 3);
+
+	recording_cursor_init(&cursor, recording);
+	for (k = 0; k < count; k++) {
+		/* anything before the next keyframe lands on this one */
+		first = recording_cursor_seek(&cursor, index[k].time + 1000);
+		ck_assert_int_eq(first, index[k].event);
+
+		for (i = first; i > 0; i--) {
+			if (rec.events[i - 1].type == EV_ABS &&
+			    rec.events[i - 1].code == ABS_X) {
+				x = rec.events[i - 1].value;
+				break;
+			}
+		}
+
+		/* the state first, terminated by a SYN_REPORT */
+		have_x = false;
+		while ((status = recording_cursor_next(&cursor, &ev)) ==
+		       RECORDING_READ_STATE) {
+			if (ev.type == EV_ABS && ev.code == ABS_X) {
+				ck_assert_int_eq(ev.value, x);
+				have_x = true;
+			}
+			if (ev.type == EV_SYN)
+				break;
+		}
+		ck_assert_int_eq(status, RECORDING_READ_STATE);
+		ck_assert_int_eq(ev.code, SYN_REPORT);
+		ck_assert(have_x == (first > 0));
+
+		/* then the events from the keyframe on */
+		for (i = first; i < rec.nevents; i++) {
+			status = recording_cursor_next(&cursor, &ev);
+			ck_assert_int_eq(status, RECORDING_READ_EVENT);
+			assert_event_eq(&ev, &rec.events[i]);
+		}
+		ck_assert_int_eq(recording_cursor_next(&cursor, &ev),
+				 RECORDING_READ_END);
+	}
+
+	/* before the first keyframe is the first keyframe */
+	ck_assert_int_eq(recording_cursor_seek(&cursor, 0), 0);
+
+	recording_close(recording);
+	test_recording_destroy(&rec);
+}
+END_TEST
+
+/* Deltas between the ends of the int32 range don't fit an int32 */
+START_TEST(recording_abs_extremes)
+{
+	struct recording_description desc;
+	struct recording_writer *writer;
+	struct recording *recording;
+	struct recording_cursor cursor;
+	struct input_event events[6], ev;
+	char path[] = "/tmp/litest-recording-XXXXXX";
+	int32_t values[] = { INT32_MIN, INT32_MAX, INT32_MIN };
+	size_t i, nevents = 0;
+	int fd;
+
+	memset(&desc, 0, sizeof(desc));
+	strcpy(desc.name, "recording test extremes");
+	recording_description_enable_code(&desc, EV_ABS, ABS_X);
+	desc.abs[ABS_X].minimum = INT32_MIN;
+	desc.abs[ABS_X].maximum = INT32_MAX;
+
+	for (i = 0; i < ARRAY_LENGTH(values); i++) {
+		events[nevents].time.tv_sec = 1;
+		events[nevents].time.tv_usec = i;
+		events[nevents].type = EV_ABS;
+		events[nevents].code = ABS_X;
+		events[nevents++].value = values[i];
+		events[nevents] = events[nevents - 1];
+		events[nevents].type = EV_SYN;
+		events[nevents].code = SYN_REPORT;
+		events[nevents++].value = 0;
+	}
+
+	fd = mkstemp(path);
+	ck_assert_int_ge(fd, 0);
+	writer = recording_writer_new(fd, &desc);
+	ck_assert_notnull(writer);
+	for (i = 0; i < nevents; i++)
+		ck_assert_int_eq(recording_writer_add(writer, &events[i]), 0);
+	ck_assert_int_eq(recording_writer_finish(writer), 0);
+	close(fd);
+
+	recording = recording_open(path);
+	ck_assert_notnull(recording);
+	recording_cursor_init(&cursor, recording);
+	for (i = 0; i < nevents; i++) {
+		ck_assert_int_eq(recording_cursor_next(&cursor, &ev),
+				 RECORDING_READ_EVENT);
+		assert_event_eq(&ev, &events[i]);
+	}
+	ck_assert_int_eq(recording_cursor_next(&cursor, &ev),
+			 RECORDING_READ_END);
+	recording_close(recording);
+
+	unlink(path);
+}
+END_TEST
+
+static void
+patch_file(const char *path, off_t offset, const void *data, size_t size)
+{
+	FILE *fp;
+
+	fp = fopen(path, "r+");
+	ck_assert_notnull(fp);
+	ck_assert_int_eq(fseek(fp, offset, SEEK_SET), 0);
+	ck_assert_int_eq(fwrite(data, size, 1, fp), 1);
+	fclose(fp);
+}
+
+START_TEST(recording_invalid_index)
+{
+	struct test_recording rec;
+	struct recording *recording;
+	struct recording_header header;
+	uint64_t offset;
+
+	test_recording_write(&rec);
+
+	recording = recording_open(rec.path);
+	ck_assert_notnull(recording);
+	header = *recording_get_header(recording);
+	recording_close(recording);
+
+	/* a keyframe at the very end of the stream */
+	offset = header.stream_size;
+	patch_file(rec.path,
+		   header.index_offset +
+		   offsetof(struct recording_index_entry, offset),
+		   &offset, sizeof(offset));
+	ck_assert(recording_open(rec.path) == NULL);
+
+	test_recording_destroy(&rec);
+}
+END_TEST
+
+START_TEST(recording_invalid_name)
+{
+	struct test_recording rec;
+	struct recording *recording;
+	struct recording_header header;
+	char name[sizeof(((struct recording_description *)NULL)->name)];
+
+	test_recording_write(&rec);
+
+	recording = recording_open(rec.path);
+	ck_assert_notnull(recording);
+	header = *recording_get_header(recording);
+	recording_close(recording);
+
+	/* a name without its terminating NUL */
+	memset(name, 'a', sizeof(name));
+	patch_file(rec.path,
+		   header.description_offset +
+		   offsetof(struct recording_description, name),
+		   name, sizeof(name));
+	ck_assert(recording_open(rec.path) == NULL);
+
+	test_recording_destroy(&rec);
+}
+END_TEST
+
+START_TEST(recording_invalid_keyframe_type)
+{
+	struct test_recording rec;
+	struct recording *recording;
+	struct recording_header header;
+	struct recording_cursor cursor;
+	struct input_event ev;
+	uint8_t type = EV_MAX + 1;
+	uint8_t buf[32];
+	size_t n = 1;
+	int fd, i;
+
+	test_recording_write(&rec);
+
+	recording = recording_open(rec.path);
+	ck_assert_notnull(recording);
+	header = *recording_get_header(recording);
+	recording_close(recording);
+
+	/* the first keyframe is at the start of the stream: the tag, the
+	 * time and count varints, then the type of the first entry */
+	fd = open(rec.path, O_RDONLY);
+	ck_assert_int_ge(fd, 0);
+	ck_assert_int_eq(pread(fd, buf, sizeof(buf), header.stream_offset),
+			 (ssize_t)sizeof(buf));
+	close(fd);
+	for (i = 0; i < 2; i++) {
+		while (buf[n] & 0x80)
+			n++;
+		n++;
+	}
+	ck_assert_int_lt(n, sizeof(buf));
+	patch_file(rec.path, header.stream_offset + n, &type, sizeof(type));
+
+	recording = recording_open(rec.path);
+	ck_assert_notnull(recording);
+	recording_cursor_init(&cursor, recording);
+	ck_assert_int_eq(recording_cursor_next(&cursor, &ev),
+			 RECORDING_READ_ERROR);
+	recording_close(recording);
+
+	test_recording_destroy(&rec);
+}
+END_TEST
+
+int
+main(int argc, char **argv)
+{
+	litest_add_no_device("recording:format", recording_round_trip);
+	litest_add_no_device("recording:format", recording_seek);
+	litest_add_no_device("recording:format", recording_abs_extremes);
+	litest_add_no_device("recording:invalid", recording_invalid_index);
+	litest_add_no_device("recording:invalid", recording_invalid_name);
+	litest_add_no_device("recording:invalid", recording_invalid_keyframe_type);
+
+	return litest_run(argc, argv);
+}
@@ -0,0 +1,233 @@
+/*
+ * Copyright © 2015 Red Hat, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* These tests are most useful when built with --enable-thread-sanitizer */
+
+#include <config.h>
+
+#include <check.h>
+#include <libinput.h>
+#include <libinput-util.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "litest.h"
+
+#define NWORKERS 4
+#define QUEUE_SIZE 64
+#define TRANSFORM_WIDTH 1920
+#define TRANSFORM_HEIGHT 1080
+
+/* Hands events from the dispatching thread to the workers */
+struct event_queue {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct libinput_event *events[QUEUE_SIZE];
+	unsigned int in, count;
+	bool closed;
+
+	/* results, only updated with the lock held */
+	int ntouch, nmotion, nremoved;
+	int out_of_range;
+};
+
+static void
+event_queue_push(struct event_queue *q, struct libinput_event *event)
+{
+	pthread_mutex_lock(&q->lock);
+	while (q->count == QUEUE_SIZE)
+		pthread_cond_wait(&q->cond, &q->lock);
+
+	q->events[(q->in + q->count) % QUEUE_SIZE] = event;
+	q->count++;
+	pthread_cond_broadcast(&q->cond);
+	pthread_mutex_unlock(&q->lock);
+}
+
+static struct libinput_event *
+event_queue_pop(struct event_queue *q)
+{
+	struct libinput_event *event = NULL;
+
+	pthread_mutex_lock(&q->lock);
+	while (q->count == 0 && !q->closed)
+		pthread_cond_wait(&q->cond, &q->lock);
+
+	if (q->count > 0) {
+		event = q->events[q->in];
+		q->in = (q->in + 1) % QUEUE_SIZE;
+		q->count--;
+		pthread_cond_broadcast(&q->cond);
+	}
+	pthread_mutex_unlock(&q->lock);
+
+	return event;
+}
+
+static void
+event_queue_close(struct event_queue *q)
+{
+	pthread_mutex_lock(&q->lock);
+	q->closed = true;
+	pthread_cond_broadcast(&q->cond);
+	pthread_mutex_unlock(&q->lock);
+}
+
+static void
+push_events(struct libinput *li, struct event_queue *q)
+{
+	struct libinput_event *event;
+
+	libinput_dispatch(li);
+	while ((event = libinput_get_event(li)))
+		event_queue_push(q, event);
+}
+
+static void *
+worker(void *data)
+{
+	struct event_queue *q = data;
+	struct libinput_event *event;
+	struct libinput_event_touch *touch;
+	struct libinput_device *device;
+	double x, y;
+	int ntouch, nmotion, nremoved, out_of_range;
+
+	while ((event = event_queue_pop(q))) {
+		ntouch = 0;
+		nmotion = 0;
+		nremoved = 0;
+		out_of_range = 0;
+
+		/* keep the device around for longer than the event, like
+		 * a client would */
+		device = libinput_device_ref(libinput_event_get_device(event));
+		libinput_event_get_context(event);
+
+		switch (libinput_event_get_type(event)) {
+		case LIBINPUT_EVENT_DEVICE_REMOVED:
+			nremoved++;
+			break;
+		case LIBINPUT_EVENT_TOUCH_DOWN:
+		case LIBINPUT_EVENT_TOUCH_MOTION:
+			touch = libinput_event_get_touch_event(event);
+			x = libinput_event_touch_get_x_transformed(touch,
+								   TRANSFORM_WIDTH);
+			y = libinput_event_touch_get_y_transformed(touch,
+								   TRANSFORM_HEIGHT);
+			libinput_event_touch_get_x(touch);
+			libinput_event_touch_get_y(touch);
+			if (x < 0 || x > TRANSFORM_WIDTH ||
+			    y < 0 || y > TRANSFORM_HEIGHT)
+				out_of_range++;
+			ntouch++;
+			break;
+		case LIBINPUT_EVENT_POINTER_MOTION:
+			libinput_event_pointer_get_dx(
+				libinput_event_get_pointer_event(event));
+			nmotion++;
+			break;
+		default:
+			break;
+		}
+
+		libinput_event_destroy(event);
+		libinput_device_unref(device);
+
+		pthread_mutex_lock(&q->lock);
+		q->ntouch += ntouch;
+		q->nmotion += nmotion;
+		q->nremoved += nremoved;
+		q->out_of_range += out_of_range;
+		pthread_mutex_unlock(&q->lock);
+	}
+
+	return NULL;
+}
+
+START_TEST(threads_event_handover)
+{
+	struct libinput *li;
+	struct litest_device *touch, *mouse;
+	struct event_queue q;
+	pthread_t threads[NWORKERS];
+	int i;
+
+	memset(&q, 0, sizeof(q));
+	pthread_mutex_init(&q.lock, NULL);
+	pthread_cond_init(&q.cond, NULL);
+
+	li = litest_create_context();
+	ck_assert_int_eq(libinput_set_thread_safe_events(li, 1), 0);
+
+	touch = litest_add_device(li, LITEST_WACOM_TOUCH);
+	mouse = litest_add_device(li, LITEST_MOUSE);
+	litest_drain_events(li);
+
+	for (i = 0; i < NWORKERS; i++)
+		ck_assert_int_eq(pthread_create(&threads[i], NULL, worker, &q), 0);
+
+	for (i = 0; i < 200; i++) {
+		litest_touch_down(touch, 0, 20, 20);
+		litest_touch_move(touch, 0, 20 + i % 50, 30);
+		litest_touch_up(touch, 0);
+
+		litest_event(mouse, EV_REL, REL_X, 1);
+		litest_event(mouse, EV_SYN, SYN_REPORT, 0);
+
+		push_events(li, &q);
+	}
+
+	/* the workers may still hold events and references to the
+	 * device when it goes away */
+	litest_delete_device(touch);
+	push_events(li, &q);
+
+	event_queue_close(&q);
+	for (i = 0; i < NWORKERS; i++)
+		pthread_join(threads[i], NULL);
+
+	/* destroys the touch device */
+	libinput_dispatch(li);
+	litest_drain_events(li);
+
+	ck_assert_int_gt(q.ntouch, 0);
+	ck_assert_int_gt(q.nmotion, 0);
+	ck_assert_int_eq(q.nremoved, 1);
+	ck_assert_int_eq(q.out_of_range, 0);
+
+	litest_delete_device(mouse);
+	libinput_unref(li);
+
+	pthread_cond_destroy(&q.cond);
+	pthread_mutex_destroy(&q.lock);
+}
+END_TEST
+
+int
+main(int argc, char **argv)
+{
+	litest_add_no_device("threads:events", threads_event_handover);
+
+	return litest_run(argc, argv);
+}
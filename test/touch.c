@@ -30,6 +30,7 @@
 #include <unistd.h>
 
 #include "libinput-util.h"
+#include "evdev-mt-protocol-a.h"
 #include "litest.h"
 
 START_TEST(touch_frame_events)
@@ -401,6 +402,135 @@ START_TEST(touch_calibration_translation)
 }
 END_TEST
 
+START_TEST(touch_transformed_batch)
+{
+	struct litest_device *dev = litest_current_device();
+	struct libinput *li = dev->libinput;
+	struct libinput_event *events[2];
+	struct libinput_event_touch *tevents[2];
+	double x[2], y[2];
+	const uint32_t sizes[][2] = {
+		{ 1920, 1080 },
+		{ 640, 480 },
+		{ 1920, 1080 },
+	};
+	int nevents = 0;
+	size_t i, j;
+
+	litest_drain_events(li);
+
+	litest_touch_down(dev, 0, 10, 10);
+	litest_touch_down(dev, 1, 50, 60);
+	libinput_dispatch(li);
+
+	while (nevents < 2) {
+		struct libinput_event *ev;
+
+		litest_wait_for_event(li);
+		ev = libinput_get_event(li);
+		if (libinput_event_get_type(ev) != LIBINPUT_EVENT_TOUCH_DOWN) {
+			libinput_event_destroy(ev);
+			continue;
+		}
+
+		events[nevents] = ev;
+		tevents[nevents] = libinput_event_get_touch_event(ev);
+		nevents++;
+	}
+
+	/* changing the output size in between must not leave stale values */
+	for (i = 0; i < ARRAY_LENGTH(sizes); i++) {
+		libinput_event_touch_get_transformed_batch(tevents, nevents,
+							   sizes[i][0],
+							   sizes[i][1],
+							   x, y);
+
+		for (j = 0; j < (size_t)nevents; j++) {
+			ck_assert(x[j] ==
+				  libinput_event_touch_get_x_transformed(tevents[j],
+									 sizes[i][0]));
+			ck_assert(y[j] ==
+				  libinput_event_touch_get_y_transformed(tevents[j],
+									 sizes[i][1]));
+		}
+	}
+
+	for (j = 0; j < (size_t)nevents; j++)
+		libinput_event_destroy(events[j]);
+
+	litest_touch_up(dev, 0);
+	litest_touch_up(dev, 1);
+}
+END_TEST
+
+START_TEST(touch_transformed_batch_devices)
+{
+	struct litest_device *dev = litest_current_device();
+	struct litest_device *other;
+	struct libinput *li = dev->libinput;
+	struct libinput_event *ev;
+	struct libinput_event *events[3];
+	struct libinput_event_touch *tevents[3];
+	double x[3], y[3];
+	int nevents = 0;
+	size_t i;
+
+	other = litest_add_device(li, LITEST_GENERIC_SINGLETOUCH);
+	litest_drain_events(li);
+
+	litest_touch_down(dev, 0, 10, 10);
+	litest_touch_down(other, 0, 30, 40);
+	litest_touch_down(dev, 1, 50, 60);
+	libinput_dispatch(li);
+
+	while (nevents < 3) {
+		litest_wait_for_event(li);
+		ev = libinput_get_event(li);
+		if (libinput_event_get_type(ev) != LIBINPUT_EVENT_TOUCH_DOWN) {
+			libinput_event_destroy(ev);
+			continue;
+		}
+
+		events[nevents++] = ev;
+	}
+
+	/* The devices' ranges differ. Put the other device's event in the
+	 * middle so the batch has to switch devices twice. */
+	for (i = 0; i < (size_t)nevents; i++) {
+		if (libinput_event_get_device(events[i]) !=
+		    other->libinput_device)
+			continue;
+
+		ev = events[i];
+		events[i] = events[1];
+		events[1] = ev;
+		break;
+	}
+	for (i = 0; i < (size_t)nevents; i++)
+		tevents[i] = libinput_event_get_touch_event(events[i]);
+
+	libinput_event_touch_get_transformed_batch(tevents, nevents,
+						   1920, 1080,
+						   x, y);
+	for (i = 0; i < (size_t)nevents; i++) {
+		ck_assert(x[i] ==
+			  libinput_event_touch_get_x_transformed(tevents[i],
+								 1920));
+		ck_assert(y[i] ==
+			  libinput_event_touch_get_y_transformed(tevents[i],
+								 1080));
+	}
+
+	for (i = 0; i < (size_t)nevents; i++)
+		libinput_event_destroy(events[i]);
+
+	litest_touch_up(dev, 0);
+	litest_touch_up(other, 0);
+	litest_touch_up(dev, 1);
+	litest_delete_device(other);
+}
+END_TEST
+
 START_TEST(touch_no_left_handed)
 {
 	struct litest_device *dev = litest_current_device();
@@ -465,6 +595,209 @@ START_TEST(fake_mt_no_touch_events)
 }
 END_TEST
 
+static void
+protocol_a_contact(struct litest_device *dev, int x, int y)
+{
+	litest_event(dev, EV_ABS, ABS_MT_POSITION_X, x);
+	litest_event(dev, EV_ABS, ABS_MT_POSITION_Y, y);
+	litest_event(dev, EV_SYN, SYN_MT_REPORT, 0);
+}
+
+/* The test device's axes are 0..32767, so transforming to 32768 gives
+ * back the device coordinates */
+static void
+assert_protocol_a_touch(struct libinput *li,
+			enum libinput_event_type type,
+			int slot,
+			int x,
+			int y)
+{
+	struct libinput_event *event;
+	struct libinput_event_touch *tev;
+
+	event = libinput_get_event(li);
+	ck_assert_notnull(event);
+	ck_assert_int_eq(libinput_event_get_type(event), type);
+
+	tev = libinput_event_get_touch_event(event);
+	ck_assert_int_eq(libinput_event_touch_get_slot(tev), slot);
+
+	if (type != LIBINPUT_EVENT_TOUCH_UP) {
+		ck_assert_int_eq(libinput_event_touch_get_x_transformed(tev, 32768), x);
+		ck_assert_int_eq(libinput_event_touch_get_y_transformed(tev, 32768), y);
+	}
+
+	libinput_event_destroy(event);
+}
+
+static void
+assert_protocol_a_frame(struct libinput *li)
+{
+	struct libinput_event *event;
+
+	event = libinput_get_event(li);
+	ck_assert_notnull(event);
+	ck_assert_int_eq(libinput_event_get_type(event),
+			 LIBINPUT_EVENT_TOUCH_FRAME);
+	libinput_event_destroy(event);
+}
+
+START_TEST(touch_protocol_a_add_remove)
+{
+	struct litest_device *dev = litest_current_device();
+	struct libinput *li = dev->libinput;
+
+	litest_drain_events(li);
+
+	protocol_a_contact(dev, 1000, 2000);
+	litest_event(dev, EV_SYN, SYN_REPORT, 0);
+	libinput_dispatch(li);
+	assert_protocol_a_touch(li, LIBINPUT_EVENT_TOUCH_DOWN, 0, 1000, 2000);
+	assert_protocol_a_frame(li);
+
+	/* a second contact is added, the first one doesn't change */
+	protocol_a_contact(dev, 1000, 2000);
+	protocol_a_contact(dev, 20000, 30000);
+	litest_event(dev, EV_SYN, SYN_REPORT, 0);
+	libinput_dispatch(li);
+	assert_protocol_a_touch(li, LIBINPUT_EVENT_TOUCH_DOWN, 1, 20000, 30000);
+	assert_protocol_a_frame(li);
+
+	/* the first contact goes away, the second one moves */
+	protocol_a_contact(dev, 20100, 30000);
+	litest_event(dev, EV_SYN, SYN_REPORT, 0);
+	libinput_dispatch(li);
+	assert_protocol_a_touch(li, LIBINPUT_EVENT_TOUCH_UP, 0, 0, 0);
+	assert_protocol_a_touch(li, LIBINPUT_EVENT_TOUCH_MOTION, 1, 20100, 30000);
+	assert_protocol_a_frame(li);
+
+	/* no contacts, just the SYN_MT_REPORT */
+	litest_event(dev, EV_SYN, SYN_MT_REPORT, 0);
+	litest_event(dev, EV_SYN, SYN_REPORT, 0);
+	libinput_dispatch(li);
+	assert_protocol_a_touch(li, LIBINPUT_EVENT_TOUCH_UP, 1, 0, 0);
+	assert_protocol_a_frame(li);
+
+	litest_assert_empty_queue(li);
+}
+END_TEST
+
+START_TEST(touch_protocol_a_reorder)
+{
+	struct litest_device *dev = litest_current_device();
+	struct libinput *li = dev->libinput;
+
+	litest_drain_events(li);
+
+	protocol_a_contact(dev, 1000, 1000);
+	protocol_a_contact(dev, 30000, 30000);
+	litest_event(dev, EV_SYN, SYN_REPORT, 0);
+	libinput_dispatch(li);
+	assert_protocol_a_touch(li, LIBINPUT_EVENT_TOUCH_DOWN, 0, 1000, 1000);
+	assert_protocol_a_touch(li, LIBINPUT_EVENT_TOUCH_DOWN, 1, 30000, 30000);
+	assert_protocol_a_frame(li);
+
+	/* same two contacts, reported the other way round: each one must
+	 * stay in its slot */
+	protocol_a_contact(dev, 30100, 30000);
+	protocol_a_contact(dev, 1100, 1000);
+	litest_event(dev, EV_SYN, SYN_REPORT, 0);
+	libinput_dispatch(li);
+	assert_protocol_a_touch(li, LIBINPUT_EVENT_TOUCH_MOTION, 0, 1100, 1000);
+	assert_protocol_a_touch(li, LIBINPUT_EVENT_TOUCH_MOTION, 1, 30100, 30000);
+	assert_protocol_a_frame(li);
+
+	litest_assert_empty_queue(li);
+}
+END_TEST
+
+START_TEST(touch_protocol_a_too_many_contacts)
+{
+	struct litest_device *dev = litest_current_device();
+	struct libinput *li = dev->libinput;
+	struct libinput_event *event;
+	int i;
+	int down = 0, up = 0;
+
+	litest_drain_events(li);
+
+	for (i = 0; i < MT_PROTOCOL_A_MAX_SLOTS + 8; i++)
+		protocol_a_contact(dev, 500 * i, 500 * i);
+	litest_event(dev, EV_SYN, SYN_REPORT, 0);
+
+	litest_event(dev, EV_SYN, SYN_MT_REPORT, 0);
+	litest_event(dev, EV_SYN, SYN_REPORT, 0);
+	libinput_dispatch(li);
+
+	/* the contacts beyond the limit are dropped, the others come
+	 * and go as usual */
+	while ((event = libinput_get_event(li))) {
+		switch (libinput_event_get_type(event)) {
+		case LIBINPUT_EVENT_TOUCH_DOWN:
+			ck_assert_int_eq(up, 0);
+			down++;
+			break;
+		case LIBINPUT_EVENT_TOUCH_UP:
+			up++;
+			break;
+		case LIBINPUT_EVENT_TOUCH_FRAME:
+			break;
+		default:
+			ck_abort_msg("Unexpected event type %d",
+				     libinput_event_get_type(event));
+		}
+		libinput_event_destroy(event);
+	}
+
+	ck_assert_int_eq(down, MT_PROTOCOL_A_MAX_SLOTS);
+	ck_assert_int_eq(up, MT_PROTOCOL_A_MAX_SLOTS);
+}
+END_TEST
+
+START_TEST(touch_protocol_a_tracking_id_without_position)
+{
+	struct litest_device *dev = litest_current_device();
+	struct libinput *li = dev->libinput;
+
+	litest_drain_events(li);
+
+	litest_event(dev, EV_ABS, ABS_MT_TRACKING_ID, 5);
+	protocol_a_contact(dev, 1000, 2000);
+	litest_event(dev, EV_SYN, SYN_REPORT, 0);
+	libinput_dispatch(li);
+	assert_protocol_a_touch(li, LIBINPUT_EVENT_TOUCH_DOWN, 0, 1000, 2000);
+	assert_protocol_a_frame(li);
+
+	/* The contact is still there but the device didn't send a
+	 * position, it must stay where it was rather than jump to 0/0.
+	 * A new contact without a position can't start a touch. */
+	litest_event(dev, EV_ABS, ABS_MT_TRACKING_ID, 5);
+	litest_event(dev, EV_SYN, SYN_MT_REPORT, 0);
+	litest_event(dev, EV_ABS, ABS_MT_TRACKING_ID, 6);
+	litest_event(dev, EV_SYN, SYN_MT_REPORT, 0);
+	litest_event(dev, EV_SYN, SYN_REPORT, 0);
+	libinput_dispatch(li);
+	litest_assert_empty_queue(li);
+
+	/* only one axis sent, the other one is kept */
+	litest_event(dev, EV_ABS, ABS_MT_TRACKING_ID, 5);
+	litest_event(dev, EV_ABS, ABS_MT_POSITION_X, 1500);
+	litest_event(dev, EV_SYN, SYN_MT_REPORT, 0);
+	litest_event(dev, EV_SYN, SYN_REPORT, 0);
+	libinput_dispatch(li);
+	assert_protocol_a_touch(li, LIBINPUT_EVENT_TOUCH_MOTION, 0, 1500, 2000);
+	assert_protocol_a_frame(li);
+
+	litest_event(dev, EV_SYN, SYN_MT_REPORT, 0);
+	litest_event(dev, EV_SYN, SYN_REPORT, 0);
+	libinput_dispatch(li);
+	assert_protocol_a_touch(li, LIBINPUT_EVENT_TOUCH_UP, 0, 0, 0);
+	assert_protocol_a_frame(li);
+
+	litest_assert_empty_queue(li);
+}
+END_TEST
+
 int
 main(int argc, char **argv)
 {
@@ -479,10 +812,18 @@ main(int argc, char **argv)
 	litest_add("touch:calibration", touch_calibration_translation, LITEST_TOUCH, LITEST_TOUCHPAD);
 	litest_add("touch:calibration", touch_calibration_translation, LITEST_SINGLE_TOUCH, LITEST_TOUCHPAD);
 
+	litest_add("touch:transformed-batch", touch_transformed_batch, LITEST_TOUCH, LITEST_ANY);
+	litest_add_for_device("touch:transformed-batch", touch_transformed_batch_devices, LITEST_WACOM_TOUCH);
+
 	litest_add("touch:left-handed", touch_no_left_handed, LITEST_TOUCH, LITEST_ANY);
 
 	litest_add("touch:fake-mt", fake_mt_exists, LITEST_FAKE_MT, LITEST_ANY);
 	litest_add("touch:fake-mt", fake_mt_no_touch_events, LITEST_FAKE_MT, LITEST_ANY);
 
+	litest_add_for_device("touch:protocol-a", touch_protocol_a_add_remove, LITEST_PROTOCOL_A_SCREEN);
+	litest_add_for_device("touch:protocol-a", touch_protocol_a_reorder, LITEST_PROTOCOL_A_SCREEN);
+	litest_add_for_device("touch:protocol-a", touch_protocol_a_too_many_contacts, LITEST_PROTOCOL_A_SCREEN);
+	litest_add_for_device("touch:protocol-a", touch_protocol_a_tracking_id_without_position, LITEST_PROTOCOL_A_SCREEN);
+
 	return litest_run(argc, argv);
 }
@@ -26,7 +26,9 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <libinput.h>
+#include <libinput-util.h>
 #include <libudev.h>
+#include <poll.h>
 #include <unistd.h>
 
 #include "litest.h"
@@ -282,7 +284,7 @@ START_TEST(udev_double_suspend)
 
 	li = libinput_udev_create_context(&simple_interface, NULL, udev);
 	ck_assert(li != NULL);
-	ck_assert_int_eq(libinput_udev_assign_seat(li, "seat0"), 0);
+	ck_assert_int_eq(libinput_udev_assign_seat(li, litest_udev_seat()), 0);
 
 	fd = libinput_get_fd(li);
 	ck_assert_int_ge(fd, 0);
@@ -314,7 +316,7 @@ START_TEST(udev_double_resume)
 
 	li = libinput_udev_create_context(&simple_interface, NULL, udev);
 	ck_assert(li != NULL);
-	ck_assert_int_eq(libinput_udev_assign_seat(li, "seat0"), 0);
+	ck_assert_int_eq(libinput_udev_assign_seat(li, litest_udev_seat()), 0);
 
 	fd = libinput_get_fd(li);
 	ck_assert_int_ge(fd, 0);
@@ -366,7 +368,7 @@ START_TEST(udev_suspend_resume)
 
 	li = libinput_udev_create_context(&simple_interface, NULL, udev);
 	ck_assert(li != NULL);
-	ck_assert_int_eq(libinput_udev_assign_seat(li, "seat0"), 0);
+	ck_assert_int_eq(libinput_udev_assign_seat(li, litest_udev_seat()), 0);
 
 	fd = libinput_get_fd(li);
 	ck_assert_int_ge(fd, 0);
@@ -406,7 +408,7 @@ START_TEST(udev_device_sysname)
 
 	li = libinput_udev_create_context(&simple_interface, NULL, udev);
 	ck_assert(li != NULL);
-	ck_assert_int_eq(libinput_udev_assign_seat(li, "seat0"), 0);
+	ck_assert_int_eq(libinput_udev_assign_seat(li, litest_udev_seat()), 0);
 
 	libinput_dispatch(li);
 
@@ -444,7 +446,7 @@ START_TEST(udev_seat_recycle)
 
 	li = libinput_udev_create_context(&simple_interface, NULL, udev);
 	ck_assert(li != NULL);
-	ck_assert_int_eq(libinput_udev_assign_seat(li, "seat0"), 0);
+	ck_assert_int_eq(libinput_udev_assign_seat(li, litest_udev_seat()), 0);
 
 	libinput_dispatch(li);
 	while ((ev = libinput_get_event(li))) {
@@ -502,6 +504,130 @@ START_TEST(udev_seat_recycle)
 }
 END_TEST
 
+/* Other test processes add and remove devices too, only count ours */
+static int
+device_is_on_litest_seat(struct udev_device *udev_device)
+{
+	const char *seat;
+
+	seat = udev_device_get_property_value(udev_device, "ID_SEAT");
+	if (!seat)
+		seat = "seat0";
+
+	return strcmp(seat, litest_udev_seat()) == 0;
+}
+
+static void
+wait_for_udev_events(struct udev_monitor *monitor,
+		     const char *action,
+		     int count)
+{
+	struct udev_device *udev_device;
+	struct pollfd fds;
+
+	fds.fd = udev_monitor_get_fd(monitor);
+	fds.events = POLLIN;
+
+	while (count > 0) {
+		ck_assert_int_gt(poll(&fds, 1, 2000), 0);
+
+		udev_device = udev_monitor_receive_device(monitor);
+		if (!udev_device)
+			continue;
+
+		if (strncmp("event", udev_device_get_sysname(udev_device), 5) == 0 &&
+		    strcmp(action, udev_device_get_action(udev_device)) == 0 &&
+		    device_is_on_litest_seat(udev_device))
+			count--;
+
+		udev_device_unref(udev_device);
+	}
+}
+
+static int
+count_hotplug_devices(struct libinput *li,
+		      enum libinput_event_type type)
+{
+	struct libinput_event *event;
+	const char *name;
+	int count = 0;
+
+	while ((event = libinput_get_event(li))) {
+		name = libinput_device_get_name(libinput_event_get_device(event));
+
+		if (libinput_event_get_type(event) == type) {
+			/* removed again before libinput saw it */
+			ck_assert_str_ne(name, "litest hotplug cancelled");
+			if (strcmp(name, "litest hotplug") == 0)
+				count++;
+		}
+
+		libinput_event_destroy(event);
+	}
+
+	return count;
+}
+
+START_TEST(udev_hotplug_batch)
+{
+	struct udev *udev;
+	struct udev_monitor *monitor;
+	struct libinput *li;
+	struct libevdev_uinput *uinput[3], *cancelled;
+	unsigned int i;
+
+	udev = udev_new();
+	ck_assert(udev != NULL);
+
+	monitor = udev_monitor_new_from_netlink(udev, "udev");
+	ck_assert(monitor != NULL);
+	udev_monitor_filter_add_match_subsystem_devtype(monitor, "input", NULL);
+	ck_assert_int_eq(udev_monitor_enable_receiving(monitor), 0);
+
+	li = libinput_udev_create_context(&simple_interface, NULL, udev);
+	ck_assert(li != NULL);
+	ck_assert_int_eq(libinput_udev_assign_seat(li, litest_udev_seat()), 0);
+	litest_drain_events(li);
+
+	for (i = 0; i < ARRAY_LENGTH(uinput); i++)
+		uinput[i] = litest_create_uinput_device("litest hotplug", NULL,
+							EV_KEY, BTN_LEFT,
+							EV_REL, REL_X,
+							EV_REL, REL_Y,
+							-1);
+
+	/* this one is gone before libinput sees it */
+	cancelled = litest_create_uinput_device("litest hotplug cancelled",
+						NULL,
+						EV_KEY, BTN_LEFT,
+						EV_REL, REL_X,
+						EV_REL, REL_Y,
+						-1);
+	libevdev_uinput_destroy(cancelled);
+
+	wait_for_udev_events(monitor, "add", ARRAY_LENGTH(uinput) + 1);
+	wait_for_udev_events(monitor, "remove", 1);
+
+	/* a single dispatch picks up all pending udev events */
+	libinput_dispatch(li);
+	ck_assert_int_eq(count_hotplug_devices(li, LIBINPUT_EVENT_DEVICE_ADDED),
+			 ARRAY_LENGTH(uinput));
+
+	for (i = 0; i < ARRAY_LENGTH(uinput); i++)
+		libevdev_uinput_destroy(uinput[i]);
+
+	wait_for_udev_events(monitor, "remove", ARRAY_LENGTH(uinput));
+
+	libinput_dispatch(li);
+	ck_assert_int_eq(count_hotplug_devices(li, LIBINPUT_EVENT_DEVICE_REMOVED),
+			 ARRAY_LENGTH(uinput));
+
+	libinput_unref(li);
+	udev_monitor_unref(monitor);
+	udev_unref(udev);
+}
+END_TEST
+
 int
 main(int argc, char **argv)
 {
@@ -518,6 +644,7 @@ main(int argc, char **argv)
 	litest_add_for_device("udev:suspend", udev_suspend_resume, LITEST_SYNAPTICS_CLICKPAD);
 	litest_add_for_device("udev:device events", udev_device_sysname, LITEST_SYNAPTICS_CLICKPAD);
 	litest_add_for_device("udev:seat", udev_seat_recycle, LITEST_SYNAPTICS_CLICKPAD);
+	litest_add_no_device("udev:hotplug", udev_hotplug_batch);
 
 	return litest_run(argc, argv);
 }
@@ -0,0 +1,314 @@
+/*
+ * Copyright © 2015 Red Hat, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* Records the events of a device together with everything libinput
+ * needs to set the device up, see src/recording.h for the format */
+
+#define _GNU_SOURCE
+#include <config.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
+#include <libevdev/libevdev.h>
+#include <libudev.h>
+
+#include "libinput-util.h"
+#include "recording.h"
+
+/* The udev properties libinput looks at */
+static const char *properties[] = {
+	"ID_INPUT",
+	"ID_INPUT_KEYBOARD",
+	"ID_INPUT_MOUSE",
+	"ID_INPUT_TOUCHPAD",
+	"ID_INPUT_TOUCHSCREEN",
+	"ID_INPUT_TABLET",
+	"ID_SEAT",
+	"WL_SEAT",
+	"WL_OUTPUT",
+	"MOUSE_DPI",
+	"LIBINPUT_CALIBRATION_MATRIX",
+};
+
+enum options {
+	OPT_OUTPUT,
+	OPT_HELP,
+};
+
+static void
+usage(void)
+{
+	printf("Usage: %s [options] /dev/input/event0\n"
+	       "Records the device's events until interrupted with Ctrl+C.\n"
+	       "\n"
+	       "--output <file> .. Write the recording to file (default: recording.lirec)\n"
+	       "--help ........... Print this help.\n",
+	       program_invocation_short_name);
+}
+
+static void
+describe_udev_properties(struct recording_description *desc,
+			 const char *path)
+{
+	struct udev *udev;
+	struct udev_device *udev_device;
+	struct stat st;
+	const char *value;
+	size_t i;
+
+	if (stat(path, &st) < 0)
+		return;
+
+	udev = udev_new();
+	if (!udev)
+		return;
+
+	udev_device = udev_device_new_from_devnum(udev, 'c', st.st_rdev);
+	for (i = 0; udev_device && i < ARRAY_LENGTH(properties); i++) {
+		value = udev_device_get_property_value(udev_device,
+						       properties[i]);
+		if (value &&
+		    recording_description_add_property(desc,
+						       properties[i],
+						       value) != 0)
+			fprintf(stderr,
+				"Skipping udev property %s\n",
+				properties[i]);
+	}
+
+	udev_device_unref(udev_device);
+	udev_unref(udev);
+}
+
+static void
+describe_device(struct recording_description *desc,
+		struct libevdev *evdev,
+		const char *path)
+{
+	const struct input_absinfo *absinfo;
+	unsigned int type, code;
+	int max;
+
+	memset(desc, 0, sizeof(*desc));
+
+	snprintf(desc->name, sizeof(desc->name), "%s",
+		 libevdev_get_name(evdev));
+	desc->bustype = libevdev_get_id_bustype(evdev);
+	desc->vendor = libevdev_get_id_vendor(evdev);
+	desc->product = libevdev_get_id_product(evdev);
+	desc->version = libevdev_get_id_version(evdev);
+
+	for (code = 0; code < INPUT_PROP_CNT; code++) {
+		if (libevdev_has_property(evdev, code))
+			recording_description_enable_property(desc, code);
+	}
+
+	for (type = 0; type < EV_CNT; type++) {
+		max = libevdev_event_type_get_max(type);
+		for (code = 0; max != -1 && code <= (unsigned int)max; code++) {
+			if (!libevdev_has_event_code(evdev, type, code))
+				continue;
+
+			recording_description_enable_code(desc, type, code);
+
+			if (type == EV_ABS) {
+				absinfo = libevdev_get_abs_info(evdev, code);
+				desc->abs[code] = *absinfo;
+			} else if (type == EV_REP) {
+				desc->rep[code] = libevdev_get_event_value(evdev,
+									   type,
+									   code);
+			}
+		}
+	}
+
+	describe_udev_properties(desc, path);
+}
+
+static int
+record_events(struct libevdev *evdev,
+	      struct recording_writer *writer,
+	      int signal_fd)
+{
+	struct pollfd fds[2];
+	struct input_event ev;
+	unsigned int flags = LIBEVDEV_READ_FLAG_NORMAL;
+	int rc;
+
+	fds[0].fd = libevdev_get_fd(evdev);
+	fds[0].events = POLLIN;
+	fds[1].fd = signal_fd;
+	fds[1].events = POLLIN;
+
+	while (poll(fds, 2, -1) > -1) {
+		if (fds[1].revents)
+			break;
+
+		do {
+			rc = libevdev_next_event(evdev, flags, &ev);
+			if (rc == LIBEVDEV_READ_STATUS_SYNC) {
+				/* Record what libevdev syncs us up with
+				 * instead of the SYN_DROPPED */
+				if (flags == LIBEVDEV_READ_FLAG_NORMAL) {
+					fprintf(stderr, "SYN_DROPPED, events were lost\n");
+					flags = LIBEVDEV_READ_FLAG_SYNC;
+					continue;
+				}
+			} else if (rc == -EAGAIN &&
+				   flags == LIBEVDEV_READ_FLAG_SYNC) {
+				flags = LIBEVDEV_READ_FLAG_NORMAL;
+				rc = LIBEVDEV_READ_STATUS_SUCCESS;
+				continue;
+			}
+
+			if (rc < 0)
+				break;
+
+			if (recording_writer_add(writer, &ev) < 0)
+				return -1;
+		} while (rc >= 0);
+
+		if (rc != -EAGAIN) {
+			fprintf(stderr, "Failed to read events: %s\n",
+				strerror(-rc));
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *output = "recording.lirec";
+	struct recording_description desc;
+	struct recording_writer *writer;
+	struct libevdev *evdev;
+	sigset_t mask;
+	int fd, out_fd, signal_fd;
+	int rc;
+
+	while (1) {
+		int c;
+		int option_index = 0;
+		static struct option opts[] = {
+			{ "output", 1, 0, OPT_OUTPUT },
+			{ "help", 0, 0, OPT_HELP },
+			{ 0, 0, 0, 0}
+		};
+
+		c = getopt_long(argc, argv, "ho:", opts, &option_index);
+		if (c == -1)
+			break;
+
+		switch(c) {
+			case 'h':
+			case OPT_HELP:
+				usage();
+				return 0;
+			case 'o':
+			case OPT_OUTPUT:
+				output = optarg;
+				break;
+			default:
+				usage();
+				return 1;
+		}
+	}
+
+	if (optind != argc - 1) {
+		usage();
+		return 1;
+	}
+
+	fd = open(argv[optind], O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to open %s (%s)\n",
+			argv[optind], strerror(errno));
+		return 1;
+	}
+
+	rc = libevdev_new_from_fd(fd, &evdev);
+	if (rc != 0) {
+		fprintf(stderr, "Failed to init device (%s)\n", strerror(-rc));
+		close(fd);
+		return 1;
+	}
+	libevdev_set_clock_id(evdev, CLOCK_MONOTONIC);
+
+	describe_device(&desc, evdev, argv[optind]);
+
+	out_fd = open(output, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (out_fd < 0) {
+		fprintf(stderr, "Failed to create %s (%s)\n",
+			output, strerror(errno));
+		rc = 1;
+		goto out;
+	}
+
+	writer = recording_writer_new(out_fd, &desc);
+	if (!writer) {
+		fprintf(stderr, "Failed to write to %s\n", output);
+		rc = 1;
+		goto out;
+	}
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (signal_fd == -1 ||
+	    sigprocmask(SIG_BLOCK, &mask, NULL) == -1) {
+		fprintf(stderr, "Failed to set up signal handling (%s)\n",
+			strerror(errno));
+		recording_writer_finish(writer);
+		rc = 1;
+		goto out;
+	}
+
+	printf("Recording \"%s\" to %s, Ctrl+C to stop\n", desc.name, output);
+
+	rc = record_events(evdev, writer, signal_fd) == 0 ? 0 : 1;
+	if (recording_writer_finish(writer) != 0) {
+		fprintf(stderr, "Failed to write %s\n", output);
+		rc = 1;
+	}
+
+	close(signal_fd);
+out:
+	if (out_fd >= 0)
+		close(out_fd);
+	libevdev_free(evdev);
+	close(fd);
+
+	return rc;
+}
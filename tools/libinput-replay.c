@@ -0,0 +1,191 @@
+/*
+ * Copyright © 2015 Red Hat, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* Replays a recording from libinput-record through libinput as fast as
+ * possible. Timeouts expire in recorded time, so the output is the same
+ * as for the live events, and the time taken is libinput's CPU cost. */
+
+#define _GNU_SOURCE
+#include <config.h>
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "replay.h"
+
+enum options {
+	OPT_SEEK,
+	OPT_PRINT,
+	OPT_ENABLE_TAP,
+	OPT_HELP,
+};
+
+static int
+open_restricted(const char *path, int flags, void *user_data)
+{
+	return -ENODEV;
+}
+
+static void
+close_restricted(int fd, void *user_data)
+{
+}
+
+static const struct libinput_interface interface = {
+	.open_restricted = open_restricted,
+	.close_restricted = close_restricted,
+};
+
+static void
+usage(void)
+{
+	printf("Usage: %s [options] recording.lirec\n"
+	       "--seek <s> ...... Start <s> seconds into the recording\n"
+	       "--print ......... Print the libinput events\n"
+	       "--enable-tap .... Enable tap-to-click\n"
+	       "--help .......... Print this help.\n",
+	       program_invocation_short_name);
+}
+
+static inline uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t
+handle_events(struct libinput *li, int print)
+{
+	struct libinput_event *event;
+	uint64_t count = 0;
+	char buf[256];
+
+	while ((event = libinput_get_event(li))) {
+		if (print) {
+			replay_format_event(event, buf, sizeof(buf));
+			printf("%s\n", buf);
+		}
+		libinput_event_destroy(event);
+		count++;
+	}
+
+	return count;
+}
+
+int
+main(int argc, char **argv)
+{
+	struct replay *replay;
+	double seek = 0;
+	int print = 0, tap = 0;
+	uint64_t start, ns, nout = 0;
+	int rc;
+
+	while (1) {
+		int c;
+		int option_index = 0;
+		static struct option opts[] = {
+			{ "seek", 1, 0, OPT_SEEK },
+			{ "print", 0, 0, OPT_PRINT },
+			{ "enable-tap", 0, 0, OPT_ENABLE_TAP },
+			{ "help", 0, 0, OPT_HELP },
+			{ 0, 0, 0, 0}
+		};
+
+		c = getopt_long(argc, argv, "h", opts, &option_index);
+		if (c == -1)
+			break;
+
+		switch(c) {
+			case 'h':
+			case OPT_HELP:
+				usage();
+				return 0;
+			case OPT_SEEK:
+				seek = atof(optarg);
+				break;
+			case OPT_PRINT:
+				print = 1;
+				break;
+			case OPT_ENABLE_TAP:
+				tap = 1;
+				break;
+			default:
+				usage();
+				return 1;
+		}
+	}
+
+	if (optind != argc - 1 || seek < 0) {
+		usage();
+		return 1;
+	}
+
+	replay = replay_new(argv[optind], &interface, NULL);
+	if (!replay) {
+		fprintf(stderr, "Failed to replay %s\n", argv[optind]);
+		return 1;
+	}
+
+	if (tap)
+		libinput_device_config_tap_set_enabled(replay->device,
+						       LIBINPUT_CONFIG_TAP_ENABLED);
+
+	if (seek > 0 && replay_seek(replay, seek * 1000000) != 0) {
+		fprintf(stderr, "Recording has no index, can't seek\n");
+		replay_destroy(replay);
+		return 1;
+	}
+
+	nout += handle_events(replay->libinput, print);
+
+	start = now_ns();
+	while ((rc = replay_next_frame(replay)) > 0)
+		nout += handle_events(replay->libinput, print);
+	if (rc == 0)
+		rc = replay_finish(replay, 5000);
+	nout += handle_events(replay->libinput, print);
+	ns = now_ns() - start;
+
+	if (rc < 0)
+		fprintf(stderr, "Replay failed: %s\n", strerror(-rc));
+
+	fprintf(stderr,
+		"%" PRIu64 " events in %" PRIu64 " frames, "
+		"%" PRIu64 " libinput events, %.1f ms, %.1f ns/frame\n",
+		replay->nevents, replay->nframes, nout,
+		ns / 1000000.0,
+		replay->nframes ? (double)ns / replay->nframes : 0.0);
+
+	replay_destroy(replay);
+
+	return rc < 0 ? 1 : 0;
+}
@@ -0,0 +1,267 @@
+/*
+ * Copyright © 2015 Red Hat, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* Feeds the same synthetic Protocol A event stream through mtdev and
+ * through libinput's built-in conversion and prints the time per frame
+ * for both. */
+
+#define _GNU_SOURCE
+#include <config.h>
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <mtdev-plumbing.h>
+
+#include "evdev-mt-protocol-a.h"
+
+#define AXIS_MAX 4095
+
+enum options {
+	OPT_FRAMES,
+	OPT_CONTACTS,
+	OPT_HELP,
+};
+
+static void
+usage(void)
+{
+	printf("Usage: %s [options]\n"
+	       "--frames <n> .... Number of frames to convert (default 1000000)\n"
+	       "--contacts <n> .. Maximum number of contacts per frame (default 5)\n"
+	       "--help .......... Print this help.\n",
+	       program_invocation_short_name);
+}
+
+static inline void
+append_event(struct input_event *events,
+	     size_t *nevents,
+	     unsigned int frame,
+	     uint16_t type,
+	     uint16_t code,
+	     int32_t value)
+{
+	struct input_event *ev = &events[(*nevents)++];
+
+	/* 8ms per frame, like most touchscreens */
+	ev->time.tv_sec = frame / 125;
+	ev->time.tv_usec = (frame % 125) * 8000;
+	ev->type = type;
+	ev->code = code;
+	ev->value = value;
+}
+
+/* Contacts come and go every few hundred frames and wander around
+ * diagonally, the order within each frame is reversed every other frame
+ * so the conversion has to do actual matching. */
+static struct input_event *
+generate_events(unsigned int nframes,
+		unsigned int max_contacts,
+		size_t *nevents_out)
+{
+	struct input_event *events;
+	size_t nevents = 0;
+	unsigned int frame, i, ncontacts;
+
+	events = calloc((size_t)nframes * (max_contacts * 3 + 1),
+			sizeof(*events));
+	if (!events)
+		return NULL;
+
+	for (frame = 0; frame < nframes; frame++) {
+		ncontacts = 1 + (frame / 300) % max_contacts;
+
+		for (i = 0; i < ncontacts; i++) {
+			unsigned int c = (frame % 2) ? ncontacts - i - 1 : i;
+			int32_t x = (c * 700 + frame) % AXIS_MAX,
+				y = (c * 500 + frame * 2) % AXIS_MAX;
+
+			append_event(events, &nevents, frame,
+				     EV_ABS, ABS_MT_POSITION_X, x);
+			append_event(events, &nevents, frame,
+				     EV_ABS, ABS_MT_POSITION_Y, y);
+			append_event(events, &nevents, frame,
+				     EV_SYN, SYN_MT_REPORT, 0);
+		}
+		append_event(events, &nevents, frame, EV_SYN, SYN_REPORT, 0);
+	}
+
+	*nevents_out = nevents;
+
+	return events;
+}
+
+static inline uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t
+run_mtdev(const struct input_event *events,
+	  size_t nevents,
+	  size_t *nout)
+{
+	struct mtdev *mtdev;
+	struct input_event e;
+	uint64_t start, end;
+	size_t i;
+
+	mtdev = mtdev_new();
+	if (!mtdev || mtdev_init(mtdev) != 0) {
+		fprintf(stderr, "Failed to create mtdev context\n");
+		exit(1);
+	}
+
+	mtdev_set_mt_event(mtdev, ABS_MT_POSITION_X, 1);
+	mtdev_set_abs_minimum(mtdev, ABS_MT_POSITION_X, 0);
+	mtdev_set_abs_maximum(mtdev, ABS_MT_POSITION_X, AXIS_MAX);
+	mtdev_set_mt_event(mtdev, ABS_MT_POSITION_Y, 1);
+	mtdev_set_abs_minimum(mtdev, ABS_MT_POSITION_Y, 0);
+	mtdev_set_abs_maximum(mtdev, ABS_MT_POSITION_Y, AXIS_MAX);
+
+	*nout = 0;
+	start = now_ns();
+	for (i = 0; i < nevents; i++) {
+		mtdev_put_event(mtdev, &events[i]);
+		if (events[i].type == EV_SYN &&
+		    events[i].code == SYN_REPORT) {
+			while (!mtdev_empty(mtdev)) {
+				mtdev_get_event(mtdev, &e);
+				(*nout)++;
+			}
+		}
+	}
+	end = now_ns();
+
+	mtdev_delete(mtdev);
+
+	return end - start;
+}
+
+static void
+count_event(struct input_event *ev, void *data)
+{
+	size_t *nout = data;
+
+	(*nout)++;
+}
+
+static uint64_t
+run_protocol_a(const struct input_event *events,
+	       size_t nevents,
+	       size_t *nout)
+{
+	struct mt_protocol_a mt;
+	struct input_event e;
+	uint64_t start, end;
+	size_t i;
+
+	*nout = 0;
+	mt_protocol_a_init(&mt, count_event, nout);
+
+	start = now_ns();
+	for (i = 0; i < nevents; i++) {
+		/* libinput gets a writable copy from libevdev too */
+		e = events[i];
+		mt_protocol_a_process(&mt, &e);
+	}
+	end = now_ns();
+
+	return end - start;
+}
+
+int
+main(int argc, char **argv)
+{
+	unsigned int nframes = 1000000,
+		     max_contacts = 5;
+	struct input_event *events;
+	size_t nevents, nout;
+	uint64_t ns;
+
+	while (1) {
+		int c;
+		int option_index = 0;
+		static struct option opts[] = {
+			{ "frames", 1, 0, OPT_FRAMES },
+			{ "contacts", 1, 0, OPT_CONTACTS },
+			{ "help", 0, 0, OPT_HELP },
+			{ 0, 0, 0, 0}
+		};
+
+		c = getopt_long(argc, argv, "h", opts, &option_index);
+		if (c == -1)
+			break;
+
+		switch(c) {
+			case 'h':
+			case OPT_HELP:
+				usage();
+				return 0;
+			case OPT_FRAMES:
+				nframes = atoi(optarg);
+				break;
+			case OPT_CONTACTS:
+				max_contacts = atoi(optarg);
+				break;
+			default:
+				usage();
+				return 1;
+		}
+	}
+
+	if (nframes == 0 ||
+	    max_contacts == 0 ||
+	    max_contacts > MT_PROTOCOL_A_MAX_SLOTS) {
+		usage();
+		return 1;
+	}
+
+	events = generate_events(nframes, max_contacts, &nevents);
+	if (!events) {
+		fprintf(stderr, "Failed to allocate %u frames\n", nframes);
+		return 1;
+	}
+
+	printf("%u frames, up to %u contacts, %zu events\n",
+	       nframes, max_contacts, nevents);
+
+	ns = run_mtdev(events, nevents, &nout);
+	printf("mtdev:      %8.1f ns/frame, %zu events out\n",
+	       (double)ns / nframes, nout);
+
+	ns = run_protocol_a(events, nevents, &nout);
+	printf("built-in:   %8.1f ns/frame, %zu events out\n",
+	       (double)ns / nframes, nout);
+
+	free(events);
+
+	return 0;
+}